@@ -1,4 +1,10 @@
 -- premake5.lua
+newoption
+{
+   trigger = "io-uring",
+   description = "Run Asio on io_uring instead of epoll (Linux only, requires liburing and kernel 5.10+)"
+}
+
 workspace "clover"
    architecture "x64"
    configurations { "Debug", "Release" }
@@ -44,6 +50,13 @@ workspace "clover"
           "crypto"
       }
 
+   -- io_uring backend. These change the layout of Asio's types, so every project in the workspace
+   -- must be built with the same setting. BOOST_ASIO_DISABLE_EPOLL makes io_uring the backend for
+   -- sockets and timers as well, not just for files.
+   filter { "system:linux", "options:io-uring" }
+      defines { "BOOST_ASIO_HAS_IO_URING", "BOOST_ASIO_DISABLE_EPOLL" }
+      links { "uring" }
+
    filter "configurations:Debug"
       defines { "DEBUG" }
       runtime "Debug"
@@ -80,4 +93,5 @@ OutputDir = "%{cfg.system}-%{cfg.architecture}/%{cfg.buildcfg}"
 
 
 include "Clover/Build-Clover.lua"
-include "Sandbox/Build-Sandbox.lua"
\ No newline at end of file
+include "Sandbox/Build-Sandbox.lua"
+include "Tests/Build-Tests.lua"
\ No newline at end of file
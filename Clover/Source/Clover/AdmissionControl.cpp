@@ -0,0 +1,123 @@
+#include "pch.hpp"
+#include "AdmissionControl.hpp"
+
+namespace Clover
+{
+    AdmissionControl::ConnectionSlot::ConnectionSlot(ConnectionSlot&& other) noexcept :
+        m_owner(std::exchange(other.m_owner, nullptr)),
+        m_address(other.m_address)
+    {}
+    AdmissionControl::ConnectionSlot& AdmissionControl::ConnectionSlot::operator=(ConnectionSlot&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            m_owner = std::exchange(other.m_owner, nullptr);
+            m_address = other.m_address;
+        }
+        return *this;
+    }
+    void AdmissionControl::ConnectionSlot::Release() noexcept
+    {
+        if (m_owner != nullptr)
+            std::exchange(m_owner, nullptr)->ReleaseConnection(m_address);
+    }
+
+    AdmissionControl::RequestSlot& AdmissionControl::RequestSlot::operator=(RequestSlot&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            m_owner = std::exchange(other.m_owner, nullptr);
+        }
+        return *this;
+    }
+    void AdmissionControl::RequestSlot::Release() noexcept
+    {
+        if (m_owner != nullptr)
+            std::exchange(m_owner, nullptr)->ReleaseRequest();
+    }
+
+    AdmissionControl::ConnectionSlot AdmissionControl::TryAdmitConnection(const net::ip::address& address) noexcept
+    {
+        // Take the place first and give it back if that went over the limit, so that two threads can't
+        // both see the last free place
+        std::size_t connections = m_connections.fetch_add(1, std::memory_order_relaxed);
+        if (m_limits.maxConnections > 0 && connections >= m_limits.maxConnections)
+        {
+            m_connections.fetch_sub(1, std::memory_order_relaxed);
+            m_rejectedConnections.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+
+        if (m_limits.maxConnectionsPerIP > 0)
+        {
+            try
+            {
+                std::lock_guard lock(m_perIPMutex);
+                std::size_t& count = m_perIP[address];
+                if (count >= m_limits.maxConnectionsPerIP)
+                {
+                    m_connections.fetch_sub(1, std::memory_order_relaxed);
+                    m_rejectedConnections.fetch_add(1, std::memory_order_relaxed);
+                    return {};
+                }
+                ++count;
+            }
+            catch (...)
+            {
+                // Out of memory for the map. Turning the connection away is the safe answer
+                m_connections.fetch_sub(1, std::memory_order_relaxed);
+                m_rejectedConnections.fetch_add(1, std::memory_order_relaxed);
+                return {};
+            }
+        }
+
+        return ConnectionSlot(this, address);
+    }
+
+    AdmissionControl::RequestSlot AdmissionControl::TryBeginRequest() noexcept
+    {
+        std::size_t inFlight = m_inFlightRequests.fetch_add(1, std::memory_order_relaxed);
+        if (m_limits.maxInFlightRequests > 0 && inFlight >= m_limits.maxInFlightRequests)
+        {
+            m_inFlightRequests.fetch_sub(1, std::memory_order_relaxed);
+            m_shedRequests.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+        return RequestSlot(this);
+    }
+
+    void AdmissionControl::ReleaseConnection(const net::ip::address& address) noexcept
+    {
+        if (m_limits.maxConnectionsPerIP > 0)
+        {
+            std::lock_guard lock(m_perIPMutex);
+            auto itr = m_perIP.find(address);
+            if (itr != m_perIP.end() && --itr->second == 0)
+                m_perIP.erase(itr);
+        }
+
+        m_connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    std::size_t AdmissionControl::AddressHash::operator()(const net::ip::address& address) const noexcept
+    {
+        if (address.is_v4())
+            return std::hash<std::uint32_t>{}(address.to_v4().to_uint());
+
+        auto bytes = address.to_v6().to_bytes();
+        return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+    }
+
+    AdmissionStats AdmissionControl::GetStats() const noexcept
+    {
+        return {
+            .connections = m_connections.load(std::memory_order_relaxed),
+            .inFlightRequests = m_inFlightRequests.load(std::memory_order_relaxed),
+            .rejectedConnections = m_rejectedConnections.load(std::memory_order_relaxed),
+            .shedRequests = m_shedRequests.load(std::memory_order_relaxed),
+            .acceptPauses = m_acceptPauses.load(std::memory_order_relaxed)
+        };
+    }
+}
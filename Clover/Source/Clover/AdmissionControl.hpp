@@ -0,0 +1,138 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // How much work the server takes on at once (see Application::SetAdmissionLimits). Past these limits,
+    // new connections are turned away and new requests get a fast 503 - Service Unavailable, so a traffic
+    // spike costs the clients that arrive late some retries instead of costing everyone memory and latency.
+    // 0 means unlimited, which is the default for all of them.
+    struct AdmissionLimits
+    {
+        // Open connections, across every listener (and every shard). Websocket connections count as well.
+        // While at the limit, listeners stop accepting and new connections wait in the kernel's backlog.
+        std::size_t maxConnections = 0;
+
+        // Open connections from any one client address. A connection over the limit is closed as soon as
+        // it is accepted.
+        std::size_t maxConnectionsPerIP = 0;
+
+        // Requests whose header has been read but that have not been answered yet, across all connections.
+        // A request over the limit is answered with 503 - Service Unavailable and the connection is closed,
+        // before its body is read or any target sees it. Middleware only sees the response, in After.
+        std::size_t maxInFlightRequests = 0;
+
+        // Sent as Retry-After with a shed request's 503
+        std::chrono::seconds retryAfter = std::chrono::seconds(1);
+
+        // How often a paused listener checks whether it can accept again
+        std::chrono::milliseconds acceptPauseInterval = std::chrono::milliseconds(50);
+    };
+
+    // A snapshot of the admission counters
+    struct AdmissionStats
+    {
+        std::size_t connections;
+        std::size_t inFlightRequests;
+        std::uint64_t rejectedConnections;
+        std::uint64_t shedRequests;
+        std::uint64_t acceptPauses;
+    };
+
+    // Counts connections and in-flight requests against the AdmissionLimits. Each admitted connection or
+    // request is represented by a slot, which gives its place back when it is released or destroyed, so
+    // a session only has to hold on to its slots. Safe to use from any thread.
+    class AdmissionControl
+    {
+    public:
+        class ConnectionSlot
+        {
+        public:
+            ConnectionSlot() noexcept = default;
+            ConnectionSlot(ConnectionSlot&& other) noexcept;
+            ConnectionSlot& operator=(ConnectionSlot&& other) noexcept;
+            ConnectionSlot(const ConnectionSlot&) = delete;
+            ConnectionSlot& operator=(const ConnectionSlot&) = delete;
+            ~ConnectionSlot() noexcept { Release(); }
+
+            // False if the connection was not admitted
+            ND explicit operator bool() const noexcept { return m_owner != nullptr; }
+            void Release() noexcept;
+
+        private:
+            friend class AdmissionControl;
+            ConnectionSlot(AdmissionControl* owner, const net::ip::address& address) noexcept :
+                m_owner(owner),
+                m_address(address)
+            {}
+
+            AdmissionControl* m_owner = nullptr;
+            net::ip::address m_address;
+        };
+
+        class RequestSlot
+        {
+        public:
+            RequestSlot() noexcept = default;
+            RequestSlot(RequestSlot&& other) noexcept : m_owner(std::exchange(other.m_owner, nullptr)) {}
+            RequestSlot& operator=(RequestSlot&& other) noexcept;
+            RequestSlot(const RequestSlot&) = delete;
+            RequestSlot& operator=(const RequestSlot&) = delete;
+            ~RequestSlot() noexcept { Release(); }
+
+            // False if the request was shed
+            ND explicit operator bool() const noexcept { return m_owner != nullptr; }
+            void Release() noexcept;
+
+        private:
+            friend class AdmissionControl;
+            explicit RequestSlot(AdmissionControl* owner) noexcept : m_owner(owner) {}
+
+            AdmissionControl* m_owner = nullptr;
+        };
+
+        AdmissionControl() noexcept = default;
+        AdmissionControl(const AdmissionControl&) = delete;
+        AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+        // Should only be called before the server starts
+        inline void SetLimits(const AdmissionLimits& limits) noexcept { m_limits = limits; }
+        ND inline const AdmissionLimits& Limits() const noexcept { return m_limits; }
+
+        // An empty slot means the connection or request must be turned away
+        ND ConnectionSlot TryAdmitConnection(const net::ip::address& address) noexcept;
+        ND RequestSlot TryBeginRequest() noexcept;
+
+        // True while the server is at maxConnections, in which case listeners should stop accepting
+        ND inline bool AtConnectionLimit() const noexcept
+        {
+            return m_limits.maxConnections > 0 && m_connections.load(std::memory_order_relaxed) >= m_limits.maxConnections;
+        }
+
+        // Called by a listener each time it pauses accepting
+        inline void CountAcceptPause() noexcept { m_acceptPauses.fetch_add(1, std::memory_order_relaxed); }
+
+        ND AdmissionStats GetStats() const noexcept;
+
+    private:
+        void ReleaseConnection(const net::ip::address& address) noexcept;
+        inline void ReleaseRequest() noexcept { m_inFlightRequests.fetch_sub(1, std::memory_order_relaxed); }
+
+        AdmissionLimits m_limits;
+
+        std::atomic<std::size_t> m_connections = 0;
+        std::atomic<std::size_t> m_inFlightRequests = 0;
+        std::atomic<std::uint64_t> m_rejectedConnections = 0;
+        std::atomic<std::uint64_t> m_shedRequests = 0;
+        std::atomic<std::uint64_t> m_acceptPauses = 0;
+
+        // Open connections per client address. Only kept when maxConnectionsPerIP is set, and only touched
+        // when a connection opens or closes, never per request.
+        struct AddressHash
+        {
+            ND std::size_t operator()(const net::ip::address& address) const noexcept;
+        };
+        std::mutex m_perIPMutex;
+        std::unordered_map<net::ip::address, std::size_t, AddressHash> m_perIP;
+    };
+}
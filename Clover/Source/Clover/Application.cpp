@@ -7,6 +7,9 @@
 
 namespace Clover
 {
+    // The shard whose thread this is, when the server is sharded (see IOShard)
+    static thread_local IOShard* t_currentShard = nullptr;
+
     // =====================================================
     // Application
     Application::Application(std::string_view address, unsigned short port, unsigned int threads,
@@ -14,7 +17,9 @@ namespace Clover
         m_ioc(threads),
         m_threads(threads),
         m_ctx{ ssl::context::tlsv12 },
-        m_injaEnv()
+        m_injaEnv(),
+        m_templateCache(m_injaEnv),
+        m_pageCache(m_computePool)
     {
         assert(m_threads > 0);
 
@@ -25,14 +30,8 @@ namespace Clover
             // This holds the self-signed certificate used by the server
             LoadServerCertificate(cert, key, dh);
 
-            // Create and launch a listening port
-            std::make_shared<Listener>(
-                m_ioc,
-                m_ctx,
-                tcp::endpoint{ net::ip::make_address(address), port },
-                this)->Run();
-
-            LOG_INFO("[CORE] Started listening on {0}:{1}", address, port);
+            // The listener(s) are created in Run(), once we know whether the server is sharded
+            m_endpoint = tcp::endpoint{ net::ip::make_address(address), port };
         }
         catch (const boost::exception& e)
         {
@@ -131,6 +130,45 @@ namespace Clover
 
     void Application::Run() noexcept
     {
+        // Decide where each thread will run before any of them are started
+        m_threadPlan = ThreadPlan(m_threadPlacement, m_threads);
+
+        // Index the document root so that requests can be resolved without touching the filesystem
+        if (!m_documentIndex.IsBuilt())
+            m_documentIndex.Build(m_docRoot);
+        m_documentIndex.StartRefreshing(m_documentIndexRefreshInterval);
+
+        // Render the error pages now so that serving one only requires splicing in the reason
+        m_badRequestPage.Prepare(m_documentIndex, m_templateCache, m_serverVersion);
+        m_notFoundPage.Prepare(m_documentIndex, m_templateCache, m_serverVersion);
+        m_internalServerErrorPage.Prepare(m_documentIndex, m_templateCache, m_serverVersion);
+        m_serviceUnavailablePage.Prepare(m_documentIndex, m_templateCache, m_serverVersion);
+        m_payloadTooLargePage.Prepare(m_documentIndex, m_templateCache, m_serverVersion);
+        m_methodNotAllowedPage.Prepare(m_documentIndex, m_templateCache, m_serverVersion);
+
+        // Large request bodies are spooled to disk (see RequestBody)
+        if (m_requestBodySpoolDirectory.empty())
+        {
+            std::error_code ec;
+            m_requestBodySpoolDirectory = std::filesystem::temp_directory_path(ec);
+            if (ec)
+            {
+                LOG_WARN("[CORE] Failed to find the temporary directory ({0}). Large request bodies will be written to the working directory", ec.message());
+                m_requestBodySpoolDirectory = ".";
+            }
+        }
+
+        // Writing spooled bodies out is the one thing a request does that can block on the disk. A single thread
+        // is enough to keep up with the network, and keeps uploads from competing with each other for the disk.
+        m_spoolPool.emplace(1);
+
+        // CPU bound targets and data providers run on their own threads so that they don't compete with the io threads
+        if (m_needsComputePool)
+        {
+            unsigned int computeThreads = m_computeThreads > 0 ? m_computeThreads : std::max(std::thread::hardware_concurrency() / 2, 1u);
+            m_computePool.Start(computeThreads, [this](std::size_t) { m_threadPlan.ApplyToComputeThread(); });
+        }
+
         // Capture SIGINT and SIGTERM to perform a clean shutdown
         net::signal_set signals(m_ioc, SIGINT, SIGTERM);
         signals.async_wait(
@@ -142,18 +180,130 @@ namespace Clover
                 // to return immediately, eventually destroying the
                 // `io_context` and all of the sockets in it.
                 m_ioc.stop();
+                for (auto& shard : m_shards)
+                {
+                    if (shard != nullptr)
+                        shard->ioc.stop();
+                }
             });
 
+        LOG_INFO("[CORE] I/O backend: {0}", IOBackend());
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+        // An io_context has a single ring, and every thread that runs it contends on the ring's lock
+        // to submit and reap. One ring per thread is what lets submissions batch up without contention.
+        if (!m_ioSharding && m_threads > 1)
+            LOG_WARN("[CORE] {0} io threads are sharing one io_uring. Consider SetIOSharding(true)", m_threads);
+#endif
+
+        if (m_ioSharding)
+            RunSharded();
+        else
+            RunShared();
+
+        m_documentIndex.StopRefreshing();
+        m_computePool.Stop();
+        m_spoolPool->stop();
+        m_spoolPool->join();
+    }
+    void Application::RunShared()
+    {
+        // Connections can be accepted on a thread of their own, so that accepting never waits behind requests
+        std::optional<net::io_context> acceptIoc;
+        if (m_threadPlan.IsolateAccept())
+            acceptIoc.emplace(1);
+
+        // Create and launch the listening ports
+        for (const ListenerEndpoint& listener : Listeners())
+        {
+            std::make_shared<Listener>(m_ioc, m_ctx, listener.endpoint, listener.options, this, nullptr, acceptIoc.has_value() ? &*acceptIoc : nullptr)->Run();
+            LOG_INFO("[CORE] Started listening on {0}:{1} ({2})", listener.endpoint.address().to_string(), listener.endpoint.port(), ListenerProtocolName(listener.options.protocol));
+        }
+
+        std::thread acceptThread;
+        if (acceptIoc.has_value())
+        {
+            acceptThread = std::thread(
+                [&]
+                {
+                    m_threadPlan.ApplyToAcceptThread();
+                    acceptIoc->run();
+                });
+        }
+
         // Run the I/O service on the requested number of threads
         LOG_INFO("[CORE] Spawning {0} worker threads", m_threads);
         std::vector<std::thread> v;
         v.reserve(m_threads - 1);
         for (auto i = m_threads - 1; i > 0; --i)
             v.emplace_back(
-                [&]
+                [this, i]
                 {
+                    m_threadPlan.ApplyToIOThread(i);
                     m_ioc.run();
                 });
+        m_threadPlan.ApplyToIOThread(0);
+        m_ioc.run();
+
+        // (If we get here, it means we got a SIGINT or SIGTERM)
+
+        // Block until all the threads exit
+        for (auto& t : v)
+            t.join();
+
+        if (acceptIoc.has_value())
+        {
+            acceptIoc->stop();
+            acceptThread.join();
+        }
+    }
+    void Application::RunSharded()
+    {
+        if (m_threadPlan.IsolateAccept())
+            LOG_WARN("[CORE] ThreadPlacement::isolateAccept is ignored when sharding, every shard accepts its own connections");
+
+        // Each shard is created on its own thread, after the thread has been placed, so that its io_context
+        // and everything its connections allocate come from the memory of that thread's NUMA node. Every
+        // shard binds the same endpoint with SO_REUSEPORT, and the kernel spreads new connections across them.
+        const std::vector<ListenerEndpoint> listeners = Listeners();
+        LOG_INFO("[CORE] Spawning {0} worker threads", m_threads);
+        m_shards.resize(m_threads);
+        std::latch ready(m_threads);
+        std::vector<std::thread> v;
+        v.reserve(m_threads);
+        for (unsigned int iii = 0; iii < m_threads; ++iii)
+            v.emplace_back(
+                [this, iii, &ready, &listeners]
+                {
+                    m_threadPlan.ApplyToIOThread(iii);
+
+                    try
+                    {
+                        m_shards[iii] = std::make_unique<IOShard>(iii);
+                        for (const ListenerEndpoint& listener : listeners)
+                            std::make_shared<Listener>(m_shards[iii]->ioc, m_ctx, listener.endpoint, listener.options, this, m_shards[iii].get())->Run();
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LOG_ERROR("[CORE] Failed to start shard {0}. Caught std::exception: \n'{1}'", iii, e.what());
+                        m_shards[iii].reset();
+                    }
+
+                    IOShard* shard = m_shards[iii].get();
+                    ready.count_down();
+                    if (shard == nullptr)
+                        return;
+
+                    t_currentShard = shard;
+                    shard->ioc.run();
+                });
+
+        // The signal handler touches every shard, so don't let it run until they all exist
+        ready.wait();
+        for (const ListenerEndpoint& listener : listeners)
+            LOG_INFO("[CORE] Started listening on {0}:{1} ({2}) with {3} shards", listener.endpoint.address().to_string(), listener.endpoint.port(), ListenerProtocolName(listener.options.protocol), m_threads);
+
+        // The shared io_context is left with the signal handler and background work that isn't tied to a
+        // connection, which this thread runs
         m_ioc.run();
 
         // (If we get here, it means we got a SIGINT or SIGTERM)
@@ -162,30 +312,182 @@ namespace Clover
         for (auto& t : v)
             t.join();
     }
+    void Application::AddListener(std::string_view address, unsigned short port, const ListenerOptions& options)
+    {
+        beast::error_code ec;
+        net::ip::address ip = net::ip::make_address(address, ec);
+        if (ec)
+        {
+            LOG_ERROR("[CORE] AddListener failed. Invalid address '{0}': '{1}'", address, ec.message());
+            return;
+        }
+        m_additionalListeners.push_back({ tcp::endpoint{ ip, port }, options });
+    }
+    std::vector<ListenerEndpoint> Application::Listeners() const
+    {
+        std::vector<ListenerEndpoint> listeners;
+        listeners.reserve(m_additionalListeners.size() + 1);
+        listeners.push_back({ m_endpoint, m_listenerOptions });
+        listeners.insert(listeners.end(), m_additionalListeners.begin(), m_additionalListeners.end());
+        return listeners;
+    }
+
+    std::vector<IOShardStats> Application::GetIOShardStats() const
+    {
+        std::vector<IOShardStats> stats;
+        stats.reserve(m_shards.size());
+        for (const auto& shard : m_shards)
+        {
+            if (shard == nullptr)
+                continue;
+            stats.push_back({
+                .index = shard->index,
+                .connectionsAccepted = shard->connectionsAccepted.load(std::memory_order_relaxed),
+                .acceptErrors = shard->acceptErrors.load(std::memory_order_relaxed),
+                .requestsHandled = shard->requestsHandled.load(std::memory_order_relaxed) });
+        }
+        return stats;
+    }
+
+    // Data gathering functions that don't take a context are wrapped in one that does
+    static Application::ContextDataGatherFn WithContext(Application::DataGatherFn dataGatherFn)
+    {
+        if (!dataGatherFn)
+            return {};
+        return [dataGatherFn = std::move(dataGatherFn)](const Application::ParametersMap& parameters, const RequestContext&) { return dataGatherFn(parameters); };
+    }
+    static Application::AsyncContextDataGatherFn WithContext(Application::AsyncDataGatherFn dataGatherFn)
+    {
+        if (!dataGatherFn)
+            return {};
+        return [dataGatherFn = std::move(dataGatherFn)](const Application::ParametersMap& parameters, const RequestContext&) { return dataGatherFn(parameters); };
+    }
+
+    // PUT and POST functions that don't need the body are wrapped in one that takes it
+    static Application::BodyDataGatherFn WithBody(Application::ContextDataGatherFn dataGatherFn)
+    {
+        if (!dataGatherFn)
+            return {};
+        return [dataGatherFn = std::move(dataGatherFn)](const Application::ParametersMap& parameters, const RequestBody&, const RequestContext& context) { return dataGatherFn(parameters, context); };
+    }
 
-    void Application::RegisterGETTarget(const std::string& target, DataGatherFn dataGatherFn) noexcept 
+    void Application::RegisterGETTarget(const std::string& target, DataGatherFn dataGatherFn, const TargetOptions& options) noexcept 
     { 
-        if (m_GETTargets.find(target) != m_GETTargets.end())
-            LOG_ERROR("[CORE] Cannot register GET target '{0}' because it already exists", target);
-        else
-            m_GETTargets.insert(std::make_pair(target, dataGatherFn)); 
+        RegisterGETTarget(target, WithContext(std::move(dataGatherFn)), options);
     }
-    void Application::RegisterPUTTarget(const std::string& target, DataGatherFn dataGatherFn) noexcept 
+    void Application::RegisterPUTTarget(const std::string& target, DataGatherFn dataGatherFn, const TargetOptions& options) noexcept 
     { 
-        if (m_PUTTargets.find(target) != m_PUTTargets.end())
-            LOG_ERROR("[CORE] Cannot register PUT target '{0}' because it already exists", target);
-        else
-            m_PUTTargets.insert(std::make_pair(target, dataGatherFn));
+        RegisterPUTTarget(target, WithContext(std::move(dataGatherFn)), options);
     }
-    void Application::RegisterPOSTTarget(const std::string& target, DataGatherFn dataGatherFn) noexcept 
+    void Application::RegisterPOSTTarget(const std::string& target, DataGatherFn dataGatherFn, const TargetOptions& options) noexcept 
     { 
-        if (m_POSTTargets.find(target) != m_POSTTargets.end())
-            LOG_ERROR("[CORE] Cannot register POST target '{0}' because it already exists", target);
-        else
-            m_POSTTargets.insert(std::make_pair(target, dataGatherFn));
+        RegisterPOSTTarget(target, WithContext(std::move(dataGatherFn)), options);
+    }
+    void Application::RegisterGETTarget(const std::string& target, ContextDataGatherFn dataGatherFn, const TargetOptions& options) noexcept
+    {
+        RegisterTarget(http::verb::get, target, Target{ .dataGatherFn = std::move(dataGatherFn), .asyncDataGatherFn = {}, .bodyDataGatherFn = {}, .providers = {}, .options = options });
+    }
+    void Application::RegisterPUTTarget(const std::string& target, ContextDataGatherFn dataGatherFn, const TargetOptions& options) noexcept
+    {
+        RegisterPUTTarget(target, WithBody(std::move(dataGatherFn)), options);
+    }
+    void Application::RegisterPOSTTarget(const std::string& target, ContextDataGatherFn dataGatherFn, const TargetOptions& options) noexcept
+    {
+        RegisterPOSTTarget(target, WithBody(std::move(dataGatherFn)), options);
+    }
+    void Application::RegisterPUTTarget(const std::string& target, BodyDataGatherFn dataGatherFn, const TargetOptions& options) noexcept
+    {
+        RegisterTarget(http::verb::put, target, Target{ .dataGatherFn = {}, .asyncDataGatherFn = {}, .bodyDataGatherFn = std::move(dataGatherFn), .providers = {}, .options = options });
+    }
+    void Application::RegisterPOSTTarget(const std::string& target, BodyDataGatherFn dataGatherFn, const TargetOptions& options) noexcept
+    {
+        RegisterTarget(http::verb::post, target, Target{ .dataGatherFn = {}, .asyncDataGatherFn = {}, .bodyDataGatherFn = std::move(dataGatherFn), .providers = {}, .options = options });
+    }
+    void Application::RegisterAsyncGETTarget(const std::string& target, AsyncDataGatherFn dataGatherFn, const TargetOptions& options) noexcept
+    {
+        RegisterAsyncGETTarget(target, WithContext(std::move(dataGatherFn)), options);
+    }
+    void Application::RegisterAsyncGETTarget(const std::string& target, AsyncContextDataGatherFn dataGatherFn, const TargetOptions& options) noexcept
+    {
+        if (!dataGatherFn)
+        {
+            LOG_ERROR("[CORE] Cannot register asynchronous GET target '{0}': the data gathering function is empty", target);
+            return;
+        }
+
+        Target registeredTarget{ .dataGatherFn = {}, .asyncDataGatherFn = std::move(dataGatherFn), .bodyDataGatherFn = {}, .providers = {}, .options = options };
+
+        // A cached page can be rebuilt from a background refresh where there is no session to resume, so
+        // caching only works with synchronous data gathering functions
+        if (registeredTarget.options.cache.has_value())
+        {
+            LOG_WARN("[CORE] Page caching is not supported for asynchronous target '{0}'. Ignoring the cache options", target);
+            registeredTarget.options.cache.reset();
+        }
+
+        RegisterTarget(http::verb::get, target, std::move(registeredTarget));
+    }
+    void Application::RegisterGETTarget(const std::string& target, std::vector<DataProvider> providers, const TargetOptions& options) noexcept
+    {
+        try
+        {
+            std::unordered_set<std::string_view> names;
+            for (const DataProvider& provider : providers)
+            {
+                if (provider.name.empty() || !provider.dataGatherFn || !names.insert(provider.name).second)
+                {
+                    LOG_ERROR("[CORE] Cannot register GET target '{0}': every data provider needs a unique name and a data gathering function", target);
+                    return;
+                }
+            }
+            if (providers.empty())
+            {
+                LOG_ERROR("[CORE] Cannot register GET target '{0}': no data providers were given", target);
+                return;
+            }
+
+            Target registeredTarget{ .dataGatherFn = {}, .asyncDataGatherFn = {}, .bodyDataGatherFn = {}, .providers = std::move(providers), .options = options };
+
+            // Same as for asynchronous targets, there would be no session to resume for a background refresh
+            if (registeredTarget.options.cache.has_value())
+            {
+                LOG_WARN("[CORE] Page caching is not supported for target '{0}' because it uses data providers. Ignoring the cache options", target);
+                registeredTarget.options.cache.reset();
+            }
+
+            RegisterTarget(http::verb::get, target, std::move(registeredTarget));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::RegisterGETTarget failure. Caught std::exception: \n'{0}'", e.what());
+        }
+    }
+    void Application::RegisterTarget(http::verb method, const std::string& target, Target registeredTarget) noexcept
+    {
+        try
+        {
+            std::string error;
+            // Only GET targets are ever handed to the compute pool (see FindDeferredTarget)
+            if (registeredTarget.options.cpuBound && (method != http::verb::get || registeredTarget.IsAsync()))
+            {
+                LOG_WARN("[CORE] Ignoring 'cpuBound' for {0} target '{1}'. Only synchronous GET targets can run on the compute pool", std::string_view(http::to_string(method)), target);
+                registeredTarget.options.cpuBound = false;
+            }
+            const bool needsComputePool = registeredTarget.options.cpuBound || !registeredTarget.providers.empty() ||
+                (registeredTarget.options.cache.has_value() && registeredTarget.options.cache->staleWhileRevalidate.count() > 0);
+
+            if (!m_router.Insert(method, target, std::move(registeredTarget), error))
+                LOG_ERROR("[CORE] Cannot register {0} target '{1}': {2}", std::string_view(http::to_string(method)), target, error);
+            else if (needsComputePool)
+                m_needsComputePool = true;
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::RegisterTarget failure. Caught std::exception: \n'{0}'", e.what());
+        }
     }
 
-    http::message_generator Application::HandleHTTPRequest(HTTPRequestType req) noexcept
+    HTTPResponse Application::HandleHTTPRequest(HTTPRequestType req, RequestContext context) noexcept
     {
         PROFILE_SCOPE("Application::HandleHTTPRequest");
         
@@ -194,12 +496,20 @@ namespace Clover
             switch (req.method())
             {
             case http::verb::head:
-            case http::verb::get:  return HandleHTTPGETRequest(req);
-            case http::verb::put:  return HandleHTTPPUTRequest(req);
-            case http::verb::post: return HandleHTTPPOSTRequest(req);
+            case http::verb::get:  return HandleHTTPGETRequest(req, context);
+            case http::verb::put:
+            case http::verb::post: return HandleHTTPBodyRequest(req, context);
             default:
+            {
+                // A path that has targets for other methods gets a 405 that says which ones
+                ParametersMap parameters;
+                std::string_view target = ParseTarget(req.target(), parameters);
+                if (std::string allow = AllowedMethods(target); !allow.empty())
+                    return MethodNotAllowed(target, allow, req);
+
                 return BadRequest(std::format("Not currently handling request method: '{0}'", req.method()), req);
             }
+            }
         }
         catch (const boost::exception& e)
         {
@@ -217,14 +527,279 @@ namespace Clover
 
         return InternalServerError("Something went wrong", req);
     }
-    http::message_generator Application::HandleHTTPGETRequest(HTTPRequestType& req)
+    void Application::HandleHTTPRequest(HTTPRequestType req, RequestContext context, const net::any_io_executor& executor, ResponseHandler handler) noexcept
+    {
+        PROFILE_SCOPE("Application::HandleHTTPRequest (async)");
+
+        // The session does not read another request until the handler is called, so it must be called even
+        // if the request can't be dispatched. By then the request may have been moved from, so keep what
+        // is needed to build an error response.
+        const unsigned version = req.version();
+        const bool keepAlive = req.keep_alive();
+        bool dispatched = false;
+
+        if (t_currentShard != nullptr)
+            t_currentShard->requestsHandled.fetch_add(1, std::memory_order_relaxed);
+
+        try
+        {
+            // Middleware sees the request once, before it is dispatched anywhere, and may answer it itself
+            if (m_middleware != nullptr)
+            {
+                PROFILE_SCOPE("Middleware");
+
+                std::optional<HTTPResponse> response = m_middleware->Before(req, context);
+                if (response.has_value())
+                {
+                    dispatched = true;
+                    return handler(std::move(*response));
+                }
+            }
+
+            // Almost every request is handled synchronously, in which case the handler is called right away
+            const Target* deferred = FindDeferredTarget(req);
+            if (deferred != nullptr && deferred->options.cache.has_value())
+            {
+                dispatched = true;
+                return HandleCachedHTTPRequest(std::move(req), std::move(context), executor, std::move(handler));
+            }
+            if (deferred == nullptr || (!deferred->IsAsync() && !m_computePool.IsRunning()))
+            {
+                dispatched = true;
+                return handler(HandleHTTPRequest(std::move(req), std::move(context)));
+            }
+
+            if (!deferred->IsAsync())
+            {
+                dispatched = true;
+                return HandleCPUBoundHTTPRequest(std::move(req), std::move(context), deferred->options.priority, executor, std::move(handler));
+            }
+
+            // Cancelling the context (e.g. the client disconnected) also cancels whatever the coroutine is
+            // waiting on, such as a timer or a socket operation inside the data gathering function. A
+            // cancellation_signal is not thread safe, so it is only emitted from the session's executor, and
+            // the completion handler keeps it alive for as long as the coroutine's slot refers to it.
+            auto cancellation = std::make_shared<net::cancellation_signal>();
+            context.OnCancel(
+                [cancellation, executor]()
+                {
+                    net::post(executor, [cancellation]() { cancellation->emit(net::cancellation_type::terminal); });
+                });
+
+            // The coroutine owns the request (and therefore everything that refers into it, like the target
+            // and the parameters) until the response has been handed over
+            net::co_spawn(executor, HandleAsyncHTTPGETRequest(std::move(req), std::move(context), std::move(handler)),
+                net::bind_cancellation_slot(cancellation->slot(), [cancellation](std::exception_ptr e)
+                {
+                    if (e == nullptr)
+                        return;
+
+                    try
+                    {
+                        std::rethrow_exception(e);
+                    }
+                    catch (const std::exception& ex)
+                    {
+                        LOG_ERROR("[CORE] Application::HandleAsyncHTTPGETRequest failure. Caught std::exception: \n'{0}'", ex.what());
+                    }
+                    catch (...)
+                    {
+                        LOG_ERROR("[CORE] Application::HandleAsyncHTTPGETRequest failure. Caught unknown exception.");
+                    }
+                }));
+            dispatched = true;
+        }
+        catch (const boost::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleHTTPRequest failure. Caught boost::exception: \n'{0}'",
+                boost::diagnostic_information(e));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleHTTPRequest failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] Application::HandleHTTPRequest failure. Caught unknown exception.");
+        }
+
+        if (!dispatched)
+        {
+            try
+            {
+                HTTPRequestType fallback;
+                fallback.version(version);
+                fallback.keep_alive(keepAlive);
+                handler(InternalServerError("Something went wrong", fallback));
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] Application::HandleHTTPRequest failure. Caught std::exception: \n'{0}'", e.what());
+            }
+        }
+    }
+    const Application::Target* Application::FindDeferredTarget(const HTTPRequestType& req) const noexcept
+    {
+        // Only GET (and HEAD) targets can be asynchronous, CPU bound, or cached
+        if (req.method() != http::verb::get && req.method() != http::verb::head)
+            return nullptr;
+
+        // This mirrors the checks in HandleHTTPGETRequest: anything that would not end up in
+        // GenerateHTMLResponse (bad targets, redirects, files) is handled synchronously
+        std::string_view target = req.target();
+        target = target.substr(0, target.find('?'));
+
+        if (target.find("..") != std::string_view::npos)
+            return nullptr;
+        if (target.empty() || target == "/")
+            target = "index.html";
+        else if (target.ends_with('/'))
+            return nullptr;
+
+        if (target.ends_with(".html"))
+            target.remove_suffix(5);
+
+        // Files are never deferred, and anything a route matches is a page (see IsPageTarget)
+        Router<Target>::Match route = m_router.Find(http::verb::get, target);
+        if (route.value == nullptr || (!route.value->IsAsync() && !route.value->options.cpuBound && !route.value->options.cache.has_value()))
+            return nullptr;
+        return route.value;
+    }
+    void Application::HandleCPUBoundHTTPRequest(HTTPRequestType req, RequestContext context, ComputePriority priority, const net::any_io_executor& executor, ResponseHandler handler)
+    {
+        // The whole request (data gathering, rendering, compression) is handled on the compute pool, which
+        // is safe because the synchronous path is already run concurrently from every io thread. The
+        // response is then posted back to the session's strand. A request that was cancelled while it
+        // sat in the queue is abandoned before any real work is done (see GenerateHTMLResponse).
+        const unsigned version = req.version();
+        const bool keepAlive = req.keep_alive();
+        bool submitted = m_computePool.Submit(
+            [this, req = std::move(req), context = std::move(context), executor, handler]() mutable
+            {
+                HTTPResponse response = HandleHTTPRequest(std::move(req), std::move(context));
+                net::post(executor,
+                    [handler = std::move(handler), response = std::move(response)]() mutable
+                    {
+                        handler(std::move(response));
+                    });
+            },
+            priority);
+        if (submitted)
+            return;
+
+        // The pool has been stopped (the server is shutting down), and the session is still waiting on the handler
+        LOG_WARN("[CORE] Returning status 503 - Service Unavailable. The compute pool is not running");
+        HTTPRequestType fallback;
+        fallback.version(version);
+        fallback.keep_alive(keepAlive);
+        handler(ServiceUnavailable("The server is shutting down.", fallback));
+    }
+    net::awaitable<void> Application::HandleAsyncHTTPGETRequest(HTTPRequestType req, RequestContext context, ResponseHandler handler)
+    {
+        // Exceptions can't escape from here: the session is waiting on the handler to be called before it
+        // reads the next request, so it must always be called with some response
+        std::optional<HTTPResponse> response;
+        try
+        {
+            ParametersMap parameters;
+            std::string_view target = ParseTarget(req.target(), parameters);
+            if (target.empty() || target == "/")
+                target = "index.html";
+
+            ResolvedPage resolved = ResolveHTMLTarget(target, parameters);
+            if (resolved.fileInfo == nullptr && !resolved.registeredTarget->IsJSON())
+            {
+                LOG_TRACE("[CORE] HandleAsyncHTTPGETRequest: File not found for target: '{0}'", target);
+                response.emplace(FileNotFound(target, req));
+            }
+            else
+            {
+                const Target& registeredTarget = *resolved.registeredTarget;
+                if (registeredTarget.options.deadline.count() > 0)
+                    context.SetTimeout(registeredTarget.options.deadline);
+
+                // The strand is free to run other sessions while the data is being gathered. When that
+                // completes, we are back on the strand, so rendering and writing proceed as usual.
+                json data;
+                try
+                {
+                    if (!context.IsCancelled())
+                    {
+                        if (registeredTarget.asyncDataGatherFn)
+                        {
+                            LOG_TRACE("[CORE] HandleAsyncHTTPGETRequest: Calling user defined asynchronous data gathering function for target: '{0}'", target);
+                            std::optional<RequestContext::Clock::time_point> deadline = context.Deadline();
+                            if (!deadline.has_value())
+                            {
+                                data = co_await registeredTarget.asyncDataGatherFn(parameters, context);
+                            }
+                            else
+                            {
+                                // Race the function against the deadline. Whichever loses is cancelled through its
+                                // cancellation slot, so a function stuck waiting on something is woken up.
+                                using namespace net::experimental::awaitable_operators;
+                                net::steady_timer timer(co_await net::this_coro::executor, *deadline);
+                                std::variant<json, std::monostate> result =
+                                    co_await (registeredTarget.asyncDataGatherFn(parameters, context) || timer.async_wait(net::use_awaitable));
+                                if (result.index() == 0)
+                                    data = std::move(std::get<0>(result));
+                            }
+                        }
+                        else
+                        {
+                            data = co_await GatherProviderData(target, registeredTarget, parameters, context);
+                        }
+                    }
+                }
+                catch (const boost::system::system_error& e)
+                {
+                    // A wait inside the data gathering function was cancelled because the request was (see
+                    // HandleHTTPRequest). Anything else is a genuine failure.
+                    if (e.code() != net::error::operation_aborted || !context.IsCancelled())
+                        throw;
+                }
+
+                if (context.IsCancelled())
+                    response.emplace(GenerateDeadlineResponse(target, registeredTarget, parameters, req, context));
+                else if (registeredTarget.IsJSON())
+                    response.emplace(RenderJSONResponse(target, data, req, registeredTarget, parameters));
+                else
+                    response.emplace(RenderHTMLResponse(target, *resolved.fileInfo, data, req, &registeredTarget, parameters));
+            }
+        }
+        catch (const inja::RenderError& err)
+        {
+            LOG_ERROR("[CORE] HandleAsyncHTTPGETRequest: Caught inja::RenderError: Type = '{0}' | Message = '{1}'", err.type, err.message);
+            response.emplace(InternalServerError(err.message, req));
+        }
+        catch (const boost::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleAsyncHTTPGETRequest failure. Caught boost::exception: \n'{0}'",
+                boost::diagnostic_information(e));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleAsyncHTTPGETRequest failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] Application::HandleAsyncHTTPGETRequest failure. Caught unknown exception.");
+        }
+
+        if (!response.has_value())
+            response.emplace(InternalServerError("Something went wrong", req));
+
+        handler(std::move(*response));
+    }
+    HTTPResponse Application::HandleHTTPGETRequest(HTTPRequestType& req, RequestContext& context)
     {
         PROFILE_SCOPE("Application::HandleHTTPGETRequest");
 
         // Example: ...com/user/home?id=1234&query=some-string
         //      target = "/user/home"
         //      parameters = { "id" = "1234", "query" = "some-string" }
-        auto [target, parameters] = ParseTarget(req.target());
+        ParametersMap parameters;
+        std::string_view target = ParseTarget(req.target(), parameters);
 
         {
             PROFILE_SCOPE("Some logging 1");
@@ -265,10 +840,10 @@ namespace Clover
             return GenerateRedirectResponse(target.substr(0, target.size() - 1), req);
         }
 
-        // if the target has either no file extension or the extension is .html, then
-        // it will be treated an html request. Otherwise, we will assume the request is
-        // for another type of file (.css, .js, .png, etc)
-        if (IsTargetHTML(target))
+        // If a GET target is registered for the path, or the path has either no file extension or the
+        // extension is .html, then it will be treated an html request. Otherwise, we will assume the
+        // request is for another type of file (.css, .js, .png, etc)
+        if (IsPageTarget(target))
         {
             LOG_TRACE("[CORE] Determined target '{0}' IS an HTML request", target);
 
@@ -278,7 +853,7 @@ namespace Clover
             //     RegisterTarget will be called.
             //  2. It will call GenerateHTML to stamp out the html template into a string 
             //     that will then make up the response body
-            return GenerateHTMLResponse(target, parameters, req);
+            return GenerateHTMLResponse(target, parameters, req, context);
         }
 
         LOG_TRACE("[CORE] Determined target '{0}' IS NOT an HTML request", target);
@@ -295,227 +870,940 @@ namespace Clover
         // The target will be treated as a file. If it doesn't exist, a 404 response will be returned
         return ServeFile(target, req);
     }
-    http::message_generator Application::HandleHTTPPUTRequest(HTTPRequestType& req)
+    HTTPResponse Application::HandleHTTPBodyRequest(HTTPRequestType& req, RequestContext& context)
     {
-        PROFILE_SCOPE("Application::HandleHTTPPUTRequest");
+        PROFILE_SCOPE("Application::HandleHTTPBodyRequest");
 
-        http::response<http::string_body> res{ http::status::ok, req.version() };
-        res.set(http::field::server, m_serverVersion);
-        res.set(http::field::content_type, "text/html"); 
-        res.keep_alive(req.keep_alive()); 
-        res.body() = "Not currently handling PUT requests";
-        res.prepare_payload();
-        return res;
-    }
-    http::message_generator Application::HandleHTTPPOSTRequest(HTTPRequestType& req)
-    {
-        PROFILE_SCOPE("Application::HandleHTTPPOSTRequest");
+        ParametersMap parameters;
+        std::string_view target = ParseTarget(req.target(), parameters);
 
-        http::response<http::string_body> res{ http::status::ok, req.version() };
-        res.set(http::field::server, m_serverVersion);
-        res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = "Not currently handling POST requests";
-        res.prepare_payload();
-        return res;
-    }
+        if (target.find("..") != std::string_view::npos)
+        {
+            std::string_view reason = "Invalid request because target contains '..'";
+            LOG_WARN("[CORE] {0} : '{1}'", reason, target);
+            return BadRequest(reason, req);
+        }
+
+        // Unlike GET, there is nothing to serve for a PUT or POST unless a target was registered for it
+        ResolvedPage resolved = ResolveHTMLTarget(target, parameters, req.method());
+        if (resolved.registeredTarget == nullptr)
+        {
+            LOG_WARN("[CORE] No {0} target is registered for '{1}'", std::string_view(req.method_string()), target);
+            if (resolved.pathMatched)
+                return MethodNotAllowed(target, AllowedMethods(target), req);
+            return FileNotFound(target, req);
+        }
+
+        const Target& registeredTarget = *resolved.registeredTarget;
+        if (registeredTarget.options.deadline.count() > 0)
+            context.SetTimeout(registeredTarget.options.deadline);
+        if (context.IsCancelled())
+            return GenerateDeadlineResponse(target, registeredTarget, parameters, req, context);
+
+        LOG_TRACE("[CORE] HandleHTTPBodyRequest: Received a {0} byte body for target '{1}' ({2})", req.body().Size(), target,
+            req.body().IsSpooled() ? req.body().Path().string() : std::string("in memory"));
+
+        json data;
+        if (registeredTarget.bodyDataGatherFn)
+        {
+            PROFILE_SCOPE("BodyDataGatherFn");
+            try
+            {
+                data = registeredTarget.bodyDataGatherFn(parameters, req.body(), context);
+            }
+            catch (const BadRequestBody& e)
+            {
+                LOG_WARN("[CORE] Could not decode the request body for target '{0}': {1}", target, e.what());
+                return BadRequest(e.what(), req);
+            }
+        }
+
+        // Render the result with the target's page if it has one, otherwise hand it back as is
+        if (resolved.fileInfo != nullptr)
+            return RenderHTMLResponse(target, *resolved.fileInfo, data, req, &registeredTarget, parameters);
+
+        return RenderJSONResponse(target, data, req, registeredTarget, parameters);
+    }
+    Application::RequestBodyLimits Application::GetRequestBodyLimits(const HTTPRequestType& req) const noexcept
+    {
+        // This mirrors the lookup in ResolveHTMLTarget, but only the route is needed here
+        std::string_view target = req.target();
+        target = target.substr(0, target.find('?'));
+        if (target.ends_with(".html"))
+            target.remove_suffix(5);
+
+        Router<Target>::Match route = m_router.Find(req.method(), target);
+        std::uint64_t maxSize = route.value != nullptr && route.value->options.maxBodySize > 0 ?
+            route.value->options.maxBodySize : m_maxRequestBodySize;
 
-    std::pair<std::string_view, Application::ParametersMap> Application::ParseTarget(std::string_view target) const noexcept
+        return { .maxSize = maxSize, .maxInMemory = m_requestBodyMemoryLimit, .spoolDirectory = m_requestBodySpoolDirectory };
+    }
+    std::optional<HTTPResponse> Application::CheckRequestHeader(HTTPRequestType& req, RequestContext& context) noexcept
+    {
+        if (m_middleware == nullptr || !m_middleware->HasHeaderStages())
+            return std::nullopt;
+
+        PROFILE_SCOPE("Application::CheckRequestHeader");
+
+        try
+        {
+            return m_middleware->OnHeader(req, context);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::CheckRequestHeader failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] Application::CheckRequestHeader failure. Caught unknown exception.");
+        }
+
+        // A stage that failed can't have let the request through (it may be the one checking for auth)
+        req.keep_alive(false);
+        try
+        {
+            return InternalServerError("Something went wrong", req);
+        }
+        catch (...)
+        {
+            EmptyResponse res{ http::status::internal_server_error, req.version() };
+            res.keep_alive(false);
+            res.prepare_payload();
+            return res;
+        }
+    }
+    void Application::FlushRequestBody(RequestBody& body, bool close, const net::any_io_executor& executor, SpoolHandler handler)
+    {
+        auto flush = [&body, close, executor, handler = std::move(handler)]() mutable
+        {
+            beast::error_code ec;
+            body.FlushSpool(close, ec);
+            net::post(executor, [ec, handler = std::move(handler)]() { handler(ec); });
+        };
+
+        // The spool thread is started by Run()
+        if (!m_spoolPool.has_value())
+            return flush();
+
+        net::post(*m_spoolPool, std::move(flush));
+    }
+    HTTPResponse Application::HandleOverload(const HTTPRequestType& req) noexcept
+    {
+        PROFILE_SCOPE("Application::HandleOverload");
+
+        // Shedding has to stay cheap while the server is overloaded, so this only traces (see GetAdmissionStats
+        // for the totals) and sends the prepared page as is, without compressing it. The connection is closed
+        // as well: the body (if any) is never read, and a client that comes back after Retry-After has to be
+        // admitted again
+        LOG_TRACE("[CORE] Returning status 503 - Service Unavailable for target '{0}' (overloaded)", std::string_view(req.target()));
+
+        try
+        {
+            http::response<http::string_body> res = m_serviceUnavailablePage.Response("The server is too busy to handle the request. Please try again shortly.",
+                req.version(), false, m_documentIndex, m_templateCache, m_serverVersion);
+            res.set(http::field::retry_after, std::to_string(m_admission.Limits().retryAfter.count()));
+            res.prepare_payload();
+            return res;
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleOverload failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] Application::HandleOverload failure. Caught unknown exception.");
+        }
+
+        http::response<http::empty_body> res{ http::status::service_unavailable, req.version() };
+        res.keep_alive(false);
+        res.prepare_payload();
+        return res;
+    }
+    HTTPResponse Application::HandleRequestBodyTooLarge(HTTPRequestType req) noexcept
+    {
+        PROFILE_SCOPE("Application::HandleRequestBodyTooLarge");
+
+        // The rest of the body is still on its way, so the connection can't be used for another request
+        req.keep_alive(false);
+
+        try
+        {
+            return PayloadTooLarge(req);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleRequestBodyTooLarge failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] Application::HandleRequestBodyTooLarge failure. Caught unknown exception.");
+        }
+
+        return InternalServerError("Something went wrong", req);
+    }
+    HTTPResponse Application::HandleMalformedRequest(HTTPRequestType req, std::string_view reason) noexcept
+    {
+        PROFILE_SCOPE("Application::HandleMalformedRequest");
+
+        // There is no telling where the next request would start
+        req.keep_alive(false);
+
+        try
+        {
+            return BadRequest(std::format("The request could not be parsed: {0}", reason), req);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleMalformedRequest failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] Application::HandleMalformedRequest failure. Caught unknown exception.");
+        }
+
+        http::response<http::empty_body> res{ http::status::bad_request, req.version() };
+        res.keep_alive(false);
+        res.prepare_payload();
+        return res;
+    }
+    HTTPResponse Application::HandleRequestBodyFailure(HTTPRequestType req) noexcept
+    {
+        PROFILE_SCOPE("Application::HandleRequestBodyFailure");
+
+        // The rest of the body is still on its way, so the connection can't be used for another request
+        req.keep_alive(false);
+
+        try
+        {
+            return InternalServerError("The request body could not be stored", req);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleRequestBodyFailure failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] Application::HandleRequestBodyFailure failure. Caught unknown exception.");
+        }
+
+        http::response<http::empty_body> res{ http::status::internal_server_error, req.version() };
+        res.keep_alive(false);
+        res.prepare_payload();
+        return res;
+    }
+
+    std::string_view Application::ParseTarget(std::string_view target, Application::ParametersMap& parameters) const noexcept
     {
         PROFILE_SCOPE("Application::ParseTarget");
 
-        std::pair<std::string_view, Application::ParametersMap> result;
-        
         size_t pos = target.find('?');
-        if (pos == std::string::npos) 
+        if (pos == std::string::npos)
+            return target;
+
+        // The parameters are views into the target (or, if percent-encoded, into decoded storage owned
+        // by 'parameters'), so parsing them does not allocate for a typical request
+        try
+        {
+            parameters.Parse(target.substr(pos + 1));
+        }
+        catch (const std::exception& e)
         {
-            result.first = target;
+            LOG_ERROR("[CORE] Application::ParseTarget failure. Caught std::exception: \n'{0}'", e.what());
         }
-        else 
+
+        return target.substr(0, pos);
+    }
+    net::awaitable<json> Application::GatherProviderData(std::string_view target, const Target& registeredTarget, const ParametersMap& urlParams, const RequestContext& context)
+    {
+        // Everything the providers touch is owned by this state and not by the coroutine, because a
+        // provider that times out keeps running (and eventually reports back) after the page has been
+        // rendered without it. The results are only ever touched on the session's strand.
+        struct FanOut
         {
-            result.first = std::string_view(target.data(), pos); // Return substring up to the delimiter
+            explicit FanOut(const net::any_io_executor& executor) : timer(executor) {}
 
-            // parse the parameters into json
-            size_t keyPos = pos + 1;
-            size_t equalsPos, ampPos;
+            std::vector<std::pair<std::string, std::string>> ownedParams;
+            ParametersMap params;
+            std::vector<std::optional<json>> results;
+            std::vector<bool> finished;
+            std::size_t remaining = 0;
 
-            // We are going to progress the key position until we go beyond the string_view
-            while (keyPos < target.size())
-            {
-                equalsPos = target.find('=', keyPos);
-                ampPos = target.find('&', keyPos);
+            // Woken (cancelled) when the last provider finishes, otherwise expires at the next deadline. If the
+            // client goes away, the wait is cancelled through the coroutine's cancellation slot (see HandleHTTPRequest).
+            net::steady_timer timer;
+        };
+
+        const std::vector<DataProvider>& providers = registeredTarget.providers;
+        const net::any_io_executor executor = co_await net::this_coro::executor;
 
-                std::string_view key, value;
+        auto fanOut = std::make_shared<FanOut>(executor);
+        fanOut->ownedParams.assign(urlParams.begin(), urlParams.end());
+        for (const auto& [key, value] : fanOut->ownedParams)
+            fanOut->params.emplace(key, value);
+        fanOut->results.resize(providers.size());
+        fanOut->finished.resize(providers.size(), false);
+        fanOut->remaining = providers.size();
 
-                // If no '=' was found or it was found after the '&' then this is an error. However, we want to 
-                // try to recover as much as possible, so if there is still a '&', we will just continue like normal
-                if (equalsPos > ampPos || equalsPos == std::string::npos)
+        const auto start = std::chrono::steady_clock::now();
+
+        for (std::size_t iii = 0; iii < providers.size(); ++iii)
+        {
+            // Providers live in the router, which is not modified after setup, so a pointer is fine
+            auto run = [fanOut, iii, provider = &providers[iii], executor, context]()
                 {
-                    // If there are no more '&', then just log an error message and break
-                    if (ampPos == std::string::npos)
+                    std::optional<json> result;
+                    try
                     {
-                        LOG_WARN("[CORE] Parsing parameters failed because there is no '=' for key '{0}': '{1}", target.substr(keyPos), target);
-                        break;
+                        // Don't start on a provider for a request that has already been given up on
+                        PROFILE_SCOPE("DataProvider");
+                        if (!context.IsCancelled())
+                            result = provider->dataGatherFn(fanOut->params);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LOG_ERROR("[CORE] Data provider '{0}' failed. Caught std::exception: \n'{1}'", provider->name, e.what());
+                    }
+                    catch (...)
+                    {
+                        LOG_ERROR("[CORE] Data provider '{0}' failed. Caught unknown exception.", provider->name);
                     }
 
-                    // If there are remaining '&', then log an error, but continue like normal
-                    key = target.substr(keyPos, ampPos - keyPos);
-                    LOG_WARN("[CORE] Parsing parameters failed because there is no '=' for key '{0}': '{1}", key, target);
+                    net::post(executor,
+                        [fanOut, iii, result = std::move(result)]() mutable
+                        {
+                            // Too late, the page was already rendered without it
+                            if (fanOut->finished[iii])
+                                return;
+
+                            fanOut->results[iii] = std::move(result);
+                            fanOut->finished[iii] = true;
+                            if (--fanOut->remaining == 0)
+                                fanOut->timer.cancel();
+                        });
+                };
+
+            // If the pool is not running (e.g. it is being shut down), just run the provider here
+            if (!m_computePool.Submit(run, registeredTarget.options.priority))
+                run();
+        }
 
-                    keyPos = ampPos + 1;
+        // Wait for all of the providers, giving up on each one at its own deadline, and on all of them at
+        // the request's deadline
+        while (fanOut->remaining > 0 && !context.IsCancelled())
+        {
+            const auto now = std::chrono::steady_clock::now();
+            std::optional<std::chrono::steady_clock::time_point> nextDeadline = context.Deadline();
+            for (std::size_t iii = 0; iii < providers.size(); ++iii)
+            {
+                if (fanOut->finished[iii] || providers[iii].timeout.count() <= 0)
                     continue;
+
+                const auto deadline = start + providers[iii].timeout;
+                if (deadline <= now)
+                {
+                    LOG_WARN("[CORE] Data provider '{0}' for target '{1}' timed out after {2}ms. Rendering without it", providers[iii].name, target, providers[iii].timeout.count());
+                    fanOut->finished[iii] = true;
+                    --fanOut->remaining;
                 }
+                else if (!nextDeadline.has_value() || deadline < *nextDeadline)
+                {
+                    nextDeadline = deadline;
+                }
+            }
 
-                key = target.substr(keyPos, equalsPos - keyPos);
+            if (fanOut->remaining == 0)
+                break;
 
-                // If there are no more '&', then just go to the end of the string_view
-                if (ampPos == std::string::npos)
-                    value = target.substr(equalsPos + 1);
-                else
-                    value = target.substr(equalsPos + 1, ampPos - equalsPos - 1);
+            fanOut->timer.expires_at(nextDeadline.value_or(std::chrono::steady_clock::time_point::max()));
+            beast::error_code ec;
+            co_await fanOut->timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+        }
+
+        // If we gave up on the request, anything that finishes from here on is ignored
+        std::fill(fanOut->finished.begin(), fanOut->finished.end(), true);
 
-                // Check if this key was already added
-                if (result.second.contains(key))
-                    LOG_WARN("[CORE] Parsing parameters failed because this is the second time the key '{0}' was found. Skipping second occurrence. Parameters: {1}", key, target);
+        json data = json::object();
+        for (std::size_t iii = 0; iii < providers.size(); ++iii)
+        {
+            if (fanOut->results[iii].has_value())
+                data[providers[iii].name] = std::move(*fanOut->results[iii]);
+            else
+                data[providers[iii].name] = nullptr;
+        }
+
+        LOG_TRACE("[CORE] GatherProviderData: Gathered data from {0} providers for target '{1}' in {2}ms", providers.size(), target,
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+        co_return data;
+    }
+    json Application::GatherRequestData(std::string_view target, const Target* registeredTarget, const Application::ParametersMap& urlParams, const RequestContext& context) const
+    {
+        PROFILE_SCOPE("Application::GatherRequestData");
+
+        // Asynchronous targets are normally routed to HandleAsyncHTTPGETRequest before getting here. The only
+        // way to end up here with one is through the synchronous HandleHTTPRequest overload
+        if (registeredTarget != nullptr && registeredTarget->IsAsync())
+        {
+            LOG_ERROR("[CORE] GatherRequestData: Target '{0}' gathers its data asynchronously, which cannot be done here", target);
+            return {};
+        }
+
+        // Call user-supplied callbacks
+        if (registeredTarget == nullptr || !registeredTarget->dataGatherFn)
+        {
+            LOG_TRACE("[CORE] GatherRequestData: No user defined data gathering function for target: '{0}'", target);
+            return {};
+        }
+
+        LOG_TRACE("[CORE] GatherRequestData: Calling user defined data gathering function for target: '{0}'", target);
+        return registeredTarget->dataGatherFn(urlParams, context);
+    }
+    HTTPResponse Application::GenerateRedirectResponse(std::string_view target, HTTPRequestType& req)
+    {
+        http::response<http::string_body> res{ http::status::permanent_redirect, req.version() };
+        res.set(http::field::server, m_serverVersion);
+        res.set(http::field::content_type, "text/html");
+        res.set(http::field::location, target);
+        res.keep_alive(req.keep_alive());
+        res.prepare_payload();
+        return res;
+    }
+    HTTPResponse Application::GenerateNotModifiedResponse(std::string_view etag, std::string_view lastModifiedDate, HTTPRequestType& req, std::string_view vary)
+    {
+        LOG_INFO("[CORE] Returning status 304 - Not Modified for target '{0}'", std::string_view(req.target()));
+
+        // A 304 never has a body, but it must carry the same validators the 200 response would have
+        http::response<http::empty_body> res{ http::status::not_modified, req.version() };
+        res.set(http::field::server, m_serverVersion);
+        res.set(http::field::etag, etag);
+        if (!lastModifiedDate.empty())
+            res.set(http::field::last_modified, lastModifiedDate);
+        if (!vary.empty())
+            res.set(http::field::vary, vary);
+        res.keep_alive(req.keep_alive());
+        return res;
+    }
+    Application::ResolvedPage Application::ResolveHTMLTarget(std::string_view target, Application::ParametersMap& urlParams, http::verb method) const
+    {
+        PROFILE_SCOPE("Application::ResolveHTMLTarget");
+
+        // The normal use case is for the user application to register a target like '/home' and
+        // this will ultimately map to a file called 'home.html'. When a GET request comes through
+        // for '/home', this works just fine. However, if the GET request was for '/home.html', then
+        // we will fail to find the user supplied callback. Therefore, if the target ends in '.html',
+        // we will remove those characters when we go to lookup the user supplied callback
+        std::string_view routePath = target;
+        if (routePath.ends_with(".html"))
+            routePath.remove_suffix(5);
+
+        ResolvedPage resolved;
+
+        Router<Target>::Match route = m_router.Find(method, routePath);
+        resolved.registeredTarget = route.value;
+        resolved.pathMatched = route.pathMatched;
+
+        // Values captured by the route ('/user/{id}') are passed along with the query parameters. If both
+        // have the same name, the one from the path wins
+        for (const auto& [name, value] : route.parameters)
+            urlParams.insert_or_assign(name, value);
+
+        // A JSON target has no page, so there is nothing to look up
+        if (resolved.registeredTarget != nullptr && resolved.registeredTarget->IsJSON())
+            return resolved;
+
+        // Strip any leading '/' because the document index is keyed by paths relative to the document root
+        resolved.page = resolved.registeredTarget != nullptr && !resolved.registeredTarget->options.page.empty() ?
+            std::string_view(resolved.registeredTarget->options.page) : target;
+        if (resolved.page.starts_with('/'))
+            resolved.page.remove_prefix(1);
+
+        // The page index maps both "page" and "page.html" to the file "page.html"
+        resolved.fileInfo = m_documentIndex.FindPage(resolved.page);
+        return resolved;
+    }
+    HTTPResponse Application::GenerateHTMLResponse(std::string_view target, Application::ParametersMap& urlParams, HTTPRequestType& req, RequestContext& context)
+    {
+        PROFILE_SCOPE("Application::GenerateHTMLResponse");
+
+        // If the file does not exist, then return 404 (unless the target is sent as JSON, which needs no file)
+        ResolvedPage resolved = ResolveHTMLTarget(target, urlParams);
+        const Target* registeredTarget = resolved.registeredTarget;
+        const bool isJSON = registeredTarget != nullptr && registeredTarget->IsJSON();
+        if (resolved.fileInfo == nullptr && !isJSON)
+        {
+            // Nothing to GET, but the path is registered for PUT or POST
+            if (registeredTarget == nullptr && resolved.pathMatched)
+                return MethodNotAllowed(target, AllowedMethods(target), req);
+
+            LOG_TRACE("[CORE] GenerateHTMLResponse: File not found for target: '{0}'", target);
+            return FileNotFound(target, req);
+        }
+
+        LOG_TRACE("[CORE] GenerateHTMLResponse: Converted target to file: '{0}' -> '{1}'", target, isJSON ? std::string("(JSON)") : resolved.fileInfo->path);
+
+        // The deadline is measured from when the request was received, so if this request spent its
+        // time waiting in the compute pool's queue, it may already be too late to bother
+        if (registeredTarget != nullptr && registeredTarget->options.deadline.count() > 0)
+            context.SetTimeout(registeredTarget->options.deadline);
+        if (registeredTarget != nullptr && context.IsCancelled())
+            return GenerateDeadlineResponse(target, *registeredTarget, urlParams, req, context);
+
+        // Targets that opted in to page caching can skip both data gathering and rendering
+        if (registeredTarget != nullptr && registeredTarget->options.cache.has_value())
+            return GenerateCachedHTMLResponse(target, *registeredTarget, resolved.page, urlParams, req);
+
+        // Gather all data that will be used to fulfill the request to generate the necessary html
+        json data;
+        {
+            PROFILE_SCOPE("GatherRequestData - outer");
+            data = GatherRequestData(target, registeredTarget, urlParams, context);
+        }
+
+        // Don't spend time rendering a page nobody is going to see
+        if (registeredTarget != nullptr && context.IsCancelled())
+            return GenerateDeadlineResponse(target, *registeredTarget, urlParams, req, context);
+
+        if (isJSON)
+            return RenderJSONResponse(target, data, req, *registeredTarget, urlParams);
+
+        return RenderHTMLResponse(target, *resolved.fileInfo, data, req, registeredTarget, urlParams);
+    }
+    HTTPResponse Application::RenderHTMLResponse(std::string_view target, const FileInfo& fileInfo, const json& data, HTTPRequestType& req,
+                                                            const Target* registeredTarget, const ParametersMap& urlParams)
+    {
+        PROFILE_SCOPE("Application::RenderHTMLResponse");
+
+        {
+            PROFILE_SCOPE("Some logging 2");
+
+            LOG_TRACE("[CORE] GenerateHTMLResponse: Received data for target '{0}': \n{1}", target, data.dump(4));
+        }
+
+        const std::string& file = fileInfo.path;
+
+        // The page is a function of the template and the gathered data, so a hash of the two makes a
+        // good weak validator. If the client already has this version, we can skip rendering altogether.
+        std::string etag = std::format("W/\"{0:x}-{1:x}\"", std::hash<json>{}(data), static_cast<std::uint64_t>(fileInfo.lastWriteTime.time_since_epoch().count()));
+        if (IsNotModified(req, etag))
+            return GenerateNotModifiedResponse(etag, {}, req);
+
+        // Generate the html to be rendered
+        std::string html;
+        try
+        {
+            PROFILE_SCOPE("Inja render");
+
+            html = m_templateCache.Render(file, fileInfo.lastWriteTime, data);
+        }
+        catch (const inja::RenderError& err)
+        {
+            LOG_ERROR("[CORE] Caught inja::RenderError: Type = '{0}' | Message = '{1}'", err.type, err.message);
+            LOG_ERROR("[CORE]     The failure came from this call: 'm_templateCache.Render(file, fileInfo.lastWriteTime, data)', where file = '{0}' and data = \n{1}", file, data.dump(4));
+            return InternalServerError(err.message, req);
+        }
+
+        LOG_INFO("[CORE] Returning status 200 - OK for target '{0}'", target);
+
+        // Keep a copy of the page around in case a later request for it misses its deadline
+        if (registeredTarget != nullptr && registeredTarget->options.onDeadline == DeadlineFallback::StalePage)
+        {
+            m_pageCache.Remember(PageCache::MakeKey(target, urlParams), registeredTarget->options.stalePageInterval,
+                [&html, &etag]()
+                {
+                    auto page = std::make_shared<CachedPage>();
+                    page->body = std::make_shared<const std::string>(html);
+                    page->etag = etag;
+                    return std::shared_ptr<const CachedPage>(std::move(page));
+                });
+        }
+
+        http::response<http::string_body> res{ http::status::ok, req.version() };
+
+        {
+            PROFILE_SCOPE("Prepare response");
+
+            res.set(http::field::server, m_serverVersion);
+            res.set(http::field::content_type, "text/html");
+            res.set(http::field::etag, etag);
+            res.keep_alive(req.keep_alive());
+            res.body() = std::move(html);
+            CompressResponse(res, req);
+            res.prepare_payload();
+        }
+        return res;
+    }
+    HTTPResponse Application::RenderJSONResponse(std::string_view target, const json& data, HTTPRequestType& req,
+                                                            const Target& registeredTarget, const ParametersMap& urlParams)
+    {
+        PROFILE_SCOPE("Application::RenderJSONResponse");
+
+        // Same validator as for a rendered page, minus the template
+        std::string etag = std::format("W/\"{0:x}\"", std::hash<json>{}(data));
+        if (IsNotModified(req, etag))
+            return GenerateNotModifiedResponse(etag, {}, req);
+
+        http::response<http::string_body> res{ http::status::ok, req.version() };
+        res.set(http::field::server, m_serverVersion);
+        res.set(http::field::content_type, "application/json");
+        res.set(http::field::etag, etag);
+        res.keep_alive(req.keep_alive());
+
+        // Serialized straight into the response body. There is no template to go through and nothing to copy.
+        {
+            PROFILE_SCOPE("Serialize JSON");
+            res.body() = data.dump();
+        }
+
+        LOG_INFO("[CORE] Returning status 200 - OK for target '{0}' (JSON)", target);
+
+        // Keep a copy around in case a later request misses its deadline (see RenderHTMLResponse)
+        if (registeredTarget.options.onDeadline == DeadlineFallback::StalePage)
+        {
+            m_pageCache.Remember(PageCache::MakeKey(target, urlParams), registeredTarget.options.stalePageInterval,
+                [&res, &etag]()
+                {
+                    auto page = std::make_shared<CachedPage>();
+                    page->body = std::make_shared<const std::string>(res.body());
+                    page->contentType = "application/json";
+                    page->etag = etag;
+                    return std::shared_ptr<const CachedPage>(std::move(page));
+                });
+        }
+
+        CompressResponse(res, req);
+        res.prepare_payload();
+        return res;
+    }
+    HTTPResponse Application::GenerateCachedHTMLResponse(std::string_view target, const Target& registeredTarget, std::string_view page, 
+                                                                    const ParametersMap& urlParams, HTTPRequestType& req)
+    {
+        PROFILE_SCOPE("Application::GenerateCachedHTMLResponse");
+
+        std::shared_ptr<const CachedPage> cachedPage;
+        std::exception_ptr error;
+        try
+        {
+            cachedPage = m_pageCache.Get(PageCache::MakeKey(target, urlParams), *registeredTarget.options.cache,
+                MakePageBuildFn(target, registeredTarget, page, urlParams));
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        return GenerateBuiltPageResponse(target, cachedPage, error, req);
+    }
+    void Application::HandleCachedHTTPRequest(HTTPRequestType req, RequestContext context, const net::any_io_executor& executor, ResponseHandler handler)
+    {
+        PROFILE_SCOPE("Application::HandleCachedHTTPRequest");
+
+        // The request is shared by whoever ends up answering it: this call on a hit, or the thread that
+        // builds the page on a miss. The target and the parameters refer into it.
+        auto request = std::make_shared<HTTPRequestType>(std::move(req));
+
+        // FindDeferredTarget has already turned away anything HandleHTTPGETRequest would not render. Anything
+        // that goes wrong before the page is looked up is answered here, since the session is waiting on the handler.
+        std::optional<HTTPResponse> response;
+        std::string key;
+        PageCache::BuildFn build;
+        const Target* registeredTarget = nullptr;
+        std::string_view target;
+        try
+        {
+            ParametersMap urlParams;
+            target = ParseTarget(request->target(), urlParams);
+            if (target.empty() || target == "/")
+                target = "index.html";
+
+            ResolvedPage resolved = ResolveHTMLTarget(target, urlParams);
+            registeredTarget = resolved.registeredTarget;
+            if (resolved.fileInfo == nullptr && !registeredTarget->IsJSON())
+            {
+                LOG_TRACE("[CORE] HandleCachedHTTPRequest: File not found for target: '{0}'", target);
+                response.emplace(FileNotFound(target, *request));
+            }
+            else
+            {
+                if (registeredTarget->options.deadline.count() > 0)
+                    context.SetTimeout(registeredTarget->options.deadline);
+                if (context.IsCancelled())
+                    response.emplace(GenerateDeadlineResponse(target, *registeredTarget, urlParams, *request, context));
                 else
-                    result.second[key] = value;                
+                {
+                    key = PageCache::MakeKey(target, urlParams);
+                    build = MakePageBuildFn(target, *registeredTarget, resolved.page, urlParams);
+                }
+            }
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] Application::HandleCachedHTTPRequest failure. Caught std::exception: \n'{0}'", e.what());
+            response.emplace(InternalServerError("Something went wrong", *request));
+        }
 
-                // If there are no more '&', then we are done
-                if (ampPos == std::string::npos)
-                    break;
+        if (response.has_value())
+            return handler(std::move(*response));
 
-                // Increment the key position to what it would be if it exists
-                keyPos = ampPos + 1;
+        // A hit answers right away on this thread, even for a CPU bound target. A miss is answered by whichever
+        // thread builds the page (the compute pool, for a CPU bound target), so the response is sent back to
+        // the session's executor, where it is a no-op hop on a hit.
+        PageCache::PageHandler respond =
+            [this, request, executor, handler = std::move(handler), target = std::string(target)](std::shared_ptr<const CachedPage> cachedPage, std::exception_ptr error)
+            {
+                net::dispatch(executor,
+                    [this, request, handler, target, cachedPage = std::move(cachedPage), error]()
+                    {
+                        handler(GenerateBuiltPageResponse(target, cachedPage, error, *request));
+                    });
+            };
+
+        std::optional<ComputePriority> buildPriority;
+        if (registeredTarget->options.cpuBound)
+            buildPriority = registeredTarget->options.priority;
+
+        m_pageCache.AsyncGet(key, *registeredTarget->options.cache, std::move(build), std::move(respond), buildPriority);
+    }
+    PageCache::BuildFn Application::MakePageBuildFn(std::string_view target, const Target& registeredTarget, std::string_view page, const ParametersMap& urlParams)
+    {
+        // The build function may be called from another thread after this request has already
+        // completed (background refresh), so it needs its own copies of the target and parameters.
+        // It also resolves the file again so that a background refresh picks up a modified template.
+        // (Registered targets live in the router, which is not modified after setup, so a pointer is fine.)
+        std::vector<std::pair<std::string, std::string>> ownedParams(urlParams.begin(), urlParams.end());
+        return [this, target = std::string(target), registeredTarget = &registeredTarget, page = std::string(page), ownedParams = std::move(ownedParams)]() -> std::shared_ptr<const CachedPage>
+            {
+                std::shared_ptr<const FileInfo> fileInfo;
+                if (!registeredTarget->IsJSON())
+                {
+                    fileInfo = m_documentIndex.FindPage(page);
+                    if (fileInfo == nullptr)
+                        throw std::runtime_error(std::format("The file for target '{0}' no longer exists", target));
+                }
+
+                ParametersMap params;
+                for (const auto& [key, value] : ownedParams)
+                    params.emplace(key, value);
+
+                // A cached page is shared by many requests (and may be built in the background), so it is not
+                // tied to the context of whichever request happened to trigger the build
+                json data = GatherRequestData(target, registeredTarget, params, RequestContext{});
+
+                auto cachedPage = std::make_shared<CachedPage>();
+                if (registeredTarget->IsJSON())
+                {
+                    cachedPage->body = std::make_shared<const std::string>(data.dump());
+                    cachedPage->contentType = "application/json";
+                }
+                else
+                    cachedPage->body = std::make_shared<const std::string>(m_templateCache.Render(fileInfo->path, fileInfo->lastWriteTime, data));
+                cachedPage->etag = std::format("W/\"{0:x}\"", std::hash<std::string>{}(*cachedPage->body));
+                if (m_compressionLevel > 0 && cachedPage->body->size() >= m_compressionMinSize)
+                    cachedPage->gzipBody = std::make_shared<const std::string>(GzipCompress(*cachedPage->body, m_compressionLevel));
+                return cachedPage;
+            };
+    }
+    HTTPResponse Application::GenerateBuiltPageResponse(std::string_view target, const std::shared_ptr<const CachedPage>& cachedPage,
+                                                                   std::exception_ptr error, HTTPRequestType& req)
+    {
+        if (error != nullptr)
+        {
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const inja::RenderError& err)
+            {
+                LOG_ERROR("[CORE] Caught inja::RenderError: Type = '{0}' | Message = '{1}'", err.type, err.message);
+                LOG_ERROR("[CORE]     The failure came while building the cached page for target '{0}'", target);
+                return InternalServerError(err.message, req);
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] Failed to build the cached page for target '{0}'. Caught std::exception: \n'{1}'", target, e.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR("[CORE] Failed to build the cached page for target '{0}'. Caught unknown exception.", target);
             }
+            return InternalServerError("Something went wrong", req);
         }
 
-        return result;
+        LOG_INFO("[CORE] Returning status 200 - OK for target '{0}' (cached)", target);
+
+        return GenerateCachedPageResponse(*cachedPage, req);
     }
-    json Application::GatherRequestData(std::string_view target, const Application::ParametersMap& urlParams) const
+    HTTPResponse Application::GenerateDeadlineResponse(std::string_view target, const Target& registeredTarget, const ParametersMap& urlParams,
+                                                                   HTTPRequestType& req, const RequestContext& context)
     {
-        PROFILE_SCOPE("Application::GatherRequestData");
+        PROFILE_SCOPE("Application::GenerateDeadlineResponse");
 
-        // The normal use case is for the user application to register a target like '/home' and
-        // this will ultimately map to a file called 'home.html'. When a GET request comes through
-        // for '/home', this works just fine. However, if the GET request was for '/home.html', then
-        // we will fail to find the user supplied callback. Therefore, if the target ends in '.html',
-        // we will remove those characters when we go to lookup the user supplied callback
-        if (target.ends_with(".html"))
-            target.remove_suffix(5);
+        std::string_view reason = CancelReasonName(context.Reason());
+        LOG_WARN("[CORE] Gave up on target '{0}': {1}", target, reason);
 
-        // Call user-supplied callbacks
-        auto itr = m_GETTargets.find(target);
-        if (itr == m_GETTargets.end())
+        // A page that is out of date is usually more useful than an error page
+        if (registeredTarget.options.onDeadline == DeadlineFallback::StalePage)
         {
-            LOG_TRACE("[CORE] GatherRequestData: No user defined data gathering function for target: '{0}'", target);
-            return {};
+            std::shared_ptr<const CachedPage> stalePage = m_pageCache.Peek(PageCache::MakeKey(target, urlParams));
+            if (stalePage != nullptr)
+            {
+                LOG_INFO("[CORE] Returning status 200 - OK for target '{0}' (stale)", target);
+                return GenerateCachedPageResponse(*stalePage, req);
+            }
         }
 
-        LOG_TRACE("[CORE] GatherRequestData: Calling user defined data gathering function for target: '{0}'", target);
-        return itr->second(urlParams);
+        return ServiceUnavailable(std::format("The request for '{0}' could not be completed in time ({1}).", target, reason), req);
     }
-    http::message_generator Application::GenerateRedirectResponse(std::string_view target, HTTPRequestType& req)
+    HTTPResponse Application::GenerateCachedPageResponse(const CachedPage& cachedPage, HTTPRequestType& req)
     {
-        http::response<http::string_body> res{ http::status::permanent_redirect, req.version() };
+        if (IsNotModified(req, cachedPage.etag))
+            return GenerateNotModifiedResponse(cachedPage.etag, {}, req);
+
+        // The compressed variant was built along with the page, so a hit never has to compress anything
+        const bool gzip = cachedPage.gzipBody != nullptr && AcceptsGzip(req);
+
+        // The body is shared with the cache, so there is no need to copy the page into the response
+        http::response<SharedBody> res{
+            std::piecewise_construct,
+            std::make_tuple(gzip ? cachedPage.gzipBody : cachedPage.body),
+            std::make_tuple(http::status::ok, req.version()) };
         res.set(http::field::server, m_serverVersion);
-        res.set(http::field::content_type, "text/html");
-        res.set(http::field::location, target);
+        res.set(http::field::content_type, cachedPage.contentType);
+        res.set(http::field::etag, cachedPage.etag);
+        if (gzip)
+            res.set(http::field::content_encoding, "gzip");
+        if (cachedPage.gzipBody != nullptr)
+            res.set(http::field::vary, "Accept-Encoding");
         res.keep_alive(req.keep_alive());
         res.prepare_payload();
         return res;
     }
-    http::message_generator Application::GenerateHTMLResponse(std::string_view target, const Application::ParametersMap& urlParams, HTTPRequestType& req)
+    HTTPResponse Application::ServeFile(std::string_view target, HTTPRequestType& req)
     {
-        PROFILE_SCOPE("Application::GenerateHTMLResponse");
-
-        std::string file(target);
-
-        // Strip any leading '/' (We already ensure the document root ends with '/')
-        if (file.starts_with('/'))
-            file = file.erase(0, 1);
-
-        // If the target does not already end in ".html", then we assume the request was for
-        // is valid, but we simply need to append the html extension
-        if (!file.ends_with(".html"))
-            file += ".html";
+        PROFILE_SCOPE("Application::ServeFile");
 
-        // Prepend the document root path
-        file.insert(0, m_docRoot);
+        if (target.ends_with('/'))
+        {
+            LOG_ERROR("[CORE] Something went wrong. ServeFile was called with target = '{0}' which ends with '/'. However, this should have been handled as an HTML request and not handled via ServeFile", target);
+            return BadRequest(std::format("[CORE] ServerFile: Cannot serve target '{0}' because it ends with '/'", target), req);
+        }
 
-        LOG_TRACE("[CORE] GenerateHTMLResponse: Converted target to file: '{0}' -> '{1}'", target, file);
+        // Strip any leading '/' because the document index is keyed by paths relative to the document root
+        std::string_view file = target;
+        if (file.starts_with('/')) 
+            file.remove_prefix(1);
 
-        // If the file does not exist, then return 404
-        if (!std::filesystem::exists(file))
-        {
-            LOG_TRACE("[CORE] GenerateHTMLResponse: File not found: '{0}'", file);
+        // If the file is not in the index, it does not exist
+        std::shared_ptr<const FileInfo> fileInfo = m_documentIndex.Find(file);
+        if (fileInfo == nullptr)
             return FileNotFound(target, req);
-        }
 
-        // Gather all data that will be used to fulfill the request to generate the necessary html
-        json data;
-        {
-            PROFILE_SCOPE("GatherRequestData - outer");
-            data = GatherRequestData(target, urlParams);
-        }
+        // If there are precompressed copies of the file, pick the one the client prefers. From here on,
+        // the chosen copy is what gets served (with its own ETag, size, and byte ranges), but with the
+        // content type of the original file.
+        FileRepresentation representation{ .mimeType = fileInfo->mimeType };
+        PrecompressedVariants variants = m_documentIndex.FindPrecompressed(file);
+        if (variants.brotli != nullptr || variants.gzip != nullptr)
         {
-            PROFILE_SCOPE("Some logging 2");
-
-            LOG_TRACE("[CORE] GenerateHTMLResponse: Received data for target '{0}': \n{1}", target, data.dump(4));
+            representation.varies = true;
+
+            auto acceptEncoding = req.find(http::field::accept_encoding);
+            representation.coding = NegotiateContentCoding(
+                acceptEncoding != req.end() ? acceptEncoding->value() : std::string_view(),
+                variants.brotli != nullptr,
+                variants.gzip != nullptr);
+
+            if (representation.coding == ContentCoding::Brotli)
+                fileInfo = std::move(variants.brotli);
+            else if (representation.coding == ContentCoding::Gzip)
+                fileInfo = std::move(variants.gzip);
         }
 
-        // Generate the html to be rendered
-        std::string html;
-        try
-        {
-            PROFILE_SCOPE("Inja render_file");
+        // If the client already has the current version of the file, there is nothing to send
+        if (IsNotModified(req, fileInfo->etag, fileInfo->lastModified))
+            return GenerateNotModifiedResponse(fileInfo->etag, fileInfo->lastModifiedDate, req, representation.varies ? "Accept-Encoding" : "");
 
-            html = m_injaEnv.render_file(file, data);
-        }
-        catch (const inja::RenderError& err)
+        // Only GET requests can ask for part of the file. If-Range makes the Range header conditional on
+        // the client's partial copy still being current, otherwise the whole file is sent.
+        RangeRequest range;
+        if (req.method() == http::verb::get)
         {
-            LOG_ERROR("[CORE] Caught inja::RenderError: Type = '{0}' | Message = '{0}'", err.type, err.message);
-            LOG_ERROR("[CORE]     The failure came from this call: 'm_injaEnv.render_file(file, data)', where file = '{0}' and data = \n{1}", file, data.dump(4));
-            return InternalServerError(err.message, req);
+            auto rangeHeader = req.find(http::field::range);
+            if (rangeHeader != req.end() && IfRangeMatches(req, fileInfo->etag, fileInfo->lastModified))
+                range = ParseRange(rangeHeader->value(), fileInfo->size);
         }
 
-        LOG_INFO("[CORE] Returning status 200 - OK for target '{0}'", target);
-
-        http::response<http::string_body> res{ http::status::ok, req.version() };
+        if (range.result == RangeRequest::Result::Unsatisfiable)
+            return GenerateRangeNotSatisfiableResponse(fileInfo->size, req);
 
+        // Multiple ranges are sent as a multipart/byteranges body that has to be assembled in memory. If
+        // that would be too large, ignore the Range header and send the whole file instead (the RFC allows
+        // this). Browsers and download managers only ever ask for a single range anyway.
+        if (range.result == RangeRequest::Result::Satisfiable && range.ranges.size() > 1)
         {
-            PROFILE_SCOPE("Prepare response");
+            std::uint64_t total = 0;
+            for (const ByteRange& byteRange : range.ranges)
+                total += byteRange.length;
 
-            res.set(http::field::server, m_serverVersion);
-            res.set(http::field::content_type, "text/html");
-            res.keep_alive(req.keep_alive());
-            res.body() = html;
-            res.prepare_payload();
+            if (total > m_maxMultipartRangeBytes)
+                range = {};
         }
-        return res;
-    }
-    http::message_generator Application::ServeFile(std::string_view target, HTTPRequestType& req)
-    {
-        PROFILE_SCOPE("Application::ServeFile");
 
-        std::string file(target);
+        const bool partial = range.result == RangeRequest::Result::Satisfiable;
+        const bool multipart = partial && range.ranges.size() > 1;
+        const std::string boundary = multipart ? std::format("{0:016x}", std::hash<std::string_view>{}(fileInfo->etag)) : std::string();
 
-        if (file.ends_with('/'))
+        // Small files are served straight from memory, without a copy
+        if (std::shared_ptr<const std::string> buffer = m_staticAssetCache.Get(*fileInfo))
         {
-            LOG_ERROR("[CORE] Something went wrong. ServeFile was called with target = '{0}' which ends with '/'. However, this should have been handled as an HTML request and not handled via ServeFile", target);
-            return BadRequest(std::format("[CORE] ServerFile: Cannot serve target '{0}' because it ends with '/'", target), req);
-        }
+            // Respond to HEAD request
+            if (req.method() == http::verb::head)
+            {
+                LOG_INFO("[CORE] Returning status 200 - OK for target '{0}' (cached)", target);
 
-        // Strip any leading '/' (We already ensure the document root ends with '/')
-        if (file.starts_with('/')) 
-            file = file.erase(0, 1); 
+                http::response<http::empty_body> res{ http::status::ok, req.version() };
+                SetFileHeaders(res, *fileInfo, representation);
+                res.content_length(buffer->size());
+                res.keep_alive(req.keep_alive());
+                return res;
+            }
 
-        // Prepend the document root path
-        file.insert(0, m_docRoot);
+            // A single range is just a narrower view of the same cached buffer
+            std::string_view view = *buffer;
+            if (multipart)
+            {
+                std::optional<std::string> parts = MakeMultipartByteranges(boundary, representation.mimeType, fileInfo->size, range.ranges,
+                    [&view](const ByteRange& byteRange, std::string& out)
+                    {
+                        out.append(view.substr(static_cast<std::size_t>(byteRange.offset), static_cast<std::size_t>(byteRange.length)));
+                        return true;
+                    });
+                buffer = std::make_shared<const std::string>(std::move(*parts));
+                view = *buffer;
+            }
+            else if (partial)
+                view = view.substr(static_cast<std::size_t>(range.ranges[0].offset), static_cast<std::size_t>(range.ranges[0].length));
+
+            LOG_INFO("[CORE] Returning status {0} for target '{1}' (cached)", partial ? "206 - Partial Content" : "200 - OK", target);
+
+            // Respond to GET request
+            http::response<SharedBody> res{
+                std::piecewise_construct,
+                std::make_tuple(std::move(buffer), view),
+                std::make_tuple(partial ? http::status::partial_content : http::status::ok, req.version()) };
+            SetFileHeaders(res, *fileInfo, representation);
+            if (multipart)
+                res.set(http::field::content_type, std::format("multipart/byteranges; boundary={0}", boundary));
+            else if (partial)
+                res.set(http::field::content_range, range.ranges[0].ContentRange(fileInfo->size));
+            res.content_length(res.body().view.size());
+            res.keep_alive(req.keep_alive());
+            return res;
+        }
 
-        // Attempt to open the file
+        // Attempt to open the file. If the document index is holding the file open, its descriptor is reused
         beast::error_code ec;
-        http::file_body::value_type body;
-        body.open(file.data(), beast::file_mode::scan, ec); 
+        StaticFileBody::value_type body;
+        body.Open(fileInfo, ec);
 
         // Handle the case where the file doesn't exist
         if (ec == beast::errc::no_such_file_or_directory)
@@ -525,164 +1813,198 @@ namespace Clover
         if (ec)
             return InternalServerError(ec.message(), req);
 
-        // Cache the size since we need it after the move
-        auto const size = body.size();
-
-        LOG_INFO("[CORE] Returning status 200 - OK for target '{0}'", target);
-
         // Respond to HEAD request
         if (req.method() == http::verb::head)
         {
+            LOG_INFO("[CORE] Returning status 200 - OK for target '{0}'", target);
+
             http::response<http::empty_body> res{ http::status::ok, req.version() };
-            res.set(http::field::server, m_serverVersion);
-            res.set(http::field::content_type, MimeType(target));
-            res.content_length(size);
+            SetFileHeaders(res, *fileInfo, representation);
+            res.content_length(body.length);
+            res.keep_alive(req.keep_alive());
+            return res;
+        }
+
+        // The multipart body is assembled by reading each range out of the file
+        if (multipart)
+        {
+            std::optional<std::string> parts = MakeMultipartByteranges(boundary, representation.mimeType, fileInfo->size, range.ranges,
+                [&body](const ByteRange& byteRange, std::string& out)
+                {
+                    std::size_t start = out.size();
+                    out.resize(start + static_cast<std::size_t>(byteRange.length));
+
+                    std::uint64_t done = 0;
+                    while (done < byteRange.length)
+                    {
+                        beast::error_code readError;
+                        std::size_t bytes = body.ReadSome(byteRange.offset + done, out.data() + start + done, static_cast<std::size_t>(byteRange.length - done), readError);
+                        if (readError || bytes == 0)
+                            return false;
+                        done += bytes;
+                    }
+                    return true;
+                });
+
+            if (!parts.has_value())
+                return InternalServerError(std::format("Failed to read file '{0}'", fileInfo->path), req);
+
+            LOG_INFO("[CORE] Returning status 206 - Partial Content for target '{0}' ({1} ranges)", target, range.ranges.size());
+
+            http::response<http::string_body> res{ http::status::partial_content, req.version() };
+            SetFileHeaders(res, *fileInfo, representation);
+            res.set(http::field::content_type, std::format("multipart/byteranges; boundary={0}", boundary));
             res.keep_alive(req.keep_alive());
+            res.body() = std::move(*parts);
+            res.prepare_payload();
             return res;
         }
 
-        // Respond to GET request
-        http::response<http::file_body> res{
+        if (partial)
+        {
+            body.offset = range.ranges[0].offset;
+            body.length = range.ranges[0].length;
+        }
+
+        LOG_INFO("[CORE] Returning status {0} for target '{1}'", partial ? "206 - Partial Content" : "200 - OK", target);
+
+        // Respond to GET request. The session sends the body with sendfile when possible (see HTTPSession::DoWrite)
+        StaticFileResponse res{
             std::piecewise_construct,
             std::make_tuple(std::move(body)),
-            std::make_tuple(http::status::ok, req.version()) };
-        res.set(http::field::server, m_serverVersion);
-        res.set(http::field::content_type, MimeType(target));
-        res.content_length(size);
+            std::make_tuple(partial ? http::status::partial_content : http::status::ok, req.version()) };
+        SetFileHeaders(res, *fileInfo, representation);
+        if (partial)
+            res.set(http::field::content_range, range.ranges[0].ContentRange(fileInfo->size));
+        res.content_length(res.body().length);
         res.keep_alive(req.keep_alive());
         return res;
     }
-    
-    http::message_generator Application::BadRequest(std::string_view reason, HTTPRequestType& req)
+    bool Application::AcceptsGzip(const HTTPRequestType& req) const noexcept
     {
-        PROFILE_SCOPE("Application::BadRequest");
+        auto acceptEncoding = req.find(http::field::accept_encoding);
+        return acceptEncoding != req.end() && EncodingQuality(acceptEncoding->value(), "gzip") > 0.0;
+    }
+    void Application::CompressResponse(http::response<http::string_body>& res, const HTTPRequestType& req) const
+    {
+        PROFILE_SCOPE("Application::CompressResponse");
 
-        LOG_WARN("[CORE] Returning status 400 - Bad Request for target '{0}'", std::string_view(req.target()));
-        LOG_WARN("[CORE]     Reason: {0}", reason);
-        
-        std::string body;
+        // Small bodies are not worth the CPU time (and may even grow)
+        if (m_compressionLevel <= 0 || res.body().size() < m_compressionMinSize)
+            return;
 
-        if (m_badRequestTarget.empty())
-            body = reason;
-        else
+        // Whether or not this particular response gets compressed, a cache has to know it depends on Accept-Encoding
+        res.set(http::field::vary, "Accept-Encoding");
+
+        if (!AcceptsGzip(req))
+            return;
+
+        try
         {
-            // Prepend the document root path
-            std::string file = m_docRoot + m_badRequestTarget;
-            if (!std::filesystem::exists(file))
-            {
-                LOG_ERROR("[CORE] BadRequest: File not found: '{0}'", file);
-                body = reason;
-            }
-            else
-            {
-                json data = { { "reason", std::string(reason) } }; 
-                try
-                {                    
-                    body = m_injaEnv.render_file(file, data);
-                }
-                catch (const inja::RenderError& err) 
-                {
-                    LOG_ERROR("[CORE] BadRequest: Caught inja::RenderError: Type = '{0}' | Message = '{0}'", err.type, err.message);
-                    LOG_ERROR("[CORE]     The failure came from this call: 'm_injaEnv.render_file(file, data)', where file = '{0}' and data = \n{1}", file, data.dump(4));
-                    body = reason;
-                }
-            }
+            res.body() = GzipCompress(res.body(), m_compressionLevel);
+            res.set(http::field::content_encoding, "gzip");
+        }
+        catch (const std::exception& e)
+        {
+            // Not fatal. The response is just sent uncompressed
+            LOG_ERROR("[CORE] Application::CompressResponse failure. Caught std::exception: \n'{0}'", e.what());
         }
+    }
+    HTTPResponse Application::GenerateRangeNotSatisfiableResponse(std::uint64_t size, HTTPRequestType& req)
+    {
+        LOG_INFO("[CORE] Returning status 416 - Range Not Satisfiable for target '{0}'", std::string_view(req.target()));
 
-        http::response<http::string_body> res{ http::status::bad_request, req.version() };
+        http::response<http::empty_body> res{ http::status::range_not_satisfiable, req.version() };
         res.set(http::field::server, m_serverVersion);
-        res.set(http::field::content_type, "text/html");
+        res.set(http::field::content_range, std::format("bytes */{0}", size));
         res.keep_alive(req.keep_alive());
-        res.body() = body;
         res.prepare_payload();
         return res;
     }
-    http::message_generator Application::FileNotFound(std::string_view target, HTTPRequestType& req)
+    
+    HTTPResponse Application::BadRequest(std::string_view reason, HTTPRequestType& req)
     {
-        PROFILE_SCOPE("Application::FileNotFound");
+        PROFILE_SCOPE("Application::BadRequest");
 
-        LOG_WARN("[CORE] Returning status 404 - Not Found for target '{0}'", std::string_view(req.target()));
+        LOG_WARN("[CORE] Returning status 400 - Bad Request for target '{0}'", std::string_view(req.target()));
+        LOG_WARN("[CORE]     Reason: {0}", reason);
 
-        std::string reason = "The resource '" + std::string(target) + "' was not found.";
-        std::string body;
+        return GenerateErrorResponse(m_badRequestPage, reason, req);
+    }
+    HTTPResponse Application::FileNotFound(std::string_view target, HTTPRequestType& req)
+    {
+        PROFILE_SCOPE("Application::FileNotFound");
 
-        if (m_notFoundTarget.empty())
-            body = reason;
-        else
-        {
-            // Prepend the document root path
-            std::string file = m_docRoot + m_notFoundTarget;
-            if (!std::filesystem::exists(file)) 
-            {
-                LOG_ERROR("[CORE] FileNotFound: File not found: '{0}'", file);
-                body = reason;
-            }
-            else
-            {
-                json data = { { "reason", std::string(reason) } };
-                try
-                {
-                    body = m_injaEnv.render_file(file, data); 
-                }
-                catch (const inja::RenderError& err)
-                {
-                    LOG_ERROR("[CORE] FileNotFound: Caught inja::RenderError: Type = '{0}' | Message = '{0}'", err.type, err.message);
-                    LOG_ERROR("[CORE]     The failure came from this call: 'm_injaEnv.render_file(file, data)', where file = '{0}' and data = \n{1}", file, data.dump(4));
-                    body = reason; 
-                }
-            }
-        }
+        LOG_WARN("[CORE] Returning status 404 - Not Found for target '{0}'", std::string_view(req.target()));
 
-        http::response<http::string_body> res{ http::status::not_found, req.version() };
-        res.set(http::field::server, m_serverVersion);
-        res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = body;
-        res.prepare_payload();
-        return res;
+        return GenerateErrorResponse(m_notFoundPage, std::format("The resource '{0}' was not found.", target), req);
     }
-    http::message_generator Application::InternalServerError(std::string_view reason, HTTPRequestType& req)
+    HTTPResponse Application::InternalServerError(std::string_view reason, HTTPRequestType& req)
     {
         PROFILE_SCOPE("Application::InternalServerError");
 
         LOG_WARN("[CORE] Returning status 500 - Internal Server Error for target '{0}'", std::string_view(req.target()));
         LOG_WARN("[CORE]     Reason: {0}", reason);
 
-        std::string _reason = "An error occurred: '" + std::string(reason) + "'";
-        std::string body;
+        return GenerateErrorResponse(m_internalServerErrorPage, std::format("An error occurred: '{0}'", reason), req);
+    }
+    HTTPResponse Application::ServiceUnavailable(std::string_view reason, HTTPRequestType& req)
+    {
+        PROFILE_SCOPE("Application::ServiceUnavailable");
+
+        LOG_WARN("[CORE] Returning status 503 - Service Unavailable for target '{0}'", std::string_view(req.target()));
+        LOG_WARN("[CORE]     Reason: {0}", reason);
+
+        return GenerateErrorResponse(m_serviceUnavailablePage, reason, req);
+    }
+    HTTPResponse Application::PayloadTooLarge(HTTPRequestType& req)
+    {
+        PROFILE_SCOPE("Application::PayloadTooLarge");
 
-        if (m_internalServerErrorTarget.empty())
-            body = _reason;
-        else
+        LOG_WARN("[CORE] Returning status 413 - Payload Too Large for target '{0}'", std::string_view(req.target()));
+
+        return GenerateErrorResponse(m_payloadTooLargePage, std::format("The request body for '{0}' is too large.", std::string_view(req.target())), req);
+    }
+    HTTPResponse Application::MethodNotAllowed(std::string_view target, std::string_view allow, HTTPRequestType& req)
+    {
+        PROFILE_SCOPE("Application::MethodNotAllowed");
+
+        LOG_WARN("[CORE] Returning status 405 - Method Not Allowed for {0} '{1}' (allowed: {2})", std::string_view(req.method_string()), std::string_view(req.target()), allow);
+
+        http::response<http::string_body> res = m_methodNotAllowedPage.Response(
+            std::format("The method '{0}' is not allowed for '{1}'.", std::string_view(req.method_string()), target),
+            req.version(), req.keep_alive(), m_documentIndex, m_templateCache, m_serverVersion);
+        res.set(http::field::allow, allow);
+        CompressResponse(res, req);
+        res.prepare_payload();
+        return res;
+    }
+    std::string Application::AllowedMethods(std::string_view target) const
+    {
+        // Same lookup as ResolveHTMLTarget. Targets can only be registered for GET, PUT, and POST, and a
+        // GET target also answers HEAD
+        std::string_view routePath = target;
+        if (routePath.ends_with(".html"))
+            routePath.remove_suffix(5);
+
+        std::string allow;
+        for (http::verb method : { http::verb::get, http::verb::put, http::verb::post })
         {
-            // Prepend the document root path
-            std::string file = m_docRoot + m_internalServerErrorTarget;
-            if (!std::filesystem::exists(file)) 
-            {
-                LOG_ERROR("[CORE] InternalServerError: File not found: '{0}'", file);
-                body = _reason;
-            }
-            else
-            {
-                json data = { { "reason", _reason } };
-                try
-                {
-                    body = m_injaEnv.render_file(file, data);
-                }
-                catch (const inja::RenderError& err)
-                {
-                    LOG_ERROR("[CORE] InternalServerError: Caught inja::RenderError: Type = '{0}' | Message = '{0}'", err.type, err.message);
-                    LOG_ERROR("[CORE]     The failure came from this call: 'm_injaEnv.render_file(file, data)', where file = '{0}' and data = \n{1}", file, data.dump(4));
-                    body = _reason;
-                }
-            }
+            if (m_router.Find(method, routePath).value == nullptr)
+                continue;
+
+            if (!allow.empty())
+                allow += ", ";
+            allow += http::to_string(method);
+            if (method == http::verb::get)
+                allow += ", HEAD";
         }
-
-        http::response<http::string_body> res{ http::status::internal_server_error, req.version() };
-        res.set(http::field::server, m_serverVersion);
-        res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = body;
+        return allow;
+    }
+    HTTPResponse Application::GenerateErrorResponse(ErrorPage& page, std::string_view reason, HTTPRequestType& req)
+    {
+        http::response<http::string_body> res = page.Response(reason, req.version(), req.keep_alive(), m_documentIndex, m_templateCache, m_serverVersion);
+        CompressResponse(res, req);
         res.prepare_payload();
         return res;
     }
@@ -780,10 +2102,11 @@ namespace Clover
 
     // =====================================================
     // DetectSession
-    DetectSession::DetectSession(tcp::socket&& socket, ssl::context& ctx, Application* application) :
+    DetectSession::DetectSession(tcp::socket&& socket, ssl::context& ctx, Application* application, AdmissionControl::ConnectionSlot connection) :
         m_stream(std::move(socket)),
         m_ctx(ctx),
-        m_application(application)
+        m_application(application),
+        m_connection(std::move(connection))
     {
         m_address = m_stream.socket().remote_endpoint().address().to_string();
         m_port = m_stream.socket().remote_endpoint().port();
@@ -864,7 +2187,8 @@ namespace Clover
                     std::move(m_stream),
                     m_ctx,
                     std::move(m_buffer),
-                    m_application)->Run();
+                    m_application,
+                    std::move(m_connection))->Run();
                 return;
             }
 
@@ -874,7 +2198,8 @@ namespace Clover
             std::make_shared<PlainHTTPSession>(
                 std::move(m_stream),
                 std::move(m_buffer),
-                m_application)->Run();
+                m_application,
+                std::move(m_connection))->Run();
         }
         catch (const boost::exception& e)
         {
@@ -895,11 +2220,35 @@ namespace Clover
     // =====================================================
     // Listener
 
-    Listener::Listener(net::io_context& ioc, ssl::context& ctx, tcp::endpoint endpoint, Application* application) :
+#ifdef PLATFORM_LINUX
+    // An integer socket option that Asio has no type for. Written against Asio's documented
+    // SettableSocketOption requirements, since its own helpers for this live in net::detail
+    template<int Level, int Name>
+    class IntegerSocketOption
+    {
+    public:
+        explicit IntegerSocketOption(int value) noexcept : m_value(value) {}
+
+        template<typename Protocol> ND int level(const Protocol&) const noexcept { return Level; }
+        template<typename Protocol> ND int name(const Protocol&) const noexcept { return Name; }
+        template<typename Protocol> ND const int* data(const Protocol&) const noexcept { return &m_value; }
+        template<typename Protocol> ND std::size_t size(const Protocol&) const noexcept { return sizeof(m_value); }
+
+    private:
+        int m_value;
+    };
+#endif
+
+    Listener::Listener(net::io_context& ioc, ssl::context& ctx, tcp::endpoint endpoint, const ListenerOptions& options, Application* application,
+                       IOShard* shard, net::io_context* acceptIoc) :
         m_ioc(ioc),
         m_ctx(ctx),
-        m_acceptor(net::make_strand(ioc)),
-        m_application(application)
+        m_acceptor(acceptIoc != nullptr ? net::any_io_executor(acceptIoc->get_executor()) :
+                   shard != nullptr     ? net::any_io_executor(ioc.get_executor()) : net::any_io_executor(net::make_strand(ioc))),
+        m_options(options),
+        m_application(application),
+        m_shard(shard),
+        m_pauseTimer(m_acceptor.get_executor())
     {
         assert(m_application != nullptr);
 
@@ -921,6 +2270,41 @@ namespace Clover
             return;
         }
 
+#ifdef PLATFORM_LINUX
+        // Lets every shard bind the same endpoint
+        if (m_shard != nullptr)
+        {
+            m_acceptor.set_option(IntegerSocketOption<SOL_SOCKET, SO_REUSEPORT>(1), ec);
+            if (ec)
+            {
+                LOG_ERROR("[CORE] Received Listener acceptor set_option (SO_REUSEPORT) error: '{0}'", ec.what());
+                return;
+            }
+        }
+#endif
+
+        // Neither option is essential, so failing to set one is only a warning
+#ifdef PLATFORM_LINUX
+        if (m_options.deferAccept)
+        {
+            m_acceptor.set_option(IntegerSocketOption<IPPROTO_TCP, TCP_DEFER_ACCEPT>(static_cast<int>(m_options.deferAcceptTimeout.count())), ec);
+            if (ec)
+                LOG_WARN("[CORE] Received Listener acceptor set_option (TCP_DEFER_ACCEPT) error: '{0}'", ec.what());
+        }
+
+        // Accepted sockets inherit TCP_NODELAY from the listening socket on Linux, which saves a
+        // setsockopt for every connection
+        if (m_options.noDelay)
+        {
+            m_acceptor.set_option(tcp::no_delay(true), ec);
+            if (ec)
+                LOG_WARN("[CORE] Received Listener acceptor set_option (TCP_NODELAY) error: '{0}'", ec.what());
+        }
+#else
+        if (m_options.deferAccept)
+            LOG_WARN("[CORE] ListenerOptions::deferAccept is only supported on Linux and will be ignored");
+#endif
+
         // Bind to the server address
         m_acceptor.bind(endpoint, ec);
         if (ec)
@@ -945,6 +2329,46 @@ namespace Clover
 
     void Listener::DoAccept() noexcept
     {
+        // At the connection limit, stop accepting until some connections have closed. New connections wait
+        // in the kernel's backlog meanwhile, which costs the server nothing.
+        if (m_application->GetAdmissionControl().AtConnectionLimit())
+        {
+            if (!m_paused)
+            {
+                m_paused = true;
+                m_application->GetAdmissionControl().CountAcceptPause();
+                beast::error_code ec;
+                tcp::endpoint endpoint = m_acceptor.local_endpoint(ec);
+                LOG_WARN("[CORE] Reached the connection limit. Pausing accepting on {0}:{1}", endpoint.address().to_string(), endpoint.port());
+            }
+
+            m_pauseTimer.expires_after(m_application->GetAdmissionControl().Limits().acceptPauseInterval);
+            m_pauseTimer.async_wait(
+                beast::bind_front_handler(
+                    &Listener::OnAcceptPaused,
+                    this->shared_from_this()));
+            return;
+        }
+
+        if (m_paused)
+        {
+            m_paused = false;
+            beast::error_code ec;
+            tcp::endpoint endpoint = m_acceptor.local_endpoint(ec);
+            LOG_INFO("[CORE] Resuming accepting on {0}:{1}", endpoint.address().to_string(), endpoint.port());
+        }
+
+        // A shard's io_context is only ever run by one thread, so its connections don't need a strand
+        if (m_shard != nullptr)
+        {
+            m_acceptor.async_accept(
+                m_ioc.get_executor(),
+                beast::bind_front_handler(
+                    &Listener::OnAccept,
+                    this->shared_from_this()));
+            return;
+        }
+
         // The new connection gets its own strand
         m_acceptor.async_accept(
             net::make_strand(m_ioc),
@@ -953,6 +2377,15 @@ namespace Clover
                 this->shared_from_this()));
     }
 
+    void Listener::OnAcceptPaused(beast::error_code ec) noexcept
+    {
+        // Only cancelled when the io_context is shutting down
+        if (ec == net::error::operation_aborted)
+            return;
+
+        DoAccept();
+    }
+
     void Listener::OnAccept(beast::error_code ec, tcp::socket socket) noexcept
     {
         try
@@ -960,18 +2393,66 @@ namespace Clover
             if (ec)
             {
                 LOG_ERROR("[CORE] Received Listener::OnAccept error: '{0}'", ec.what());
+                if (m_shard != nullptr)
+                    m_shard->acceptErrors.fetch_add(1, std::memory_order_relaxed);
             }
             else
             {
+                if (m_shard != nullptr)
+                    m_shard->connectionsAccepted.fetch_add(1, std::memory_order_relaxed);
+
                 LOG_TRACE("[CORE] Attempting to accept incoming connection from {0}:{1}...",
                     socket.remote_endpoint().address().to_string(),
                     socket.remote_endpoint().port());
 
-                // Create the detector http_session and run it
-                std::make_shared<DetectSession>(
-                    std::move(socket),
-                    m_ctx,
-                    m_application)->Run();
+#ifndef PLATFORM_LINUX
+                if (m_options.noDelay)
+                {
+                    beast::error_code noDelayError;
+                    socket.set_option(tcp::no_delay(true), noDelayError);
+                }
+#endif
+
+                // A connection over the limits is closed straight away, which is the cheapest way to turn it away.
+                // Another listener (or shard) may have taken the last place since DoAccept checked.
+                AdmissionControl::ConnectionSlot connection = m_application->GetAdmissionControl().TryAdmitConnection(socket.remote_endpoint().address());
+                if (!connection)
+                {
+                    LOG_TRACE("[CORE] Rejected connection from {0} (connection limit)", socket.remote_endpoint().address().to_string());
+                    beast::error_code closeError;
+                    socket.close(closeError);
+                }
+                else
+                {
+                    switch (m_options.protocol)
+                    {
+                    case ListenerProtocol::Plain:
+                        Launch(std::make_shared<PlainHTTPSession>(
+                            beast::tcp_stream(std::move(socket)),
+                            beast::flat_buffer{},
+                            m_application,
+                            std::move(connection)));
+                        break;
+
+                    case ListenerProtocol::TLS:
+                        Launch(std::make_shared<SSLHTTPSession>(
+                            beast::tcp_stream(std::move(socket)),
+                            m_ctx,
+                            beast::flat_buffer{},
+                            m_application,
+                            std::move(connection)));
+                        break;
+
+                    case ListenerProtocol::Detect:
+                        // Create the detector http_session and run it
+                        std::make_shared<DetectSession>(
+                            std::move(socket),
+                            m_ctx,
+                            m_application,
+                            std::move(connection))->Run();
+                        break;
+                    }
+                }
             }
         }
         catch (const boost::exception& e)
@@ -1,7 +1,30 @@
 #pragma once
 #include "pch.hpp"
+#include "AdmissionControl.hpp"
+#include "BodyParser.hpp"
+#include "Compression.hpp"
+#include "ComputePool.hpp"
+#include "ConditionalRequest.hpp"
+#include "ContentEncoding.hpp"
+#include "DocumentIndex.hpp"
+#include "ErrorPage.hpp"
+#include "HTTPResponse.hpp"
+#include "IOShard.hpp"
+#include "ListenerOptions.hpp"
 #include "Log.hpp"
+#include "Middleware.hpp"
+#include "PageCache.hpp"
+#include "Parameters.hpp"
 #include "Profiling.hpp"
+#include "RangeRequest.hpp"
+#include "RequestBody.hpp"
+#include "RequestContext.hpp"
+#include "Router.hpp"
+#include "SharedBody.hpp"
+#include "StaticAssetCache.hpp"
+#include "StaticFileBody.hpp"
+#include "TemplateCache.hpp"
+#include "ThreadPlacement.hpp"
 
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/exception_ptr.hpp>
@@ -11,12 +34,100 @@ namespace Clover
     class PlainWebsocketSession;
     class SSLWebsocketSession;
 
+    // What to send when a request runs past its target's deadline (see TargetOptions::deadline)
+    enum class DeadlineFallback
+    {
+        ServiceUnavailable,     // 503 - Service Unavailable
+        StalePage               // The last page that was rendered for the same target and parameters, or a 503 if there is none
+    };
+
+    // How the data gathered for a target is sent back (see TargetOptions::format)
+    enum class ResponseFormat
+    {
+        Page,                   // Rendered with the target's page
+        JSON                    // Serialized straight into the response as application/json. No page is needed
+    };
+
+    // Optional settings that can be supplied when registering a target
+    // NOTE: This lives outside of Application so that its members can have default initializers
+    //       and still be used in the default arguments of Application's member functions
+    struct TargetOptions
+    {
+        // If set, the rendered page is cached (keyed by target + parameters) so that subsequent
+        // requests skip both the data gathering function and rendering. Only for GET targets.
+        std::optional<PageCache::Options> cache = std::nullopt;
+
+        // The page to render, relative to the document root (e.g. "user/profile.html"). By default, the
+        // page has the same name as the target, which is not possible for a target with parameters such
+        // as '/user/{id}', so those need to name their page here.
+        std::string page = "";
+
+        // JSON targets skip the document root and the template engine entirely, for fetch/XHR calls that
+        // want the data itself. Like pages, they are only matched by targets without a file extension
+        // ('/api/user/{id}', not '/api/user.json').
+        ResponseFormat format = ResponseFormat::Page;
+
+        // CPU heavy GET targets (large reports, expensive renders) can be handled on the compute pool
+        // instead of an io thread, so they don't hold up static files and websocket traffic. The data
+        // gathering function and the render both run on the pool. If the target is also cached, a hit is
+        // still answered from the io thread and only a miss goes to the pool. Ignored for asynchronous targets.
+        bool cpuBound = false;
+        ComputePriority priority = ComputePriority::Interactive;
+
+        // How long a request for the target may take, measured from when it was received (so time spent
+        // queued on the compute pool counts). The deadline is available to the data gathering function
+        // through the RequestContext. Once it has passed (or the client disconnects), the request is
+        // abandoned at the next opportunity - before gathering data, before rendering, or while waiting
+        // on data providers - and 'onDeadline' is sent instead. 0 means no deadline.
+        std::chrono::milliseconds deadline{ 0 };
+        DeadlineFallback onDeadline = DeadlineFallback::ServiceUnavailable;
+
+        // With DeadlineFallback::StalePage, how old the copy kept for the fallback may get before a newly
+        // rendered page replaces it. Keeping a copy costs a copy of the page, so it isn't done on every response.
+        std::chrono::milliseconds stalePageInterval{ 1000 };
+
+        // Largest request body accepted for the target, in bytes. Larger requests are answered with
+        // 413 - Payload Too Large before the body is read. 0 means the server default (see SetMaxRequestBodySize).
+        std::uint64_t maxBodySize = 0;
+    };
+
     class Application
     {
     public:
-        using ParametersMap = std::unordered_map<std::string_view, std::string_view>;
+        using ParametersMap = Parameters;
         using DataGatherFn = std::function<json(const ParametersMap&)>;
-        
+
+        // A data gathering function that can wait on something (a database, another service, a thread
+        // pool) without blocking the io thread. The coroutine runs on the session's strand, but while it
+        // is suspended the strand is free to service other work. The parameters stay valid until the
+        // coroutine completes. If the client disconnects or the target's deadline passes, the operation
+        // the coroutine is waiting on is cancelled (it completes with operation_aborted).
+        using AsyncDataGatherFn = std::function<net::awaitable<json>(const ParametersMap&)>;
+
+        // Data gathering functions that also receive the request's deadline and cancellation signal.
+        // Long running functions should check context.IsCancelled() and give up early when it is set.
+        using ContextDataGatherFn = std::function<json(const ParametersMap&, const RequestContext&)>;
+        using AsyncContextDataGatherFn = std::function<net::awaitable<json>(const ParametersMap&, const RequestContext&)>;
+
+        // Data gathering function for PUT and POST targets, which also receives the request body. A large
+        // body may have been spooled to a temporary file (see RequestBody), so use Data() only when
+        // IsSpooled() is false, or ReadAll()/SaveAs() either way. ParseJSONBody and MultipartForm decode the
+        // body from wherever it is (see BodyParser.hpp for what each of them copies), and a BadRequestBody
+        // thrown from here is answered with 400 - Bad Request.
+        using BodyDataGatherFn = std::function<json(const ParametersMap&, const RequestBody&, const RequestContext&)>;
+
+        // One of several independent sources of data for a page. The providers of a target are run
+        // concurrently on the compute pool and each result is placed in the template data under the
+        // provider's name. A provider that throws, or that has not finished within its timeout, is left
+        // as null so the page can still be rendered with whatever did arrive. A timeout of 0 means wait
+        // as long as it takes.
+        struct DataProvider
+        {
+            std::string name;
+            DataGatherFn dataGatherFn;
+            std::chrono::milliseconds timeout{ 0 };
+        };
+        using TargetOptions = Clover::TargetOptions;
 
         Application(std::string_view address, unsigned short port, unsigned int threads = std::thread::hardware_concurrency(),
                     const std::string& cert = "", const std::string& key = "", const std::string& dh = "") noexcept;
@@ -24,8 +135,61 @@ namespace Clover
 
         void Run() noexcept;
 
-        using HTTPRequestType = http::request<http::string_body, http::basic_fields<std::allocator<char>>>;
-        ND http::message_generator HandleHTTPRequest(HTTPRequestType req) noexcept;
+        using HTTPRequestType = HTTPRequest;
+        ND HTTPResponse HandleHTTPRequest(HTTPRequestType req, RequestContext context = {}) noexcept;
+
+        // Same as above, but targets registered with an asynchronous data gathering function are handled
+        // by a coroutine spawned on 'executor'. The handler is called exactly once with the response,
+        // either before this returns or later from 'executor'. Cancelling the context (e.g. because the
+        // client disconnected) abandons the request at the next opportunity.
+        using ResponseHandler = std::function<void(HTTPResponse)>;
+        void HandleHTTPRequest(HTTPRequestType req, RequestContext context, const net::any_io_executor& executor, ResponseHandler handler) noexcept;
+
+        // Called by the session once the header of a request has been read, to decide how much of a body
+        // to accept and where to put it before reading the body. 'req' only has its header filled in.
+        struct RequestBodyLimits
+        {
+            std::uint64_t maxSize;
+            std::uint64_t maxInMemory;
+            const std::filesystem::path& spoolDirectory;
+        };
+        ND RequestBodyLimits GetRequestBodyLimits(const HTTPRequestType& req) const noexcept;
+
+        // Write out the part of a spooled request body that is waiting in memory (see RequestBody::FlushSpool)
+        // on the spool thread, so that the io thread never waits on the disk, and then call 'handler' on
+        // 'executor'. The body must be left alone until then.
+        using SpoolHandler = std::function<void(beast::error_code)>;
+        void FlushRequestBody(RequestBody& body, bool close, const net::any_io_executor& executor, SpoolHandler handler);
+
+        // The response to a request whose body was larger than GetRequestBodyLimits allowed
+        ND HTTPResponse HandleRequestBodyTooLarge(HTTPRequestType req) noexcept;
+
+        // The response to a request that could not be parsed. 'req' holds whatever was parsed before the error
+        ND HTTPResponse HandleMalformedRequest(HTTPRequestType req, std::string_view reason) noexcept;
+
+        // The response to a request whose body could not be stored (e.g. the spool file could not be written)
+        ND HTTPResponse HandleRequestBodyFailure(HTTPRequestType req) noexcept;
+
+        // The response to a request that was shed because too many requests are in flight (see AdmissionLimits).
+        // Made from the request's header alone, before any of its body is read, and always closes the connection
+        ND HTTPResponse HandleOverload(const HTTPRequestType& req) noexcept;
+
+        // Used by the listeners and sessions to stay within the AdmissionLimits
+        ND inline AdmissionControl& GetAdmissionControl() noexcept { return m_admission; }
+
+        // Called by the session once the header of a request has been read, before its body. Returns the
+        // response if a middleware stage answered the request from its header (see MiddlewarePipeline).
+        ND std::optional<HTTPResponse> CheckRequestHeader(HTTPRequestType& req, RequestContext& context) noexcept;
+
+        // Called by the session for every response it sends, just before it is queued for writing
+        inline void OnResponseReady(const RequestContext& context, HTTPResponse& response) noexcept
+        {
+            if (m_middleware != nullptr)
+            {
+                http::response_header<>& header = ResponseHeader(response);
+                m_middleware->After(context, header.result(), header);
+            }
+        }
 
         virtual void HandleWebsocketData(PlainWebsocketSession* session, std::string&& data) noexcept = 0;
         virtual void HandleWebsocketData(SSLWebsocketSession* session, std::string&& data) noexcept = 0;
@@ -44,47 +208,309 @@ namespace Clover
             if (!m_docRoot.ends_with('/'))
                 m_docRoot += '/';
         }
+        // The document root is indexed when Run() is called and then re-indexed periodically, on a thread of
+        // its own, so that changes to the document root are picked up. An interval of 0 disables re-indexing.
+        inline void SetDocumentIndexRefreshInterval(std::chrono::milliseconds interval) noexcept { m_documentIndexRefreshInterval = interval; }
+        inline void RefreshDocumentIndex() noexcept { m_documentIndex.Build(m_docRoot); }
+        // Keep every file in the document root open (see DocumentIndex::SetHoldFilesOpen). Linux only.
+        inline void SetHoldFilesOpen(bool hold) noexcept { m_documentIndex.SetHoldFilesOpen(hold); }
+
+        // Small static files are served from memory. 'capacity' bounds the total number of bytes held
+        // and files larger than 'maxFileSize' are always served from disk
+        inline void SetStaticAssetCacheLimits(std::uint64_t capacity, std::uint64_t maxFileSize) noexcept 
+        { 
+            m_staticAssetCache.SetCapacity(capacity); 
+            m_staticAssetCache.SetMaxFileSize(maxFileSize); 
+        }
+        ND inline const StaticAssetCache& GetStaticAssetCache() const noexcept { return m_staticAssetCache; }
+
+        // Rendered pages and error pages are gzip compressed when the client accepts it and the body is at
+        // least 'minSize' bytes. A level of 0 disables dynamic compression. Static files are never compressed
+        // on the fly (see the .br/.gz support in ServeFile).
+        inline void SetDynamicCompression(int level, std::size_t minSize = 1024) noexcept
+        {
+            m_compressionLevel = std::clamp(level, 0, 9);
+            m_compressionMinSize = minSize;
+        }
+
+        // Requests for multiple ranges of a file are answered with a multipart body that is assembled in
+        // memory. If the ranges add up to more than this, the whole file is sent instead.
+        inline void SetMaxMultipartRangeBytes(std::uint64_t bytes) noexcept { m_maxMultipartRangeBytes = bytes; }
+
+        // Request bodies larger than this are rejected, unless the target allows more (see TargetOptions::maxBodySize)
+        inline void SetMaxRequestBodySize(std::uint64_t bytes) noexcept { m_maxRequestBodySize = bytes; }
+
+        // Request bodies larger than 'memoryLimit' are written to a temporary file in 'directory' as they
+        // arrive instead of being held in memory. The writes happen on a thread of their own, so the io threads
+        // never wait on the disk. By default, the directory is the system's temporary directory.
+        inline void SetRequestBodySpooling(std::uint64_t memoryLimit, const std::filesystem::path& directory = {}) noexcept
+        {
+            m_requestBodyMemoryLimit = memoryLimit;
+            if (!directory.empty())
+                m_requestBodySpoolDirectory = directory;
+        }
+
+        // Every request goes through these stages before it is dispatched (see MiddlewarePipeline). The
+        // pipeline is composed at compile time, so it costs one indirect call per request no matter how
+        // many stages it has. The returned pipeline can be used to reach a stage later (see Get). Should only
+        // be called during setup, before Run(). Replaces any previous pipeline.
+        template<MiddlewareStage... Stages>
+        MiddlewarePipeline<Stages...>& UseMiddleware(Stages... stages)
+        {
+            auto pipeline = std::make_unique<MiddlewarePipeline<Stages...>>(std::move(stages)...);
+            MiddlewarePipeline<Stages...>& result = *pipeline;
+            m_middleware = std::move(pipeline);
+            return result;
+        }
+
+        // Number of threads in the compute pool, which is only started if a target is registered as cpuBound,
+        // with data providers, or with a page cache that serves stale pages (the refreshes run on the pool).
+        // 0 means half the hardware threads (at least 1).
+        inline void SetComputeThreads(unsigned int threads) noexcept { m_computeThreads = threads; }
+        ND inline const ComputePool& GetComputePool() const noexcept { return m_computePool; }
+
+        // Instead of every io thread sharing one io_context, give each thread its own io_context and its own
+        // SO_REUSEPORT listener (see IOShard). This removes the contention on the shared io_context's
+        // scheduler, which is what limits throughput on machines with many cores. Work that isn't tied to a
+        // connection (the signal handler) then runs on the thread that called Run(). Only supported on Linux. Should only be called during setup, before Run().
+        inline void SetIOSharding(bool enabled) noexcept
+        {
+#ifdef PLATFORM_LINUX
+            m_ioSharding = enabled;
+#else
+            if (enabled)
+                LOG_WARN("[CORE] SetIOSharding: Sharding requires SO_REUSEPORT, which is only supported on Linux. All io threads will share one io_context");
+#endif
+        }
+
+        // The counters of each shard. Empty unless the server is running sharded.
+        ND std::vector<IOShardStats> GetIOShardStats() const;
+
+        // The mechanism Asio uses to wait for I/O, which is fixed at build time (see the io-uring option in Build.lua)
+        //
+        // With io_uring, sockets, timers, and files all go through the ring, and each io_context batches its
+        // submissions. Registered buffers (net::register_buffers) are deliberately not used. All they save is
+        // pinning the buffer's pages for each operation, and only when the exact registered memory is passed
+        // to the read or write. Here, a session reads into its own growable beast::flat_buffer, so giving it
+        // a fixed registered slot would cap the size of a request header. Responses are written from buffers
+        // that belong to each response (the serializer's header, a cached page shared between connections),
+        // so writing from registered memory would first need a copy of each body, which costs more than the
+        // pinning. Static files don't need it either: plain sessions send them with sendfile(2), and TLS
+        // sessions have to encrypt them in user space anyway.
+        ND static constexpr std::string_view IOBackend() noexcept
+        {
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+            return "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+            return "epoll";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+            return "iocp";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+            return "kqueue";
+#else
+            return "select";
+#endif
+        }
+
+        // How connections to the endpoint given to the constructor are handled. By default each connection
+        // is inspected to tell TLS from plain HTTP (ListenerProtocol::Detect). Should only be called during
+        // setup, before Run().
+        inline void SetListenerOptions(const ListenerOptions& options) noexcept { m_listenerOptions = options; }
+
+        // Listen on another endpoint as well, e.g. plain HTTP on port 80 next to TLS on port 443, so that
+        // neither needs detection. Should only be called during setup, before Run().
+        void AddListener(std::string_view address, unsigned short port, const ListenerOptions& options);
+
+        // Cap the open connections (overall and per client address) and the requests in flight, so that the
+        // server sheds load instead of slowing down for everyone (see AdmissionLimits). Unlimited by default.
+        // Should only be called during setup, before Run().
+        inline void SetAdmissionLimits(const AdmissionLimits& limits) noexcept { m_admission.SetLimits(limits); }
+        // The current counts, including how many requests were shed and connections turned away so far
+        ND inline AdmissionStats GetAdmissionStats() const noexcept { return m_admission.GetStats(); }
+
+        // Pin the io, compute, and accept threads to CPUs, and keep io threads on their own NUMA node's
+        // memory (see ThreadPlacement). Should only be called during setup, before Run().
+        inline void SetThreadPlacement(const ThreadPlacement& placement) { m_threadPlacement = placement; }
+
         inline void SetBadRequestTarget(std::string_view target) noexcept 
         { 
             if (target.ends_with('/'))
                 LOG_ERROR("[CORE] SetBadRequestTarget failed. Bad Request target cannot end in '/': '{0}'", target);
             else
-                m_badRequestTarget = target;
+                m_badRequestPage.SetTarget(target);
         }
         inline void SetNotFoundTarget(std::string_view target) noexcept 
         {
             if (target.ends_with('/'))
                 LOG_ERROR("[CORE] SetNotFoundTarget failed. Not Found target cannot end in '/': '{0}'", target);
             else
-                m_notFoundTarget = target;
+                m_notFoundPage.SetTarget(target);
         }
         inline void SetInternalServerErrorTarget(std::string_view target) noexcept 
         { 
             if (target.ends_with('/'))
                 LOG_ERROR("[CORE] SetInternalServerErrorTarget failed. Internal Server Error target cannot end in '/': '{0}'", target);
             else
-                m_internalServerErrorTarget = target;
+                m_internalServerErrorPage.SetTarget(target);
+        }
+        inline void SetServiceUnavailableTarget(std::string_view target) noexcept
+        {
+            if (target.ends_with('/'))
+                LOG_ERROR("[CORE] SetServiceUnavailableTarget failed. Service Unavailable target cannot end in '/': '{0}'", target);
+            else
+                m_serviceUnavailablePage.SetTarget(target);
+        }
+        inline void SetPayloadTooLargeTarget(std::string_view target) noexcept
+        {
+            if (target.ends_with('/'))
+                LOG_ERROR("[CORE] SetPayloadTooLargeTarget failed. Payload Too Large target cannot end in '/': '{0}'", target);
+            else
+                m_payloadTooLargePage.SetTarget(target);
+        }
+        inline void SetMethodNotAllowedTarget(std::string_view target) noexcept
+        {
+            if (target.ends_with('/'))
+                LOG_ERROR("[CORE] SetMethodNotAllowedTarget failed. Method Not Allowed target cannot end in '/': '{0}'", target);
+            else
+                m_methodNotAllowedPage.SetTarget(target);
         }
 
-        void RegisterGETTarget(const std::string& target, DataGatherFn dataGatherFn) noexcept;
-        void RegisterPUTTarget(const std::string& target, DataGatherFn dataGatherFn) noexcept;
-        void RegisterPOSTTarget(const std::string& target, DataGatherFn dataGatherFn) noexcept;
+        // Templates are parsed once and then cached. The cache will notice when a template file is
+        // modified, but ReloadTemplates() can be used to force all templates to be re-parsed
+        inline void ReloadTemplates() noexcept { m_templateCache.Reload(); }
+        inline void SetTemplateCheckInterval(std::chrono::milliseconds interval) noexcept { m_templateCache.SetCheckInterval(interval); }
+
+        // Cached pages are rebuilt once their ttl expires, but they can also be dropped explicitly
+        inline void InvalidateCachedPages() noexcept { m_pageCache.Clear(); }
+        inline void SetPageCacheMaxEntries(std::size_t maxEntries) noexcept { m_pageCache.SetMaxEntries(maxEntries); }
+
+        // Targets are patterns that may contain parameters and a trailing wildcard, for example
+        // '/user/{id}' or '/docs/*path' (see Router). The captured values are passed to the data
+        // gathering function along with the query parameters. Should only be called during setup, before Run().
+        void RegisterGETTarget(const std::string& target, DataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+        void RegisterPUTTarget(const std::string& target, DataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+        void RegisterPOSTTarget(const std::string& target, DataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+        void RegisterGETTarget(const std::string& target, ContextDataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+        void RegisterPUTTarget(const std::string& target, ContextDataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+        void RegisterPOSTTarget(const std::string& target, ContextDataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+
+        // PUT and POST targets can also receive the request body (see BodyDataGatherFn). The result is
+        // rendered with the target's page if there is one, and otherwise sent back as JSON.
+        void RegisterPUTTarget(const std::string& target, BodyDataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+        void RegisterPOSTTarget(const std::string& target, BodyDataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+
+        // Same as RegisterGETTarget, but the data is gathered by a coroutine (see AsyncDataGatherFn).
+        // Page caching is not supported for these targets, so options.cache is ignored.
+        void RegisterAsyncGETTarget(const std::string& target, AsyncDataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+        void RegisterAsyncGETTarget(const std::string& target, AsyncContextDataGatherFn dataGatherFn, const TargetOptions& options = {}) noexcept;
+
+        // Same as RegisterGETTarget, but the data comes from several providers that run concurrently (see
+        // DataProvider), so the page takes as long as the slowest provider instead of the sum of them all.
+        // Page caching is not supported for these targets, so options.cache is ignored.
+        void RegisterGETTarget(const std::string& target, std::vector<DataProvider> providers, const TargetOptions& options = {}) noexcept;
 
     private:
         void LoadServerCertificate(const std::string& cert, const std::string& key, const std::string& dh);
-        ND std::pair<std::string_view, ParametersMap> ParseTarget(std::string_view target) const noexcept;
-        ND json GatherRequestData(std::string_view target, const ParametersMap& urlParams) const;
-        ND http::message_generator GenerateHTMLResponse(std::string_view target, const ParametersMap& urlParams, HTTPRequestType& req);
-        ND http::message_generator GenerateRedirectResponse(std::string_view target, HTTPRequestType& req);
-        ND http::message_generator ServeFile(std::string_view target, HTTPRequestType& req);
+        ND std::string_view ParseTarget(std::string_view target, ParametersMap& parameters) const noexcept;
+        struct Target
+        {
+            // Functions registered without a context are wrapped so that there is only one way to call them
+            ContextDataGatherFn dataGatherFn;
+            AsyncContextDataGatherFn asyncDataGatherFn;
+            BodyDataGatherFn bodyDataGatherFn;
+            std::vector<DataProvider> providers;
+            TargetOptions options;
+
+            // Asynchronous targets are handled by a coroutine (see HandleAsyncHTTPGETRequest)
+            ND inline bool IsAsync() const noexcept { return asyncDataGatherFn || !providers.empty(); }
+            ND inline bool IsJSON() const noexcept { return options.format == ResponseFormat::JSON; }
+        };
 
-        ND http::message_generator HandleHTTPGETRequest(HTTPRequestType& req);
-        ND http::message_generator HandleHTTPPUTRequest(HTTPRequestType& req);
-        ND http::message_generator HandleHTTPPOSTRequest(HTTPRequestType& req);
+        // The registered target (if any) and the file to render for an HTML request. JSON targets have no file.
+        struct ResolvedPage
+        {
+            const Target* registeredTarget = nullptr;
+            std::string_view page;
+            std::shared_ptr<const FileInfo> fileInfo;
+
+            // True if a target is registered for the path, even if not for the method
+            bool pathMatched = false;
+        };
+
+        void RegisterTarget(http::verb method, const std::string& target, Target registeredTarget) noexcept;
+        ND const Target* FindDeferredTarget(const HTTPRequestType& req) const noexcept;
+        void HandleCPUBoundHTTPRequest(HTTPRequestType req, RequestContext context, ComputePriority priority, const net::any_io_executor& executor, ResponseHandler handler);
+        net::awaitable<void> HandleAsyncHTTPGETRequest(HTTPRequestType req, RequestContext context, ResponseHandler handler);
+        net::awaitable<json> GatherProviderData(std::string_view target, const Target& registeredTarget, const ParametersMap& urlParams, const RequestContext& context);
+        ND json GatherRequestData(std::string_view target, const Target* registeredTarget, const ParametersMap& urlParams, const RequestContext& context) const;
+        ND ResolvedPage ResolveHTMLTarget(std::string_view target, ParametersMap& urlParams, http::verb method = http::verb::get) const;
+        ND HTTPResponse GenerateHTMLResponse(std::string_view target, ParametersMap& urlParams, HTTPRequestType& req, RequestContext& context);
+        ND HTTPResponse RenderHTMLResponse(std::string_view target, const FileInfo& fileInfo, const json& data, HTTPRequestType& req,
+                                                      const Target* registeredTarget, const ParametersMap& urlParams);
+        ND HTTPResponse RenderJSONResponse(std::string_view target, const json& data, HTTPRequestType& req,
+                                                      const Target& registeredTarget, const ParametersMap& urlParams);
+        ND HTTPResponse GenerateDeadlineResponse(std::string_view target, const Target& registeredTarget, const ParametersMap& urlParams,
+                                                            HTTPRequestType& req, const RequestContext& context);
+        ND HTTPResponse GenerateCachedPageResponse(const CachedPage& cachedPage, HTTPRequestType& req);
+        ND HTTPResponse GenerateCachedHTMLResponse(std::string_view target, const Target& registeredTarget, std::string_view page, 
+                                                              const ParametersMap& urlParams, HTTPRequestType& req);
+        void HandleCachedHTTPRequest(HTTPRequestType req, RequestContext context, const net::any_io_executor& executor, ResponseHandler handler);
+        ND PageCache::BuildFn MakePageBuildFn(std::string_view target, const Target& registeredTarget, std::string_view page, const ParametersMap& urlParams);
+        ND HTTPResponse GenerateBuiltPageResponse(std::string_view target, const std::shared_ptr<const CachedPage>& cachedPage,
+                                                             std::exception_ptr error, HTTPRequestType& req);
+        ND HTTPResponse GenerateRedirectResponse(std::string_view target, HTTPRequestType& req);
+        ND HTTPResponse GenerateNotModifiedResponse(std::string_view etag, std::string_view lastModifiedDate, HTTPRequestType& req, std::string_view vary = {});
+        ND HTTPResponse ServeFile(std::string_view target, HTTPRequestType& req);
+        ND HTTPResponse GenerateRangeNotSatisfiableResponse(std::uint64_t size, HTTPRequestType& req);
+        ND bool AcceptsGzip(const HTTPRequestType& req) const noexcept;
+        void CompressResponse(http::response<http::string_body>& res, const HTTPRequestType& req) const;
+
+        // How a static file is being sent. When a precompressed copy is served, the FileInfo is the one
+        // for the copy, but the content type is still that of the original file.
+        struct FileRepresentation
+        {
+            std::string_view mimeType;
+            ContentCoding coding = ContentCoding::Identity;
+            bool varies = false;    // True if the response depends on Accept-Encoding
+        };
+
+        // Headers that every successful static file response carries
+        template<typename Body>
+        void SetFileHeaders(http::response<Body>& res, const FileInfo& info, const FileRepresentation& representation) const
+        {
+            res.set(http::field::server, m_serverVersion);
+            res.set(http::field::content_type, representation.mimeType);
+            res.set(http::field::etag, info.etag);
+            res.set(http::field::last_modified, info.lastModifiedDate);
+            res.set(http::field::accept_ranges, "bytes");
+            if (representation.coding != ContentCoding::Identity)
+                res.set(http::field::content_encoding, ContentCodingName(representation.coding));
+            if (representation.varies)
+                res.set(http::field::vary, "Accept-Encoding");
+        }
 
-        ND http::message_generator BadRequest(std::string_view reason, HTTPRequestType& req);
-        ND http::message_generator FileNotFound(std::string_view target, HTTPRequestType& req);
-        ND http::message_generator InternalServerError(std::string_view reason, HTTPRequestType& req);
+        ND HTTPResponse HandleHTTPGETRequest(HTTPRequestType& req, RequestContext& context);
+        ND HTTPResponse HandleHTTPBodyRequest(HTTPRequestType& req, RequestContext& context);
+
+        ND HTTPResponse BadRequest(std::string_view reason, HTTPRequestType& req);
+        ND HTTPResponse FileNotFound(std::string_view target, HTTPRequestType& req);
+        ND HTTPResponse InternalServerError(std::string_view reason, HTTPRequestType& req);
+        ND HTTPResponse ServiceUnavailable(std::string_view reason, HTTPRequestType& req);
+        ND HTTPResponse PayloadTooLarge(HTTPRequestType& req);
+        ND HTTPResponse MethodNotAllowed(std::string_view target, std::string_view allow, HTTPRequestType& req);
+        ND std::string AllowedMethods(std::string_view target) const;
+        ND HTTPResponse GenerateErrorResponse(ErrorPage& page, std::string_view reason, HTTPRequestType& req);
+
+        // True if the target should be rendered as a page rather than served as a file. A registered GET
+        // target always is, so that a parameter can capture a value with a '.' in it ('/user/{name}' with
+        // 'john.doe'). Only a target that no route matches is judged by its extension (see IsTargetHTML).
+        ND bool IsPageTarget(std::string_view target) const noexcept
+        {
+            std::string_view routePath = target;
+            if (routePath.ends_with(".html"))
+                routePath.remove_suffix(5);
+            return m_router.Find(http::verb::get, routePath).value != nullptr || IsTargetHTML(target);
+        }
 
         ND constexpr bool IsTargetHTML(std::string_view target) const noexcept
         {
@@ -102,62 +528,54 @@ namespace Clover
             pos = file.rfind('.');
             return pos == std::string::npos ? true : file.substr(pos).compare(".html") == 0;
         }
-        ND constexpr std::string_view MimeType(std::string_view path) const noexcept
-        {
-            if (path.ends_with(".htm"))  return "text/html";
-            if (path.ends_with(".html")) return "text/html";
-            if (path.ends_with(".php"))  return "text/html";
-            if (path.ends_with(".css"))  return "text/css";
-            if (path.ends_with(".txt"))  return "text/plain";
-            if (path.ends_with(".js"))   return "application/javascript";
-            if (path.ends_with(".json")) return "application/json";
-            if (path.ends_with(".xml"))  return "application/xml";
-            if (path.ends_with(".swf"))  return "application/x-shockwave-flash";
-            if (path.ends_with(".flv"))  return "video/x-flv";
-            if (path.ends_with(".png"))  return "image/png";
-            if (path.ends_with(".jpe"))  return "image/jpeg";
-            if (path.ends_with(".jpeg")) return "image/jpeg";
-            if (path.ends_with(".jpg"))  return "image/jpeg";
-            if (path.ends_with(".gif"))  return "image/gif";
-            if (path.ends_with(".bmp"))  return "image/bmp";
-            if (path.ends_with(".ico"))  return "image/vnd.microsoft.icon";
-            if (path.ends_with(".tiff")) return "image/tiff";
-            if (path.ends_with(".tif"))  return "image/tiff";
-            if (path.ends_with(".svg"))  return "image/svg+xml";
-            if (path.ends_with(".svgz")) return "image/svg+xml";
-            return "application/text";
-        }
 
+        void RunShared();
+        void RunSharded();
+
+        // The endpoint given to the constructor, followed by any added with AddListener
+        ND std::vector<ListenerEndpoint> Listeners() const;
+
+        // Declared before the io_contexts so that it outlives the sessions, which give their slots back when destroyed
+        AdmissionControl m_admission;
         net::io_context m_ioc;
         unsigned int m_threads;
+        tcp::endpoint m_endpoint;
+        ListenerOptions m_listenerOptions;
+        std::vector<ListenerEndpoint> m_additionalListeners;
+        bool m_ioSharding = false;
+        std::vector<std::unique_ptr<IOShard>> m_shards;
+        ThreadPlacement m_threadPlacement;
+        ThreadPlan m_threadPlan;
         ssl::context m_ctx;
         inja::Environment m_injaEnv;
+        TemplateCache m_templateCache;
+        ComputePool m_computePool;
+        PageCache m_pageCache;
+        DocumentIndex m_documentIndex;
+        StaticAssetCache m_staticAssetCache;
+        ErrorPage m_badRequestPage{ http::status::bad_request };
+        ErrorPage m_notFoundPage{ http::status::not_found };
+        ErrorPage m_internalServerErrorPage{ http::status::internal_server_error };
+        ErrorPage m_serviceUnavailablePage{ http::status::service_unavailable };
+        ErrorPage m_payloadTooLargePage{ http::status::payload_too_large };
+        ErrorPage m_methodNotAllowedPage{ http::status::method_not_allowed };
+        std::chrono::milliseconds m_documentIndexRefreshInterval{ 2000 };
+        std::uint64_t m_maxMultipartRangeBytes = 4 * 1024 * 1024;
+        std::uint64_t m_maxRequestBodySize = 10000;
+        std::uint64_t m_requestBodyMemoryLimit = 64 * 1024;
+        std::filesystem::path m_requestBodySpoolDirectory;
+        std::optional<net::thread_pool> m_spoolPool;
+        int m_compressionLevel = 6;
+        std::size_t m_compressionMinSize = 1024;
+        std::unique_ptr<MiddlewareChain> m_middleware;
+        unsigned int m_computeThreads = 0;
+        bool m_needsComputePool = false;
         
 
         std::string m_serverVersion = "Clover";
         std::string m_docRoot = "Source/front-end";
-        std::string m_badRequestTarget = "";
-        std::string m_notFoundTarget = "";
-        std::string m_internalServerErrorTarget = "";
-
-        // string_hash is used that that we can do a lookup using a string_view even though
-        // the keys are strings. See: https://www.cppstories.com/2021/heterogeneous-access-cpp20/
-        struct string_hash {
-            using is_transparent = void;
-            [[nodiscard]] size_t operator()(const char* txt) const {
-                return std::hash<std::string_view>{}(txt);
-            }
-            [[nodiscard]] size_t operator()(std::string_view txt) const {
-                return std::hash<std::string_view>{}(txt);
-            }
-            [[nodiscard]] size_t operator()(const std::string& txt) const {
-                return std::hash<std::string>{}(txt);
-            }
-        };
 
-        std::unordered_map<std::string, DataGatherFn, string_hash, std::equal_to<>> m_GETTargets;
-        std::unordered_map<std::string, DataGatherFn, string_hash, std::equal_to<>> m_PUTTargets;
-        std::unordered_map<std::string, DataGatherFn, string_hash, std::equal_to<>> m_POSTTargets;
+        Router<Target> m_router;
     };
 
     // To be defined in client
@@ -170,8 +588,9 @@ namespace Clover
     class WebsocketSession
     {
     public:
-        WebsocketSession(Application* application) noexcept :
-            m_application(application)
+        WebsocketSession(Application* application, AdmissionControl::ConnectionSlot connection) noexcept :
+            m_application(application),
+            m_connection(std::move(connection))
         {}
 
         // Start the asynchronous operation
@@ -402,6 +821,9 @@ namespace Clover
         beast::flat_buffer m_buffer;
         Application* m_application;
         std::vector<std::shared_ptr<std::string const>> m_queue;
+
+        // Carried over from the HTTP session, so an upgraded connection still counts against the limits
+        AdmissionControl::ConnectionSlot m_connection;
     };
 
     // Handles a plain WebSocket connection
@@ -409,8 +831,8 @@ namespace Clover
     {
     public:
         // Create the session
-        explicit PlainWebsocketSession(beast::tcp_stream&& stream, Application* application) :
-            WebsocketSession<PlainWebsocketSession>(application),
+        explicit PlainWebsocketSession(beast::tcp_stream&& stream, Application* application, AdmissionControl::ConnectionSlot connection) :
+            WebsocketSession<PlainWebsocketSession>(application, std::move(connection)),
             m_ws(std::move(stream))
         {}
         inline ~PlainWebsocketSession()
@@ -446,8 +868,8 @@ namespace Clover
     {
     public:
         // Create the SSLWebsocketSession
-        explicit SSLWebsocketSession(ssl::stream<beast::tcp_stream>&& stream, Application* application) :
-            WebsocketSession<SSLWebsocketSession>(application),
+        explicit SSLWebsocketSession(ssl::stream<beast::tcp_stream>&& stream, Application* application, AdmissionControl::ConnectionSlot connection) :
+            WebsocketSession<SSLWebsocketSession>(application, std::move(connection)),
             m_ws(std::move(stream))
         {}
         ~SSLWebsocketSession()
@@ -479,14 +901,14 @@ namespace Clover
     };
 
     template<class Body, class Allocator>
-    void MakeWebsocketSession(beast::tcp_stream stream, http::request<Body, http::basic_fields<Allocator>> req, Application* application)
+    void MakeWebsocketSession(beast::tcp_stream stream, http::request<Body, http::basic_fields<Allocator>> req, Application* application, AdmissionControl::ConnectionSlot connection)
     {
-        std::make_shared<PlainWebsocketSession>(std::move(stream), application)->Run(std::move(req));
+        std::make_shared<PlainWebsocketSession>(std::move(stream), application, std::move(connection))->Run(std::move(req));
     }
     template<class Body, class Allocator>
-    void MakeWebsocketSession(ssl::stream<beast::tcp_stream> stream, http::request<Body, http::basic_fields<Allocator>> req, Application* application)
+    void MakeWebsocketSession(ssl::stream<beast::tcp_stream> stream, http::request<Body, http::basic_fields<Allocator>> req, Application* application, AdmissionControl::ConnectionSlot connection)
     {
-        std::make_shared<SSLWebsocketSession>(std::move(stream), application)->Run(std::move(req));
+        std::make_shared<SSLWebsocketSession>(std::move(stream), application, std::move(connection))->Run(std::move(req));
     }
 
     // Handles an HTTP server connection.
@@ -497,8 +919,9 @@ namespace Clover
     {
     public:
         // Construct the session
-        HTTPSession(beast::flat_buffer buffer, Application* application) noexcept :
+        HTTPSession(beast::flat_buffer buffer, Application* application, AdmissionControl::ConnectionSlot connection) noexcept :
             m_application(application),
+            m_connection(std::move(connection)),
             m_buffer(std::move(buffer)),
             m_port(0)
         {
@@ -516,23 +939,144 @@ namespace Clover
             // Construct a new parser for each message
             m_parser.emplace();
 
-            // Apply a reasonable limit to the allowed size
-            // of the body in bytes to prevent abuse.
-            m_parser->body_limit(10000);
+            // The body limit depends on the target, which isn't known until the header has been read (see
+            // OnReadHeader). Until then, don't let Beast reject the request based on its Content-Length.
+            m_parser->body_limit(std::numeric_limits<std::uint64_t>::max());
 
             // Set the timeout.
             beast::get_lowest_layer(GetDerived().Stream()).expires_after(std::chrono::seconds(30));
 
-            // Read a request using the parser-oriented interface
-            http::async_read(
+            // Read the header first, so we know where the body should go
+            http::async_read_header(
+                GetDerived().Stream(),
+                m_buffer,
+                *m_parser,
+                beast::bind_front_handler(
+                    &HTTPSession::OnReadHeader,
+                    GetDerived().shared_from_this()));
+        }
+
+        void OnReadHeader(beast::error_code ec, std::size_t bytes_transferred) noexcept
+        {
+            if (ec)
+                return OnRead(ec, bytes_transferred);
+
+            try
+            {
+                // A request over the in-flight limit is shed before any of its body is read or any middleware
+                // runs, so shedding stays cheap. The slot is held until the response is queued (see QueueWrite).
+                // Websocket upgrades are not requests in flight, so they don't take a slot
+                m_context.emplace();
+                if (!websocket::is_upgrade(m_parser->get()))
+                {
+                    m_requestSlot = m_application->GetAdmissionControl().TryBeginRequest();
+                    if (!m_requestSlot)
+                        return RejectHeader(m_application->HandleOverload(m_parser->get()));
+                }
+
+                // Middleware gets to turn the request away before any of its body is read
+                if (std::optional<HTTPResponse> response = m_application->CheckRequestHeader(m_parser->get(), *m_context))
+                    return RejectHeader(std::move(*response));
+
+                // Bodiless requests and websocket upgrades are handled the same as before
+                if (m_parser->is_done() || websocket::is_upgrade(m_parser->get()))
+                    return OnRead(ec, bytes_transferred);
+
+                // A body that is too large is rejected before any of it is read
+                Application::RequestBodyLimits limits = m_application->GetRequestBodyLimits(m_parser->get());
+                boost::optional<std::uint64_t> contentLength = m_parser->content_length();
+                if (contentLength.has_value() && *contentLength > limits.maxSize)
+                    return OnRead(http::error::body_limit, bytes_transferred);
+
+                // For a chunked body, Beast enforces the limit as the chunks arrive
+                m_parser->body_limit(limits.maxSize);
+                m_parser->get().body().SpoolTo(limits.spoolDirectory, limits.maxInMemory);
+
+                ReadBody();
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::OnReadHeader failure. Caught std::exception: \n'{0}'", e.what());
+                Reject(m_application->HandleRequestBodyFailure(m_parser->release()));
+            }
+        }
+
+        // The body is read a piece at a time rather than with a single read, so that the timeout applies to
+        // each piece (a large upload on a slow link may take longer than the timeout in total, but should
+        // never stall) and so that a spooled body can be written out as it arrives
+        void ReadBody()
+        {
+            beast::get_lowest_layer(GetDerived().Stream()).expires_after(std::chrono::seconds(30));
+
+            http::async_read_some(
                 GetDerived().Stream(),
                 m_buffer,
                 *m_parser,
                 beast::bind_front_handler(
-                    &HTTPSession::OnRead,
+                    &HTTPSession::OnReadBody,
                     GetDerived().shared_from_this()));
         }
 
+        void OnReadBody(beast::error_code ec, std::size_t bytes_transferred) noexcept
+        {
+            if (ec)
+                return OnRead(ec, bytes_transferred);
+
+            // Need a try-catch here so an exception doesn't escape and cause a crash
+            try
+            {
+                // Writing to the spool file could block on the disk, so it is done on the spool thread. Reading
+                // waits for it, which also bounds how much of a spooled body is held in memory at once
+                const RequestBody& body = m_parser->get().body();
+                const bool done = m_parser->is_done();
+                if (body.IsSpooled() && (done || body.PendingSpool() >= m_spoolFlushSize))
+                    return FlushBody(done);
+
+                if (done)
+                    return OnRead(ec, bytes_transferred);
+
+                ReadBody();
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::OnReadBody failure. Caught std::exception: \n'{0}'", e.what());
+            }
+        }
+
+        void FlushBody(bool done)
+        {
+            m_application->FlushRequestBody(
+                m_parser->get().body(),
+                done,
+                GetDerived().Stream().get_executor(),
+                [self = GetDerived().shared_from_this(), done](beast::error_code ec)
+                {
+                    self->OnBodyFlushed(done, ec);
+                });
+        }
+
+        void OnBodyFlushed(bool done, beast::error_code ec) noexcept
+        {
+            // Need a try-catch here so an exception doesn't escape and cause a crash
+            try
+            {
+                if (ec)
+                {
+                    LOG_ERROR("[CORE] Failed to store the request body from {0}:{1} for '{2}': '{3}'", m_address, m_port, std::string_view(m_parser->get().target()), ec.message());
+                    return Reject(m_application->HandleRequestBodyFailure(m_parser->release()));
+                }
+
+                if (done)
+                    return OnRead(ec, 0);
+
+                ReadBody();
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::OnBodyFlushed failure. Caught std::exception: \n'{0}'", e.what());
+            }
+        }
+
         void OnRead(beast::error_code ec, std::size_t bytes_transferred) noexcept
         {
             PROFILE_BEGIN_SESSION(
@@ -568,6 +1112,21 @@ namespace Clover
                         if (ec == beast::error::timeout)
                             return;
 
+                        // The body was larger than the target allows. Answer with 413 and then close the connection
+                        if (ec == http::error::body_limit)
+                        {
+                            LOG_WARN("[CORE] Request body from {0}:{1} for '{2}' exceeded the limit", m_address, m_port, std::string_view(m_parser->get().target()));
+                            return Reject(m_application->HandleRequestBodyTooLarge(m_parser->release()));
+                        }
+
+                        // The request is malformed. Say so instead of just dropping the connection (a partial message
+                        // means the client closed the connection partway through, so there is no one to tell)
+                        if (ec.category() == beast::error_code(http::error::bad_method).category() && ec != http::error::partial_message)
+                        {
+                            LOG_WARN("[CORE] Malformed request from {0}:{1}: '{2}'", m_address, m_port, ec.message());
+                            return Reject(m_application->HandleMalformedRequest(m_parser->release(), ec.message()));
+                        }
+
                         LOG_ERROR("[CORE] Received HTTPSession::OnRead error: '{0}'", ec.what());
                         return;
                     }
@@ -584,7 +1143,8 @@ namespace Clover
                         return MakeWebsocketSession(
                             GetDerived().ReleaseStream(),
                             m_parser->release(),
-                            m_application);
+                            m_application,
+                            std::move(m_connection));
                     }
 
                     target = (std::string)m_parser->get().target();
@@ -596,8 +1156,32 @@ namespace Clover
                     //        LOG_TRACE("\t{0}: {1}", (std::string)itr->name_string(), (std::string)itr->value());
                     //    LOG_TRACE("\tBody      : {0}\n", (std::string)m_parser->get().body());
 
-                    // Send the response
-                    QueueWrite(m_application->HandleHTTPRequest(m_parser->release()));
+                    // Send the response. Most requests are answered before HandleHTTPRequest returns, but a target
+                    // with an asynchronous data gathering function answers later, from a coroutine on our strand.
+                    // The request already holds its admission slot (see OnReadHeader).
+                    m_awaitingResponse = true;
+                    m_dispatching = true;
+
+                    // The context was made when the header arrived (see OnReadHeader), but the time the client
+                    // took to send the body should not count against the target's deadline
+                    if (!m_context.has_value())
+                        m_context.emplace();
+                    m_context->MarkReceived();
+
+                    m_application->HandleHTTPRequest(
+                        m_parser->release(),
+                        *m_context,
+                        GetDerived().Stream().get_executor(),
+                        [self = GetDerived().shared_from_this()](HTTPResponse response)
+                        {
+                            self->OnResponse(std::move(response));
+                        });
+                    m_dispatching = false;
+
+                    // While the response is being produced elsewhere, nothing is reading from the socket, so
+                    // watch it ourselves in case the client gives up and the work can be abandoned
+                    if (m_awaitingResponse && !m_watchingDisconnect)
+                        WatchForDisconnect();
                 }
                 catch (const boost::exception& e)
                 {
@@ -613,8 +1197,9 @@ namespace Clover
                     LOG_ERROR("[CORE] HTTPSession::OnRead failure. Caught unknown exception.");
                 }
 
-                // If we aren't at the queue limit, try to pipeline another request
-                if (m_response_queue.size() < m_queue_limit)
+                // If we aren't at the queue limit, try to pipeline another request. While a response is still
+                // being produced, reading is paused so that responses are queued in the order of the requests
+                if (!m_awaitingResponse && m_response_queue.size() < m_queue_limit)
                     DoRead();
             }
 
@@ -626,8 +1211,115 @@ namespace Clover
             PROFILE_END_SESSION();
         }
 
-        void QueueWrite(http::message_generator response)
+        void OnResponse(HTTPResponse response) noexcept
+        {
+            try
+            {
+                m_awaitingResponse = false;
+                QueueWrite(std::move(response));
+
+                // If the response was produced asynchronously, OnRead has already returned without reading
+                // another request, so resume reading here (unless the queue is full, see OnWrite)
+                if (!m_dispatching && m_response_queue.size() < m_queue_limit)
+                    DoRead();
+            }
+            catch (const boost::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::OnResponse failure. Caught boost::exception: \n'{0}'",
+                    boost::diagnostic_information(e));
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::OnResponse failure. Caught std::exception: \n'{0}'", e.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR("[CORE] HTTPSession::OnResponse failure. Caught unknown exception.");
+            }
+        }
+
+        // Wait for the socket to become readable while a response is pending. If the client has closed
+        // the connection, the pending request is cancelled. For TLS sessions this only sees the TCP
+        // connection, so a client that sends close_notify first is treated the same as one that has
+        // pipelined another request: we stop watching and the response is produced as usual.
+        void WatchForDisconnect()
+        {
+            m_watchingDisconnect = true;
+            beast::get_lowest_layer(GetDerived().Stream()).socket().async_wait(
+                tcp::socket::wait_read,
+                beast::bind_front_handler(
+                    &HTTPSession::OnDisconnectWait,
+                    GetDerived().shared_from_this()));
+        }
+
+        void OnDisconnectWait(beast::error_code ec) noexcept
+        {
+            m_watchingDisconnect = false;
+
+            // The response may have been sent (and another request read) while we were waiting
+            if (!m_awaitingResponse || !m_context.has_value())
+                return;
+
+            if (!ec)
+            {
+                // Peek so that a pipelined request is left in the socket for the next read
+                auto& socket = beast::get_lowest_layer(GetDerived().Stream()).socket();
+                char byte = 0;
+                socket.non_blocking(true, ec);
+                std::size_t n = ec ? 0 : socket.receive(net::buffer(&byte, 1), tcp::socket::message_peek, ec);
+                beast::error_code ignored;
+                socket.non_blocking(false, ignored);
+
+                if (ec == net::error::would_block)
+                    return WatchForDisconnect();
+
+                // The client sent more data, so it is still there
+                if (!ec && n > 0)
+                    return;
+            }
+
+            if (ec == net::error::operation_aborted)
+                return;
+
+            LOG_INFO("[CORE] Client {0}:{1} disconnected before the response was ready", m_address, m_port);
+            m_context->Cancel(RequestContext::CancelReason::ClientDisconnected);
+        }
+
+        // Answer a request whose body has not been read (or not all of it). The response must close the
+        // connection, which is done with a lingering close (see DoLinger)
+        void Reject(HTTPResponse response)
+        {
+            m_lingerOnClose = true;
+            QueueWrite(std::move(response));
+        }
+
+        // Answer a request from its header alone. If it has a body, the body is never read, so the connection
+        // is closed after the response. Otherwise the connection can go on to the next request.
+        void RejectHeader(HTTPResponse response)
+        {
+            if (!m_parser->is_done())
+            {
+                std::visit([](auto& res) { res.keep_alive(false); }, response);
+                return Reject(std::move(response));
+            }
+
+            const bool keepAlive = std::visit([](const auto& res) { return res.keep_alive(); }, response);
+            QueueWrite(std::move(response));
+            if (keepAlive && m_response_queue.size() < m_queue_limit)
+                DoRead();
+        }
+
+        void QueueWrite(HTTPResponse response)
         {
+            // Every response goes through here, including the ones the session answers with on its own (see
+            // Reject and HandleOverload), so this is where the middleware sees them. The request is answered,
+            // so it no longer counts as in flight
+            m_requestSlot.Release();
+            if (!m_context.has_value())
+                m_context.emplace();
+            m_application->OnResponseReady(*m_context, response);
+            m_context.reset();
+
             // Allocate and store the work
             m_response_queue.push(std::move(response));
 
@@ -642,11 +1334,26 @@ namespace Clover
         {
             if (!m_response_queue.empty())
             {
-                bool keep_alive = m_response_queue.front().keep_alive();
+                HTTPResponse& response = m_response_queue.front();
+
+#ifdef PLATFORM_LINUX
+                // Plain TCP sessions can hand a static file straight to the kernel. Otherwise, the body is read
+                // and written in chunks by Beast, just like any other response
+                if constexpr (Derived::SupportsSendfile)
+                {
+                    if (std::holds_alternative<StaticFileResponse>(response))
+                        return DoSendfile();
+                }
+#endif
+
+                bool keep_alive = std::visit([](const auto& res) { return res.keep_alive(); }, response);
+                http::message_generator generator = std::visit(
+                    [](auto& res) { return http::message_generator(std::move(res)); },
+                    response);
 
                 beast::async_write(
                     GetDerived().Stream(),
-                    std::move(m_response_queue.front()),
+                    std::move(generator),
                     beast::bind_front_handler(
                         &HTTPSession::OnWrite,
                         GetDerived().shared_from_this(),
@@ -654,6 +1361,164 @@ namespace Clover
             }
         }
 
+#ifdef PLATFORM_LINUX
+        // Write the header of the StaticFileResponse at the front of the queue the normal way, and
+        // then send the body with sendfile(2)
+        void DoSendfile()
+        {
+            StaticFileResponse& res = std::get<StaticFileResponse>(m_response_queue.front());
+
+            m_sendfileOffset = res.body().offset;
+            m_sendfileRemain = res.body().length;
+            m_sendfileTimedOut = false;
+            m_sendfileSerializer.emplace(res);
+
+            http::async_write_header(
+                GetDerived().Stream(),
+                *m_sendfileSerializer,
+                beast::bind_front_handler(
+                    &HTTPSession::OnSendfileHeader,
+                    GetDerived().shared_from_this()));
+        }
+
+        void OnSendfileHeader(beast::error_code ec, std::size_t bytes_transferred) noexcept
+        {
+            boost::ignore_unused(bytes_transferred);
+
+            if (ec)
+            {
+                m_sendfileSerializer.reset();
+                return OnWrite(false, ec, 0);
+            }
+
+            SendfileSome();
+        }
+
+        // Call sendfile until the body has been sent or the socket's send buffer is full, in which case
+        // we wait for the socket to become writable again. To be fair to the other connections on this
+        // thread, at most m_sendfileChunk bytes are sent before yielding back to the io_context.
+        void SendfileSome() noexcept
+        {
+            // Need a try-catch here so an exception doesn't escape and cause a crash
+            try
+            {
+                StaticFileResponse& res = std::get<StaticFileResponse>(m_response_queue.front());
+                tcp::socket& socket = beast::get_lowest_layer(GetDerived().Stream()).socket();
+
+                beast::error_code ec;
+                socket.native_non_blocking(true, ec);
+                if (ec)
+                {
+                    m_sendfileSerializer.reset();
+                    return OnWrite(false, ec, 0);
+                }
+
+                std::uint64_t sent = 0;
+                while (m_sendfileRemain > 0)
+                {
+                    if (sent >= m_sendfileChunk)
+                    {
+                        net::post(
+                            GetDerived().Stream().get_executor(),
+                            beast::bind_front_handler(
+                                &HTTPSession::SendfileSome,
+                                GetDerived().shared_from_this()));
+                        return;
+                    }
+
+                    off_t offset = static_cast<off_t>(m_sendfileOffset);
+                    std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(m_sendfileRemain, m_sendfileChunk));
+                    ssize_t bytes = ::sendfile(socket.native_handle(), res.body().NativeHandle(), &offset, count);
+
+                    if (bytes > 0)
+                    {
+                        m_sendfileOffset += static_cast<std::uint64_t>(bytes);
+                        m_sendfileRemain -= static_cast<std::uint64_t>(bytes);
+                        sent += static_cast<std::uint64_t>(bytes);
+                        continue;
+                    }
+
+                    if (bytes < 0 && errno == EINTR)
+                        continue;
+
+                    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    {
+                        // The socket buffer is full. Wait (with a timeout) until it can take more data
+                        if (!m_sendfileTimer)
+                            m_sendfileTimer.emplace(GetDerived().Stream().get_executor());
+
+                        m_sendfileWaiting = true;
+                        m_sendfileTimer->expires_after(std::chrono::seconds(30));
+                        m_sendfileTimer->async_wait(
+                            beast::bind_front_handler(
+                                &HTTPSession::OnSendfileTimeout,
+                                GetDerived().shared_from_this()));
+
+                        socket.async_wait(
+                            tcp::socket::wait_write,
+                            beast::bind_front_handler(
+                                &HTTPSession::OnSendfileWritable,
+                                GetDerived().shared_from_this()));
+                        return;
+                    }
+
+                    // Either an error occurred, or sendfile returned 0 because the file got shorter
+                    // after the Content-Length was sent. Either way, the connection can't be reused.
+                    ec = bytes == 0 ? beast::error_code(http::error::short_read) : beast::error_code(errno, beast::system_category());
+                    m_sendfileSerializer.reset();
+                    return OnWrite(false, ec, 0);
+                }
+
+                bool keep_alive = res.keep_alive();
+                m_sendfileSerializer.reset();
+                OnWrite(keep_alive, {}, static_cast<std::size_t>(res.body().length));
+            }
+            catch (const boost::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::SendfileSome failure. Caught boost::exception: \n'{0}'",
+                    boost::diagnostic_information(e));
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::SendfileSome failure. Caught std::exception: \n'{0}'", e.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR("[CORE] HTTPSession::SendfileSome failure. Caught unknown exception.");
+            }
+        }
+
+        void OnSendfileWritable(beast::error_code ec) noexcept
+        {
+            m_sendfileWaiting = false;
+            m_sendfileTimer->cancel();
+
+            if (ec)
+            {
+                if (m_sendfileTimedOut)
+                    ec = beast::error::timeout;
+
+                m_sendfileSerializer.reset();
+                return OnWrite(false, ec, 0);
+            }
+
+            SendfileSome();
+        }
+
+        // The client has not taken any data for too long. The connection is closed rather than just the wait
+        // cancelled: the response can't be finished, and a pipelined read on the same socket is of no use either.
+        void OnSendfileTimeout(beast::error_code ec) noexcept
+        {
+            // Cancelled by OnSendfileWritable, or the timer fired after the wait had already completed
+            if (ec || !m_sendfileWaiting)
+                return;
+
+            m_sendfileTimedOut = true;
+            LOG_WARN("[CORE] Timed out sending a file to {0}:{1}", m_address, m_port);
+            beast::get_lowest_layer(GetDerived().Stream()).close();
+        }
+#endif
+
         void OnWrite(bool keep_alive, beast::error_code ec, std::size_t bytes_transferred) noexcept
         {
             // Need a try-catch here so an exception doesn't escape and cause a crash
@@ -671,11 +1536,11 @@ namespace Clover
                 {
                     // This means we should close the connection, usually because
                     // the response indicated the "Connection: close" semantic.
-                    return GetDerived().DoEOF();
+                    return m_lingerOnClose ? DoLinger() : GetDerived().DoEOF();
                 }
 
                 // Resume the read if it has been paused
-                if (m_response_queue.size() == m_queue_limit)
+                if (m_response_queue.size() == m_queue_limit && !m_awaitingResponse)
                     DoRead();
 
                 m_response_queue.pop();                
@@ -697,17 +1562,92 @@ namespace Clover
             DoWrite();
         }
 
+        // Read and throw away whatever the client is still sending before closing the connection. Closing a
+        // socket with unread data in it makes the kernel reset the connection, and a client that is still
+        // uploading can then lose the response before it gets to read it. Gives up after m_lingerLimit bytes
+        // or m_lingerTimeout, whichever comes first.
+        void DoLinger()
+        {
+            m_buffer.consume(m_buffer.size());
+            beast::get_lowest_layer(GetDerived().Stream()).expires_after(m_lingerTimeout);
+            ReadLinger();
+        }
+
+        void ReadLinger()
+        {
+            GetDerived().Stream().async_read_some(
+                m_buffer.prepare(m_lingerReadSize),
+                beast::bind_front_handler(
+                    &HTTPSession::OnLinger,
+                    GetDerived().shared_from_this()));
+        }
+
+        void OnLinger(beast::error_code ec, std::size_t bytes_transferred) noexcept
+        {
+            // Need a try-catch here so an exception doesn't escape and cause a crash
+            try
+            {
+                // The socket has already been closed (see OnRead)
+                if (ec == beast::error::timeout)
+                    return;
+
+                m_lingered += bytes_transferred;
+                if (ec || m_lingered >= m_lingerLimit)
+                    return GetDerived().DoEOF();
+
+                ReadLinger();
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] HTTPSession::OnLinger failure. Caught std::exception: \n'{0}'", e.what());
+            }
+        }
+
     protected:
         ND Derived& GetDerived() noexcept { return static_cast<Derived&>(*this); }
 
         Application* m_application;
 
+        // This connection's place under the AdmissionLimits, and the place of the request being answered
+        AdmissionControl::ConnectionSlot m_connection;
+        AdmissionControl::RequestSlot m_requestSlot;
+
         static constexpr std::size_t m_queue_limit = 8; // max responses
-        std::queue<http::message_generator> m_response_queue;
+        std::queue<HTTPResponse> m_response_queue;
+
+        // True from the time a request is handed to the application until its response is queued
+        bool m_awaitingResponse = false;
+        // True while inside the call to HandleHTTPRequest (i.e. the response is being produced synchronously)
+        bool m_dispatching = false;
+        // The context of the request being read or answered, from when its header arrives until its response
+        // is queued. Kept so that the request can be cancelled if the client disconnects while we wait on it
+        std::optional<RequestContext> m_context;
+        bool m_watchingDisconnect = false;
+
+        // A spooled body is written out each time this much of it has arrived (see OnReadBody)
+        static constexpr std::size_t m_spoolFlushSize = 256 * 1024;
+
+        // Set when a request is answered before its body was read, so the connection is closed with DoLinger
+        bool m_lingerOnClose = false;
+        static constexpr std::chrono::seconds m_lingerTimeout{ 5 };
+        static constexpr std::uint64_t m_lingerLimit = 1024 * 1024;
+        static constexpr std::size_t m_lingerReadSize = 64 * 1024;
+        std::uint64_t m_lingered = 0;
+
+#ifdef PLATFORM_LINUX
+        // State for the StaticFileResponse currently being sent with sendfile
+        static constexpr std::uint64_t m_sendfileChunk = 1024 * 1024;
+        std::optional<http::response_serializer<StaticFileBody>> m_sendfileSerializer;
+        std::optional<net::steady_timer> m_sendfileTimer;
+        bool m_sendfileWaiting = false;     // True while waiting for the socket to become writable
+        bool m_sendfileTimedOut = false;    // True if that wait was ended by the timer
+        std::uint64_t m_sendfileOffset = 0;
+        std::uint64_t m_sendfileRemain = 0;
+#endif
 
         // The parser is stored in an optional container so we can
         // construct it from scratch it at the beginning of each new message.
-        boost::optional<http::request_parser<http::string_body>> m_parser;
+        boost::optional<http::request_parser<Application::HTTPRequestType::body_type>> m_parser;
 
         beast::flat_buffer m_buffer;
 
@@ -720,11 +1660,14 @@ namespace Clover
     {
     public:
         // Create the session
-        PlainHTTPSession(beast::tcp_stream&& stream, beast::flat_buffer&& buffer, Application* application) noexcept :
-            HTTPSession<PlainHTTPSession>(std::move(buffer), application),
+        PlainHTTPSession(beast::tcp_stream&& stream, beast::flat_buffer&& buffer, Application* application, AdmissionControl::ConnectionSlot connection) noexcept :
+            HTTPSession<PlainHTTPSession>(std::move(buffer), application, std::move(connection)),
             m_stream(std::move(stream))
         {}
 
+        // Plain sessions send large static files with sendfile(2) (see HTTPSession::DoWrite)
+        static constexpr bool SupportsSendfile = true;
+
         void Run() { DoRead(); }
         ND beast::tcp_stream& Stream() noexcept { return m_stream; }
         ND beast::tcp_stream ReleaseStream() noexcept { return std::move(m_stream); }
@@ -739,11 +1682,14 @@ namespace Clover
     {
     public:
         // Create the http_session
-        SSLHTTPSession(beast::tcp_stream&& stream, ssl::context& ctx, beast::flat_buffer&& buffer, Application* application) :
-            HTTPSession<SSLHTTPSession>(std::move(buffer), application),
+        SSLHTTPSession(beast::tcp_stream&& stream, ssl::context& ctx, beast::flat_buffer&& buffer, Application* application, AdmissionControl::ConnectionSlot connection) :
+            HTTPSession<SSLHTTPSession>(std::move(buffer), application, std::move(connection)),
             m_stream(std::move(stream), ctx)
         {}
 
+        // The body has to go through the TLS stream, so sendfile(2) can't be used
+        static constexpr bool SupportsSendfile = false;
+
         // Start the session
         void Run();
         ND ssl::stream<beast::tcp_stream>& Stream() noexcept { return m_stream; }
@@ -761,7 +1707,7 @@ namespace Clover
     class DetectSession : public std::enable_shared_from_this<DetectSession>
     {
     public:
-        explicit DetectSession(tcp::socket&& socket, ssl::context& ctx, Application* application);
+        explicit DetectSession(tcp::socket&& socket, ssl::context& ctx, Application* application, AdmissionControl::ConnectionSlot connection);
 
         void Run();
         void OnRun() noexcept;
@@ -771,6 +1717,7 @@ namespace Clover
         beast::tcp_stream m_stream;
         ssl::context& m_ctx;
         Application* m_application;
+        AdmissionControl::ConnectionSlot m_connection;
         beast::flat_buffer m_buffer;
 
         std::string m_address;
@@ -781,18 +1728,60 @@ namespace Clover
     class Listener : public std::enable_shared_from_this<Listener>
     {
     public:
-        Listener(net::io_context& ioc, ssl::context& ctx, tcp::endpoint endpoint, Application* application);
+        // With a shard, the listener sets SO_REUSEPORT so that every shard can bind the same endpoint, and
+        // connections use the shard's io_context directly instead of a strand (see IOShard). With 'acceptIoc',
+        // connections are accepted there and then handed over to 'ioc' (see ThreadPlacement::isolateAccept).
+        Listener(net::io_context& ioc, ssl::context& ctx, tcp::endpoint endpoint, const ListenerOptions& options, Application* application,
+                 IOShard* shard = nullptr, net::io_context* acceptIoc = nullptr);
 
         void Run();
 
     private:
         void DoAccept() noexcept;
         void OnAccept(beast::error_code ec, tcp::socket socket) noexcept;
+        void OnAcceptPaused(beast::error_code ec) noexcept;
+
+        // Start a session on its connection's executor, which is not the one the connection was accepted on
+        // unless the listener belongs to a shard
+        template<class Session>
+        static void Launch(std::shared_ptr<Session> session)
+        {
+            auto executor = session->Stream().get_executor();
+            net::dispatch(
+                executor,
+                [session = std::move(session)]()
+                {
+                    // Need a try-catch here so an exception doesn't escape and cause a crash
+                    try
+                    {
+                        session->Run();
+                    }
+                    catch (const boost::exception& e)
+                    {
+                        LOG_ERROR("[CORE] Listener::Launch failure. Caught boost::exception: \n'{0}'",
+                            boost::diagnostic_information(e));
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LOG_ERROR("[CORE] Listener::Launch failure. Caught std::exception: \n'{0}'", e.what());
+                    }
+                    catch (...)
+                    {
+                        LOG_ERROR("[CORE] Listener::Launch failure. Caught unknown exception.");
+                    }
+                });
+        }
 
         net::io_context& m_ioc;
         ssl::context& m_ctx;
         tcp::acceptor m_acceptor;
+        ListenerOptions m_options;
         Application* m_application;
+        IOShard* m_shard;
+
+        // While the server is at its connection limit, accepting stops and this timer checks back periodically
+        net::steady_timer m_pauseTimer;
+        bool m_paused = false;
     };
 
 }
@@ -0,0 +1,454 @@
+#include "pch.hpp"
+#include "BodyParser.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    static std::string_view TrimOWS(std::string_view str) noexcept
+    {
+        while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+            str.remove_prefix(1);
+        while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+            str.remove_suffix(1);
+        return str;
+    }
+
+    // Find a parameter in the ';' separated list that follows a header value ('name="field"; filename="a.png"').
+    // Quotes are removed from the value, but escapes inside them are left as they are. Browsers percent-encode
+    // quotes in field and file names rather than escaping them, so in practice there aren't any.
+    static std::optional<std::string_view> FindParameter(std::string_view parameters, std::string_view key) noexcept
+    {
+        while (!parameters.empty())
+        {
+            std::size_t end = 0;
+            bool quoted = false;
+            for (; end < parameters.size(); ++end)
+            {
+                char c = parameters[end];
+                if (c == '"')
+                    quoted = !quoted;
+                else if (c == '\\' && quoted)
+                    ++end;
+                else if (c == ';' && !quoted)
+                    break;
+            }
+            end = std::min(end, parameters.size());
+
+            std::string_view parameter = TrimOWS(parameters.substr(0, end));
+            parameters.remove_prefix(std::min(end + 1, parameters.size()));
+
+            std::size_t equals = parameter.find('=');
+            if (equals == std::string_view::npos || !beast::iequals(TrimOWS(parameter.substr(0, equals)), key))
+                continue;
+
+            std::string_view value = TrimOWS(parameter.substr(equals + 1));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                value = value.substr(1, value.size() - 2);
+            return value;
+        }
+        return std::nullopt;
+    }
+
+    json ParseJSONBody(const RequestBody& body)
+    {
+        PROFILE_SCOPE("ParseJSONBody");
+
+        json data;
+        if (!body.IsSpooled())
+        {
+            data = json::parse(body.Data(), nullptr, false);
+        }
+        else
+        {
+            std::ifstream file(body.Path(), std::ios::binary);
+            if (!file)
+                throw std::runtime_error(std::format("ParseJSONBody: Failed to open '{0}'", body.Path().string()));
+            data = json::parse(file, nullptr, false);
+        }
+
+        if (data.is_discarded())
+            throw BadRequestBody("The request body is not valid JSON");
+        return data;
+    }
+
+    std::string FormPart::ReadAll() const
+    {
+        if (m_ownsBody)
+            return m_body.ReadAll();
+        return std::string(m_data);
+    }
+    bool FormPart::SaveAs(const std::filesystem::path& destination, std::error_code& ec) const
+    {
+        PROFILE_SCOPE("FormPart::SaveAs");
+
+        if (m_ownsBody)
+            return m_body.SaveAs(destination, ec);
+
+        ec.clear();
+        std::ofstream file(destination, std::ios::binary | std::ios::trunc);
+        if (!file.write(m_data.data(), static_cast<std::streamsize>(m_data.size())))
+        {
+            ec = std::make_error_code(std::errc::io_error);
+            return false;
+        }
+        return true;
+    }
+
+    // Splits a multipart body into part headers and part data. The body can be fed in one piece or in
+    // chunks: Scan() consumes as much of 'window' as it can and returns how many bytes that was. Whatever
+    // is left (an incomplete header block, or the tail of the data that might be the start of a boundary)
+    // must be passed again at the front of the next window.
+    //
+    // The sink is told about each part as it is found: BeginPart(headers), then PartData(data) any number
+    // of times, then EndPart(). Views passed to the sink are only valid during the call.
+    class MultipartForm::Scanner
+    {
+    public:
+        explicit Scanner(std::string_view boundary) :
+            m_delimiter(std::format("\r\n--{0}", boundary)),
+            m_searcher(m_delimiter.begin(), m_delimiter.end())
+        {}
+        Scanner(const Scanner&) = delete;
+        Scanner& operator=(const Scanner&) = delete;
+
+        ND inline bool Done() const noexcept { return m_state == State::Epilogue; }
+
+        // 'last' is true if there is nothing after 'window', in which case the body must be complete
+        template<class Sink>
+        ND std::size_t Scan(std::string_view window, bool last, Sink& sink)
+        {
+            std::size_t consumed = 0;
+            for (;;)
+            {
+                std::string_view rest = window.substr(consumed);
+                switch (m_state)
+                {
+                case State::Start:
+                {
+                    // The first boundary normally comes without the CRLF in front of it
+                    std::string_view dashBoundary = std::string_view(m_delimiter).substr(2);
+                    if (rest.size() < dashBoundary.size() && !last)
+                        return consumed;
+
+                    if (rest.starts_with(dashBoundary))
+                    {
+                        consumed += dashBoundary.size();
+                        m_state = State::AfterDelimiter;
+                    }
+                    else
+                        m_state = State::Preamble;
+                    break;
+                }
+                case State::Preamble:
+                {
+                    std::size_t pos = FindDelimiter(rest);
+                    if (pos == std::string_view::npos)
+                    {
+                        if (last)
+                            throw BadRequestBody("The multipart body does not contain its boundary");
+                        return consumed + Consumable(rest);
+                    }
+                    consumed += pos + m_delimiter.size();
+                    m_state = State::AfterDelimiter;
+                    break;
+                }
+                case State::AfterDelimiter:
+                {
+                    // Either "--" (the end of the body) or a CRLF, possibly after some whitespace
+                    std::size_t padding = 0;
+                    while (padding < rest.size() && (rest[padding] == ' ' || rest[padding] == '\t'))
+                        ++padding;
+                    consumed += padding;
+                    rest.remove_prefix(padding);
+
+                    if (rest.size() < 2)
+                    {
+                        if (last)
+                            throw BadRequestBody("The multipart body ended unexpectedly");
+                        return consumed;
+                    }
+
+                    if (rest.starts_with("--"))
+                    {
+                        // Anything after the final boundary is ignored
+                        m_state = State::Epilogue;
+                        return window.size();
+                    }
+                    if (!rest.starts_with("\r\n"))
+                        throw BadRequestBody("The multipart body has a malformed boundary");
+
+                    consumed += 2;
+                    m_state = State::Headers;
+                    break;
+                }
+                case State::Headers:
+                {
+                    // A part with no headers at all is allowed
+                    std::size_t end = rest.starts_with("\r\n") ? 0 : rest.find("\r\n\r\n");
+                    if (end == std::string_view::npos)
+                    {
+                        if (rest.size() > MaxPartHeaderSize)
+                            throw BadRequestBody("The headers of a multipart part are too large");
+                        if (last)
+                            throw BadRequestBody("The multipart body ended unexpectedly");
+                        return consumed;
+                    }
+                    if (end > MaxPartHeaderSize)
+                        throw BadRequestBody("The headers of a multipart part are too large");
+
+                    // Keep the CRLF at the end of the last header, so that every header line ends with one
+                    sink.BeginPart(end == 0 ? std::string_view() : rest.substr(0, end + 2));
+                    consumed += end == 0 ? 2 : end + 4;
+                    m_state = State::Data;
+                    break;
+                }
+                case State::Data:
+                {
+                    std::size_t pos = FindDelimiter(rest);
+                    if (pos == std::string_view::npos)
+                    {
+                        if (last)
+                            throw BadRequestBody("The multipart body ended unexpectedly");
+
+                        std::size_t safe = Consumable(rest);
+                        if (safe > 0)
+                            sink.PartData(rest.substr(0, safe));
+                        return consumed + safe;
+                    }
+
+                    if (pos > 0)
+                        sink.PartData(rest.substr(0, pos));
+                    sink.EndPart();
+                    consumed += pos + m_delimiter.size();
+                    m_state = State::AfterDelimiter;
+                    break;
+                }
+                case State::Epilogue:
+                    return window.size();
+                }
+            }
+        }
+
+    private:
+        enum class State
+        {
+            Start,
+            Preamble,
+            AfterDelimiter,
+            Headers,
+            Data,
+            Epilogue
+        };
+
+        ND std::size_t FindDelimiter(std::string_view str) const
+        {
+            auto itr = std::search(str.begin(), str.end(), m_searcher);
+            return itr == str.end() ? std::string_view::npos : static_cast<std::size_t>(itr - str.begin());
+        }
+
+        // Everything except a tail that could be the start of a delimiter split across two windows
+        ND std::size_t Consumable(std::string_view str) const noexcept
+        {
+            return str.size() >= m_delimiter.size() ? str.size() - (m_delimiter.size() - 1) : 0;
+        }
+
+        std::string m_delimiter;
+        std::boyer_moore_horspool_searcher<std::string::const_iterator> m_searcher;
+        State m_state = State::Start;
+    };
+
+    void MultipartForm::Parse(const RequestBody& body)
+    {
+        PROFILE_SCOPE("MultipartForm::Parse");
+
+        // "multipart/form-data; boundary=----WebKitFormBoundary7MA4YWxkTrZu0gW"
+        std::string_view contentType = body.ContentType();
+        std::size_t semicolon = contentType.find(';');
+        std::string_view mediaType = TrimOWS(contentType.substr(0, semicolon));
+        if (!beast::iequals(mediaType, "multipart/form-data"))
+            throw BadRequestBody(std::format("Expected a multipart/form-data body, but the body is '{0}'", mediaType));
+
+        std::optional<std::string_view> boundary = semicolon == std::string_view::npos ?
+            std::nullopt : FindParameter(contentType.substr(semicolon + 1), "boundary");
+
+        // RFC 2046 limits the boundary to 70 characters
+        if (!boundary.has_value() || boundary->empty() || boundary->size() > 70)
+            throw BadRequestBody("The multipart/form-data body does not have a valid boundary");
+
+        if (body.IsSpooled())
+            ParseSpooled(body, *boundary);
+        else
+            ParseInMemory(body.Data(), *boundary);
+
+        LOG_TRACE("[CORE] MultipartForm::Parse: Found {0} parts in a {1} byte body", m_parts.size(), body.Size());
+    }
+
+    void MultipartForm::ParseInMemory(std::string_view data, std::string_view boundary)
+    {
+        // Everything is already in memory, so the parts are just views into it
+        struct Sink
+        {
+            MultipartForm& form;
+
+            void BeginPart(std::string_view headers)
+            {
+                if (form.m_parts.size() == MaxParts)
+                    throw BadRequestBody("The multipart body has too many parts");
+
+                FormPart& part = form.m_parts.emplace_back();
+                ParsePartHeaders(headers, part);
+            }
+            void PartData(std::string_view data)
+            {
+                // The whole body is scanned in one window, so the data of a part always arrives in one piece
+                form.m_parts.back().m_data = data;
+            }
+            void EndPart() noexcept {}
+        };
+
+        Scanner scanner(boundary);
+        Sink sink{ *this };
+        (void)scanner.Scan(data, true, sink);
+    }
+
+    void MultipartForm::ParseSpooled(const RequestBody& body, std::string_view boundary)
+    {
+        // The spool file is read back a chunk at a time. Each part is written to a RequestBody of its own
+        // that uses the same spooling rules as the request, so small fields stay in memory and large
+        // files are spilled to a file of their own.
+        struct Sink
+        {
+            MultipartForm& form;
+            const RequestBody& body;
+            std::optional<UploadBody::reader> reader;
+
+            void BeginPart(std::string_view headers)
+            {
+                if (form.m_parts.size() == MaxParts)
+                    throw BadRequestBody("The multipart body has too many parts");
+
+                // The chunk the headers were read into is about to be reused
+                const std::string& stored = form.m_headerStorage.emplace_back(headers);
+
+                FormPart& part = form.m_parts.emplace_back();
+                ParsePartHeaders(stored, part);
+                part.m_ownsBody = true;
+                part.m_body.SpoolTo(body.m_spoolDirectory, body.m_memoryLimit);
+
+                beast::error_code ec;
+                reader.emplace(part.m_body);
+                reader->init(boost::none, ec);
+                if (ec)
+                    throw std::runtime_error(std::format("MultipartForm: Failed to start part '{0}': {1}", part.name, ec.message()));
+
+                // So that a part can be decoded on its own, like a request body (see ParseJSONBody)
+                part.m_body.m_contentType = part.contentType;
+            }
+            void PartData(std::string_view data)
+            {
+                beast::error_code ec;
+                (void)reader->put(net::buffer(data.data(), data.size()), ec);
+                if (ec)
+                    throw std::runtime_error(std::format("MultipartForm: Failed to write part '{0}': {1}", form.m_parts.back().name, ec.message()));
+            }
+            void EndPart()
+            {
+                beast::error_code ec;
+                reader->finish(ec);
+                reader.reset();
+                if (ec)
+                    throw std::runtime_error(std::format("MultipartForm: Failed to finish part '{0}': {1}", form.m_parts.back().name, ec.message()));
+            }
+        };
+
+        beast::error_code ec;
+        beast::file file;
+        file.open(body.Path().string().c_str(), beast::file_mode::scan, ec);
+        if (ec)
+            throw std::runtime_error(std::format("MultipartForm: Failed to open '{0}': {1}", body.Path().string(), ec.message()));
+
+        // Must be able to hold a complete header block along with the boundary around it
+        static constexpr std::size_t ChunkSize = 64 * 1024;
+        static_assert(ChunkSize > 2 * MaxPartHeaderSize);
+        std::unique_ptr<char[]> buffer = std::make_unique_for_overwrite<char[]>(ChunkSize);
+
+        Scanner scanner(boundary);
+        Sink sink{ *this, body, std::nullopt };
+        std::uint64_t read = 0;
+        std::size_t used = 0;
+        while (!scanner.Done())
+        {
+            std::size_t bytes = file.read(buffer.get() + used, ChunkSize - used, ec);
+            if (ec)
+                throw std::runtime_error(std::format("MultipartForm: Failed to read '{0}': {1}", body.Path().string(), ec.message()));
+            read += bytes;
+            used += bytes;
+
+            const bool last = bytes == 0 || read >= body.Size();
+            std::size_t consumed = scanner.Scan(std::string_view(buffer.get(), used), last, sink);
+
+            // Whatever wasn't consumed is scanned again at the front of the next chunk
+            std::memmove(buffer.get(), buffer.get() + consumed, used - consumed);
+            used -= consumed;
+
+            if (last)
+                break;
+            if (used == ChunkSize)
+                throw BadRequestBody("The multipart body could not be parsed");
+        }
+    }
+
+    void MultipartForm::ParsePartHeaders(std::string_view headers, FormPart& part)
+    {
+        // 'Content-Disposition: form-data; name="avatar"; filename="me.png"\r\nContent-Type: image/png\r\n'
+        while (!headers.empty())
+        {
+            std::size_t end = headers.find("\r\n");
+            std::string_view line = headers.substr(0, end);
+            headers.remove_prefix(end == std::string_view::npos ? headers.size() : end + 2);
+
+            std::size_t colon = line.find(':');
+            if (colon == std::string_view::npos)
+                continue;
+
+            std::string_view name = TrimOWS(line.substr(0, colon));
+            std::string_view value = TrimOWS(line.substr(colon + 1));
+
+            if (beast::iequals(name, "Content-Disposition"))
+            {
+                std::size_t semicolon = value.find(';');
+                if (semicolon == std::string_view::npos)
+                    continue;
+
+                std::string_view parameters = value.substr(semicolon + 1);
+                part.name = FindParameter(parameters, "name").value_or(std::string_view());
+
+                std::optional<std::string_view> filename = FindParameter(parameters, "filename");
+                part.isFile = filename.has_value();
+                part.filename = filename.value_or(std::string_view());
+            }
+            else if (beast::iequals(name, "Content-Type"))
+            {
+                part.contentType = value;
+            }
+        }
+    }
+
+    const FormPart* MultipartForm::Find(std::string_view name) const noexcept
+    {
+        for (const FormPart& part : m_parts)
+        {
+            if (part.name == name)
+                return &part;
+        }
+        return nullptr;
+    }
+    std::string_view MultipartForm::Get(std::string_view name, std::string_view fallback) const noexcept
+    {
+        const FormPart* part = Find(name);
+        if (part == nullptr || part->IsSpooled())
+            return fallback;
+        return part->Data();
+    }
+}
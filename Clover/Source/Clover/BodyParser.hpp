@@ -0,0 +1,133 @@
+#pragma once
+#include "pch.hpp"
+#include "Profiling.hpp"
+#include "RequestBody.hpp"
+
+namespace Clover
+{
+    // Thrown when a request body can't be decoded. PUT and POST targets that throw this are answered with
+    // 400 - Bad Request (with what() as the reason) instead of 500 - Internal Server Error.
+    class BadRequestBody : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Parse a JSON request body into a json document. A spooled body is parsed from its file rather than
+    // read into a string first, but the document is a full copy of the data (and usually several times the
+    // size of the body), so for a large body consider the SAX overload below. Throws BadRequestBody if the
+    // body is not valid JSON.
+    ND json ParseJSONBody(const RequestBody& body);
+
+    // Same as above, but the body is handed to a SAX handler (see nlohmann::json_sax) instead of being
+    // built into a json document. Handlers that only need a few values out of a large body can pick them
+    // out as they go, without allocating a node for everything else. Returns false if the body is not
+    // valid JSON or the handler stopped the parse.
+    template<class SAX>
+    ND bool ParseJSONBody(const RequestBody& body, SAX& sax)
+    {
+        PROFILE_SCOPE("ParseJSONBody (SAX)");
+
+        if (!body.IsSpooled())
+            return json::sax_parse(body.Data(), &sax);
+
+        std::ifstream file(body.Path(), std::ios::binary);
+        if (!file)
+            throw std::runtime_error(std::format("ParseJSONBody: Failed to open '{0}'", body.Path().string()));
+        return json::sax_parse(file, &sax);
+    }
+
+    // One part of a multipart/form-data body: either a form field or an uploaded file.
+    //
+    // When the request body is held in memory, the part's name, filename, content type, and data are all
+    // views into it. When the request body was spooled, each part's data is copied out of the spool file
+    // into a RequestBody of its own, so a large upload is written to a second file of its own (see
+    // RequestBody::SaveAs) rather than held in memory. Until the request is done, it takes twice its size on disk.
+    class FormPart
+    {
+    public:
+        std::string_view name;
+        std::string_view filename;
+
+        // Empty if the part did not send one, in which case it should be treated as text/plain
+        std::string_view contentType;
+
+        // True if the part came from a file input (it had a filename parameter, even an empty one)
+        bool isFile = false;
+
+        ND inline std::uint64_t Size() const noexcept { return m_ownsBody ? m_body.Size() : m_data.size(); }
+        ND inline bool IsSpooled() const noexcept { return m_body.IsSpooled(); }
+
+        // The data, if it is held in memory. Empty if the part was spooled
+        ND inline std::string_view Data() const noexcept { return m_ownsBody ? m_body.Data() : m_data; }
+
+        // The file holding the data, if it was spooled. Empty otherwise
+        ND inline const std::filesystem::path& Path() const noexcept { return m_body.Path(); }
+
+        // See RequestBody::ReadAll and RequestBody::SaveAs
+        ND std::string ReadAll() const;
+        bool SaveAs(const std::filesystem::path& destination, std::error_code& ec) const;
+
+    private:
+        friend class MultipartForm;
+
+        std::string_view m_data;
+        RequestBody m_body;
+        bool m_ownsBody = false;
+    };
+
+    // A streaming multipart/form-data parser (RFC 7578). The body is scanned once for the boundary and
+    // split into parts. For a body held in memory, the parts are views into it and nothing is copied. A
+    // spooled body is read back in fixed size chunks and each part is copied out (see FormPart), so parsing
+    // a large upload needs no more memory than a small one, at the cost of writing the data a second time.
+    //
+    // Parts are kept in the order they were sent. The form must outlive any views taken from it, and the
+    // RequestBody it was parsed from must outlive the form.
+    class MultipartForm
+    {
+    public:
+        using value_type = FormPart;
+        using Container = std::vector<FormPart>;
+        using const_iterator = Container::const_iterator;
+        using iterator = const_iterator;
+
+        MultipartForm() noexcept = default;
+        MultipartForm(const MultipartForm&) = delete;
+        MultipartForm& operator=(const MultipartForm&) = delete;
+
+        // Parse 'body', using the boundary from its Content-Type. Throws BadRequestBody if the body is not
+        // multipart/form-data, is malformed, or has more than MaxParts parts. Should be called at most once.
+        void Parse(const RequestBody& body);
+
+        ND inline const_iterator begin() const noexcept { return m_parts.begin(); }
+        ND inline const_iterator end() const noexcept { return m_parts.end(); }
+        ND inline std::size_t size() const noexcept { return m_parts.size(); }
+        ND inline bool empty() const noexcept { return m_parts.empty(); }
+
+        // The first part with the given name, or nullptr
+        ND const FormPart* Find(std::string_view name) const noexcept;
+        ND inline bool contains(std::string_view name) const noexcept { return Find(name) != nullptr; }
+
+        // The data of the first part with the given name, or 'fallback' if there is no such part. Only
+        // meant for ordinary fields; a spooled part returns 'fallback' as well.
+        ND std::string_view Get(std::string_view name, std::string_view fallback = {}) const noexcept;
+
+        static constexpr std::size_t MaxParts = 1024;
+        static constexpr std::size_t MaxPartHeaderSize = 8 * 1024;
+
+    private:
+        class Scanner;
+
+        void ParseInMemory(std::string_view data, std::string_view boundary);
+        void ParseSpooled(const RequestBody& body, std::string_view boundary);
+
+        // Fills in the part's name, filename and content type from its header block, which must outlive the form
+        static void ParsePartHeaders(std::string_view headers, FormPart& part);
+
+        Container m_parts;
+
+        // Copies of the part headers when the body was spooled, since the chunk they were read into is
+        // reused. A deque, so that adding one never moves the others.
+        std::deque<std::string> m_headerStorage;
+    };
+}
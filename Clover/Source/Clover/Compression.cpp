@@ -0,0 +1,57 @@
+#include "pch.hpp"
+#include "Compression.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    std::string GzipCompress(std::string_view input, int level)
+    {
+        PROFILE_SCOPE("GzipCompress");
+
+        // Beast's deflate_stream produces a raw deflate stream, so the gzip header and trailer are added here
+        static constexpr std::size_t headerSize = 10;
+        static constexpr std::size_t trailerSize = 8;
+        static constexpr unsigned char header[headerSize] = {
+            0x1f, 0x8b,             // Magic number
+            0x08,                   // Compression method: deflate
+            0x00,                   // Flags: none
+            0x00, 0x00, 0x00, 0x00, // Modification time: not available
+            0x00,                   // Extra flags
+            0xff                    // Operating system: unknown
+        };
+
+        thread_local beast::zlib::deflate_stream stream;
+        stream.reset(level, 15, 8, beast::zlib::Strategy::normal);
+
+        // Allocate enough space up front so that the whole input can be compressed in a single call
+        std::string output;
+        output.resize(headerSize + stream.upper_bound(input.size()) + trailerSize);
+        std::memcpy(output.data(), header, headerSize);
+
+        beast::zlib::z_params zs;
+        zs.next_in = input.data();
+        zs.avail_in = input.size();
+        zs.next_out = output.data() + headerSize;
+        zs.avail_out = output.size() - headerSize - trailerSize;
+
+        beast::error_code ec;
+        stream.write(zs, beast::zlib::Flush::finish, ec);
+        if (ec != beast::zlib::error::end_of_stream)
+            throw beast::system_error(ec ? ec : beast::error_code(beast::zlib::error::need_buffers));
+
+        std::size_t size = headerSize + zs.total_out;
+
+        // Trailer: CRC-32 and size of the uncompressed input, both little endian
+        boost::crc_32_type crc;
+        crc.process_bytes(input.data(), input.size());
+        std::uint32_t trailer[2] = { static_cast<std::uint32_t>(crc.checksum()), static_cast<std::uint32_t>(input.size()) };
+        for (std::uint32_t value : trailer)
+        {
+            for (int iii = 0; iii < 4; ++iii)
+                output[size++] = static_cast<char>((value >> (8 * iii)) & 0xff);
+        }
+
+        output.resize(size);
+        return output;
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Compress 'input' into a single gzip member (RFC 1952) at the given zlib compression level (1-9).
+    //
+    // Each thread keeps its own deflate stream and reuses it for every call, so the compressor's
+    // window and hash tables are only allocated once per thread rather than once per response.
+    // Throws beast::system_error if compression fails.
+    ND std::string GzipCompress(std::string_view input, int level = 6);
+}
@@ -0,0 +1,231 @@
+#include "pch.hpp"
+#include "ComputePool.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    // Lets Submit() know when it is being called from one of the pool's own workers
+    static thread_local const ComputePool* t_pool = nullptr;
+    static thread_local std::size_t t_workerIndex = 0;
+
+    ComputePool::ComputePool() noexcept
+    {
+        for (std::size_t lane = 0; lane < LaneCount; ++lane)
+        {
+            m_depth[lane] = 0;
+            m_maxDepth[lane] = 0;
+        }
+    }
+    ComputePool::~ComputePool() noexcept
+    {
+        Stop();
+    }
+
+    void ComputePool::Start(unsigned int threads, ThreadStartFn onThreadStart)
+    {
+        if (IsRunning() || !m_workers.empty())
+        {
+            LOG_ERROR("[CORE] ComputePool::Start failed because the pool has already been started");
+            return;
+        }
+
+        threads = std::max(threads, 1u);
+        m_onThreadStart = std::move(onThreadStart);
+
+        m_workers.reserve(threads);
+        for (unsigned int iii = 0; iii < threads; ++iii)
+            m_workers.push_back(std::make_unique<Worker>());
+
+        m_running.store(true, std::memory_order_release);
+
+        m_threads.reserve(threads);
+        for (std::size_t iii = 0; iii < threads; ++iii)
+            m_threads.emplace_back([this, iii]() { WorkerLoop(iii); });
+
+        LOG_INFO("[CORE] Started compute pool with {0} threads", threads);
+    }
+
+    void ComputePool::Stop() noexcept
+    {
+        if (!m_running.exchange(false, std::memory_order_acq_rel))
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stopping.store(true, std::memory_order_release);
+        }
+        m_wake.notify_all();
+
+        for (std::thread& thread : m_threads)
+        {
+            if (thread.joinable())
+                thread.join();
+        }
+        m_threads.clear();
+
+        // Anything still queued is dropped
+        for (auto& worker : m_workers)
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            for (auto& lane : worker->lanes)
+                lane.clear();
+        }
+        for (auto& depth : m_depth)
+            depth.store(0, std::memory_order_relaxed);
+        m_pending.store(0, std::memory_order_relaxed);
+    }
+
+    bool ComputePool::Submit(Task task, ComputePriority priority)
+    {
+        if (!IsRunning())
+            return false;
+
+        // Keep work submitted by a worker on that worker, where its data is likely still in cache
+        std::size_t index = t_pool == this ?
+            t_workerIndex :
+            m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+
+        // The depth is counted before the task is visible, so that a worker that takes it right away can't
+        // take the count below zero
+        const std::size_t lane = Lane(priority);
+        std::size_t depth = m_depth[lane].fetch_add(1, std::memory_order_relaxed) + 1;
+        try
+        {
+            Worker& worker = *m_workers[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.lanes[lane].push_back(std::move(task));
+        }
+        catch (...)
+        {
+            m_depth[lane].fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+
+        std::size_t maxDepth = m_maxDepth[lane].load(std::memory_order_relaxed);
+        while (depth > maxDepth && !m_maxDepth[lane].compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed))
+        {}
+
+        // m_pending is only raised once the task is queued, and a worker claims one before it looks for a
+        // task (see WorkerLoop), so a worker never goes looking for a task that isn't there yet. Taking the
+        // lock (even briefly) also guarantees a worker that just checked m_pending and is about to wait
+        // can't miss this notification.
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_pending.fetch_add(1, std::memory_order_release);
+        }
+        m_wake.notify_one();
+        return true;
+    }
+
+    bool ComputePool::TryTake(std::size_t index, std::size_t lane, Task& task) noexcept
+    {
+        Worker& worker = *m_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.lanes[lane].empty())
+            return false;
+
+        // Oldest first, so requests are answered roughly in the order they arrived
+        task = std::move(worker.lanes[lane].front());
+        worker.lanes[lane].pop_front();
+        return true;
+    }
+
+    bool ComputePool::TrySteal(std::size_t index, std::size_t lane, Task& task) noexcept
+    {
+        // Start with the next worker over so that all the thieves don't pile on to worker 0
+        for (std::size_t offset = 1; offset < m_workers.size(); ++offset)
+        {
+            Worker& victim = *m_workers[(index + offset) % m_workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.lanes[lane].empty())
+                continue;
+
+            // Take from the back, away from the end the owner is working on
+            task = std::move(victim.lanes[lane].back());
+            victim.lanes[lane].pop_back();
+            m_stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void ComputePool::WorkerLoop(std::size_t index) noexcept
+    {
+        t_pool = this;
+        t_workerIndex = index;
+
+        if (m_onThreadStart)
+            m_onThreadStart(index);
+
+        constexpr std::size_t interactive = static_cast<std::size_t>(ComputePriority::Interactive);
+        constexpr std::size_t batch = static_cast<std::size_t>(ComputePriority::Batch);
+
+        unsigned int sinceBatch = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_sleepMutex);
+                m_wake.wait(lock, [this]() { return m_pending.load(std::memory_order_acquire) > 0 || m_stopping.load(std::memory_order_acquire); });
+                if (m_stopping.load(std::memory_order_acquire))
+                    return;
+
+                // Claim one of the queued tasks. Every claim is backed by a task that was queued before
+                // m_pending was raised for it, and every worker takes exactly one task per claim.
+                m_pending.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            // Usually interactive work first, but now and then give batch work a turn
+            const bool batchFirst = ++sinceBatch >= BatchInterval;
+            const std::array<std::size_t, LaneCount> order = batchFirst ?
+                std::array<std::size_t, LaneCount>{ batch, interactive } :
+                std::array<std::size_t, LaneCount>{ interactive, batch };
+
+            // The claimed task is in one of the lanes, but the lanes are searched one at a time while other
+            // workers take from them, so the search can pass the one that is left. Searching again will find it.
+            Task task;
+            std::size_t lane = order[0];
+            bool found = false;
+            while (!found)
+            {
+                for (std::size_t candidate : order)
+                {
+                    if (TryTake(index, candidate, task) || TrySteal(index, candidate, task))
+                    {
+                        lane = candidate;
+                        found = true;
+                        break;
+                    }
+                }
+
+                if (!found)
+                {
+                    if (m_stopping.load(std::memory_order_acquire))
+                        return;
+                    std::this_thread::yield();
+                }
+            }
+
+            if (lane == batch)
+                sinceBatch = 0;
+
+            m_depth[lane].fetch_sub(1, std::memory_order_relaxed);
+
+            try
+            {
+                PROFILE_SCOPE("ComputePool task");
+                task();
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] ComputePool task failure. Caught std::exception: \n'{0}'", e.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR("[CORE] ComputePool task failure. Caught unknown exception.");
+            }
+
+            m_executed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
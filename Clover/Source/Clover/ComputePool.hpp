@@ -0,0 +1,89 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    enum class ComputePriority
+    {
+        Interactive,    // A user is waiting on the result (e.g. a page render)
+        Batch           // Can wait behind interactive work (e.g. reports, exports)
+    };
+
+    // A pool of threads, separate from the io threads, for CPU heavy work such as gathering the data
+    // for a large report and rendering it. Keeping that work off the io threads means a burst of heavy
+    // requests can't hold up static files and websocket traffic.
+    //
+    // Each worker owns a queue per priority. Tasks submitted from a worker go to that worker's own
+    // queue, tasks submitted from anywhere else are spread round robin. An idle worker first takes from
+    // its own queue and then steals from the other workers, so a worker stuck on a long task does not
+    // strand the tasks queued behind it. Interactive tasks are always preferred, except that every
+    // few tasks a worker takes a batch task first so that batch work can't be starved completely.
+    //
+    // Submit and the metrics are safe to call concurrently from any thread.
+    class ComputePool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        ComputePool() noexcept;
+        ComputePool(const ComputePool&) = delete;
+        ComputePool& operator=(const ComputePool&) = delete;
+        ~ComputePool() noexcept;
+
+        // Called first thing on each worker thread, e.g. to pin it to a CPU (see ThreadPlacement)
+        using ThreadStartFn = std::function<void(std::size_t index)>;
+
+        // Start the worker threads. Should only be called once
+        void Start(unsigned int threads, ThreadStartFn onThreadStart = {});
+
+        // Stop and join the worker threads. Tasks that have not started yet are dropped.
+        void Stop() noexcept;
+
+        // Returns false if the pool is not running, in which case the task is not queued
+        bool Submit(Task task, ComputePriority priority = ComputePriority::Interactive);
+
+        ND inline bool IsRunning() const noexcept { return m_running.load(std::memory_order_acquire); }
+        ND inline std::size_t ThreadCount() const noexcept { return m_workers.size(); }
+
+        // Tasks waiting to run (not counting the ones currently running), and the most that have ever been waiting at once
+        ND inline std::size_t QueueDepth(ComputePriority priority) const noexcept { return m_depth[Lane(priority)].load(std::memory_order_relaxed); }
+        ND inline std::size_t MaxQueueDepth(ComputePriority priority) const noexcept { return m_maxDepth[Lane(priority)].load(std::memory_order_relaxed); }
+        ND inline std::uint64_t Executed() const noexcept { return m_executed.load(std::memory_order_relaxed); }
+        ND inline std::uint64_t Stolen() const noexcept { return m_stolen.load(std::memory_order_relaxed); }
+
+    private:
+        static constexpr std::size_t LaneCount = 2;
+
+        // Out of this many tasks in a row, a worker takes a batch task first for one of them
+        static constexpr unsigned int BatchInterval = 8;
+
+        ND static constexpr std::size_t Lane(ComputePriority priority) noexcept { return static_cast<std::size_t>(priority); }
+
+        struct Worker
+        {
+            std::mutex mutex;
+            std::array<std::deque<Task>, LaneCount> lanes;
+        };
+
+        void WorkerLoop(std::size_t index) noexcept;
+        ND bool TryTake(std::size_t index, std::size_t lane, Task& task) noexcept;
+        ND bool TrySteal(std::size_t index, std::size_t lane, Task& task) noexcept;
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::vector<std::thread> m_threads;
+        ThreadStartFn m_onThreadStart;
+        std::atomic<std::size_t> m_nextWorker = 0;
+
+        // Idle workers sleep until there is something queued
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wake;
+        std::atomic<std::size_t> m_pending = 0;
+        std::atomic<bool> m_running = false;
+        std::atomic<bool> m_stopping = false;
+
+        std::array<std::atomic<std::size_t>, LaneCount> m_depth;
+        std::array<std::atomic<std::size_t>, LaneCount> m_maxDepth;
+        std::atomic<std::uint64_t> m_executed = 0;
+        std::atomic<std::uint64_t> m_stolen = 0;
+    };
+}
@@ -0,0 +1,119 @@
+#include "pch.hpp"
+#include "ConditionalRequest.hpp"
+
+namespace Clover
+{
+    static constexpr std::array<std::string_view, 7> s_dayNames = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static constexpr std::array<std::string_view, 12> s_monthNames = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    std::string FormatHTTPDate(std::chrono::sys_seconds time)
+    {
+        std::chrono::sys_days days = std::chrono::floor<std::chrono::days>(time);
+        std::chrono::year_month_day ymd(days);
+        std::chrono::hh_mm_ss hms(time - days);
+
+        return std::format("{0}, {1:02} {2} {3} {4:02}:{5:02}:{6:02} GMT",
+            s_dayNames[std::chrono::weekday(days).c_encoding()],
+            static_cast<unsigned>(ymd.day()),
+            s_monthNames[static_cast<unsigned>(ymd.month()) - 1],
+            static_cast<int>(ymd.year()),
+            hms.hours().count(),
+            hms.minutes().count(),
+            hms.seconds().count());
+    }
+
+    std::optional<std::chrono::sys_seconds> ParseHTTPDate(std::string_view date) noexcept
+    {
+        // "Sun, 06 Nov 1994 08:49:37 GMT"
+        //  0123456789012345678901234567
+        if (date.size() != 29 || date.substr(3, 2) != ", " || !date.ends_with(" GMT") ||
+            date[7] != ' ' || date[11] != ' ' || date[16] != ' ' || date[19] != ':' || date[22] != ':')
+            return std::nullopt;
+
+        auto number = [date](std::size_t pos, std::size_t count) -> std::optional<int>
+            {
+                int value = 0;
+                for (std::size_t iii = pos; iii < pos + count; ++iii)
+                {
+                    if (date[iii] < '0' || date[iii] > '9')
+                        return std::nullopt;
+                    value = value * 10 + (date[iii] - '0');
+                }
+                return value;
+            };
+
+        auto day = number(5, 2);
+        auto year = number(12, 4);
+        auto hour = number(17, 2);
+        auto minute = number(20, 2);
+        auto second = number(23, 2);
+        if (!day || !year || !hour || !minute || !second || *hour > 23 || *minute > 59 || *second > 60)
+            return std::nullopt;
+
+        auto month = std::find(s_monthNames.begin(), s_monthNames.end(), date.substr(8, 3));
+        if (month == s_monthNames.end())
+            return std::nullopt;
+
+        std::chrono::year_month_day ymd(
+            std::chrono::year(*year),
+            std::chrono::month(static_cast<unsigned>(month - s_monthNames.begin()) + 1),
+            std::chrono::day(static_cast<unsigned>(*day)));
+        if (!ymd.ok())
+            return std::nullopt;
+
+        return std::chrono::sys_days(ymd) + std::chrono::hours(*hour) + std::chrono::minutes(*minute) + std::chrono::seconds(*second);
+    }
+
+    bool ETagListMatches(std::string_view ifNoneMatch, std::string_view etag) noexcept
+    {
+        auto trim = [](std::string_view str) -> std::string_view
+            {
+                while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+                    str.remove_prefix(1);
+                while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+                    str.remove_suffix(1);
+                return str;
+            };
+        auto opaque = [](std::string_view tag) -> std::string_view
+            {
+                if (tag.starts_with("W/"))
+                    tag.remove_prefix(2);
+                return tag;
+            };
+
+        if (trim(ifNoneMatch) == "*")
+            return true;
+
+        std::string_view target = opaque(etag);
+        while (!ifNoneMatch.empty())
+        {
+            std::size_t comma = ifNoneMatch.find(',');
+            std::string_view tag = trim(ifNoneMatch.substr(0, comma));
+
+            if (!tag.empty() && opaque(tag) == target)
+                return true;
+
+            if (comma == std::string_view::npos)
+                break;
+            ifNoneMatch.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    bool IsNotModified(const http::fields& request, std::string_view etag, std::optional<std::chrono::sys_seconds> lastModified) noexcept
+    {
+        auto ifNoneMatch = request.find(http::field::if_none_match);
+        if (ifNoneMatch != request.end())
+            return !etag.empty() && ETagListMatches(ifNoneMatch->value(), etag);
+
+        if (!lastModified.has_value())
+            return false;
+
+        auto ifModifiedSince = request.find(http::field::if_modified_since);
+        if (ifModifiedSince == request.end())
+            return false;
+
+        std::optional<std::chrono::sys_seconds> since = ParseHTTPDate(ifModifiedSince->value());
+        return since.has_value() && *lastModified <= *since;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Helpers for validators (ETag / Last-Modified) and conditional GET/HEAD requests (RFC 9110, section 13)
+
+    // Format a time as an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    ND std::string FormatHTTPDate(std::chrono::sys_seconds time);
+
+    // Parse an IMF-fixdate. The obsolete RFC 850 and asctime formats are not accepted, which just
+    // means a conditional header using them is ignored and the full response is sent.
+    ND std::optional<std::chrono::sys_seconds> ParseHTTPDate(std::string_view date) noexcept;
+
+    // Last-Modified only has a resolution of one second
+    ND inline std::chrono::sys_seconds ToHTTPTime(std::filesystem::file_time_type time) noexcept
+    {
+        return std::chrono::floor<std::chrono::seconds>(std::chrono::clock_cast<std::chrono::system_clock>(time));
+    }
+
+    // Returns true if 'etag' is in the list of entity tags of an If-None-Match header (or if the header
+    // is "*"). Uses the weak comparison, so W/"abc" and "abc" match.
+    ND bool ETagListMatches(std::string_view ifNoneMatch, std::string_view etag) noexcept;
+
+    // Evaluate If-None-Match / If-Modified-Since against the validators of the selected representation.
+    // Returns true when the client's copy is still current and a 304 should be sent. As required by the
+    // RFC, If-Modified-Since is only considered when the request does not contain If-None-Match.
+    ND bool IsNotModified(const http::fields& request, std::string_view etag, std::optional<std::chrono::sys_seconds> lastModified = std::nullopt) noexcept;
+}
@@ -0,0 +1,65 @@
+#include "pch.hpp"
+#include "ContentEncoding.hpp"
+
+namespace Clover
+{
+    double EncodingQuality(std::string_view acceptEncoding, std::string_view coding) noexcept
+    {
+        auto trim = [](std::string_view str) -> std::string_view
+            {
+                while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+                    str.remove_prefix(1);
+                while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+                    str.remove_suffix(1);
+                return str;
+            };
+
+        std::optional<double> explicitQuality;
+        std::optional<double> wildcardQuality;
+
+        while (!acceptEncoding.empty())
+        {
+            std::size_t comma = acceptEncoding.find(',');
+            std::string_view element = acceptEncoding.substr(0, comma);
+
+            // "gzip;q=0.5" -> token = "gzip", quality = 0.5
+            std::size_t semicolon = element.find(';');
+            std::string_view token = trim(element.substr(0, semicolon));
+            double quality = 1.0;
+            if (semicolon != std::string_view::npos)
+            {
+                std::string_view parameter = trim(element.substr(semicolon + 1));
+                if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=')
+                {
+                    parameter.remove_prefix(2);
+                    if (std::from_chars(parameter.data(), parameter.data() + parameter.size(), quality).ec != std::errc())
+                        quality = 0.0;
+                }
+            }
+
+            if (beast::iequals(token, coding))
+                explicitQuality = quality;
+            else if (token == "*")
+                wildcardQuality = quality;
+
+            if (comma == std::string_view::npos)
+                break;
+            acceptEncoding.remove_prefix(comma + 1);
+        }
+
+        if (explicitQuality.has_value())
+            return *explicitQuality;
+        return wildcardQuality.value_or(0.0);
+    }
+
+    ContentCoding NegotiateContentCoding(std::string_view acceptEncoding, bool brotliAvailable, bool gzipAvailable) noexcept
+    {
+        double brotli = brotliAvailable ? EncodingQuality(acceptEncoding, "br") : 0.0;
+        double gzip = gzipAvailable ? EncodingQuality(acceptEncoding, "gzip") : 0.0;
+
+        if (brotli <= 0.0 && gzip <= 0.0)
+            return ContentCoding::Identity;
+
+        return brotli >= gzip ? ContentCoding::Brotli : ContentCoding::Gzip;
+    }
+}
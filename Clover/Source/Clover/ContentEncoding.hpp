@@ -0,0 +1,33 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Helpers for content coding negotiation (RFC 9110, section 12.5.3)
+
+    // Returns the quality value the Accept-Encoding header gives to 'coding' (e.g. "br" or "gzip"),
+    // or 0 if the client does not accept it. An explicit entry for the coding wins over "*".
+    ND double EncodingQuality(std::string_view acceptEncoding, std::string_view coding) noexcept;
+
+    // The content codings we can send. Identity means the body is not encoded at all
+    enum class ContentCoding
+    {
+        Identity,
+        Brotli,
+        Gzip
+    };
+
+    ND constexpr std::string_view ContentCodingName(ContentCoding coding) noexcept
+    {
+        switch (coding)
+        {
+        case ContentCoding::Brotli: return "br";
+        case ContentCoding::Gzip:   return "gzip";
+        default:                    return "identity";
+        }
+    }
+
+    // Choose the best coding out of the ones available for a response. When the client gives brotli
+    // and gzip the same quality, brotli is preferred because it is smaller.
+    ND ContentCoding NegotiateContentCoding(std::string_view acceptEncoding, bool brotliAvailable, bool gzipAvailable) noexcept;
+}
@@ -2,3 +2,24 @@
 
 #define ND [[nodiscard]]
 
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace Clover
+{
+    // string_hash is used that that we can do a lookup using a string_view even though
+    // the keys are strings. See: https://www.cppstories.com/2021/heterogeneous-access-cpp20/
+    struct string_hash {
+        using is_transparent = void;
+        [[nodiscard]] size_t operator()(const char* txt) const {
+            return std::hash<std::string_view>{}(txt);
+        }
+        [[nodiscard]] size_t operator()(std::string_view txt) const {
+            return std::hash<std::string_view>{}(txt);
+        }
+        [[nodiscard]] size_t operator()(const std::string& txt) const {
+            return std::hash<std::string>{}(txt);
+        }
+    };
+}
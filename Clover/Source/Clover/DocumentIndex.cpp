@@ -0,0 +1,257 @@
+#include "pch.hpp"
+#include "DocumentIndex.hpp"
+#include "ConditionalRequest.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+#ifdef PLATFORM_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Clover
+{
+    FileInfo::~FileInfo() noexcept
+    {
+#ifdef PLATFORM_LINUX
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    // Whether the index opened the file itself (see SetHoldFilesOpen)
+    static bool IsHeldOpen(const FileInfo& info) noexcept
+    {
+#ifdef PLATFORM_LINUX
+        return info.fd >= 0;
+#else
+        boost::ignore_unused(info);
+        return false;
+#endif
+    }
+
+    void DocumentIndex::Build(const std::string& root) noexcept
+    {
+        PROFILE_SCOPE("DocumentIndex::Build");
+
+        std::lock_guard buildLock(m_buildMutex);
+
+        try
+        {
+            std::string docRoot = root;
+            if (!docRoot.ends_with('/'))
+                docRoot += '/';
+
+            std::shared_ptr<const Snapshot> previous = m_snapshot.load();
+
+            // Only carry over entries if the previous snapshot was for the same document root
+            if (previous != nullptr && previous->docRoot != docRoot)
+                previous = nullptr;
+
+            auto snapshot = std::make_shared<Snapshot>();
+            snapshot->docRoot = docRoot;
+
+#ifdef PLATFORM_LINUX
+            const bool holdOpen = m_holdFilesOpen.load(std::memory_order_relaxed);
+#else
+            const bool holdOpen = false;
+#endif
+            bool changed = previous == nullptr;
+
+            std::error_code ec;
+            std::filesystem::recursive_directory_iterator itr(docRoot, std::filesystem::directory_options::skip_permission_denied, ec);
+            if (ec)
+            {
+                LOG_ERROR("[CORE] DocumentIndex: Failed to open document root '{0}': '{1}'", docRoot, ec.message());
+            }
+
+            for (; !ec && itr != std::filesystem::recursive_directory_iterator(); itr.increment(ec))
+            {
+                if (!itr->is_regular_file(ec) || ec)
+                {
+                    ec.clear();
+                    continue;
+                }
+
+                std::string relativePath = itr->path().lexically_relative(docRoot).generic_string();
+
+                std::uint64_t size = itr->file_size(ec);
+                if (ec)
+                {
+                    ec.clear();
+                    continue;
+                }
+                std::filesystem::file_time_type lastWriteTime = itr->last_write_time(ec);
+                if (ec)
+                {
+                    ec.clear();
+                    continue;
+                }
+
+                // Re-use the previous entry if the file has not changed (and is still held open, or not, as wanted)
+                std::shared_ptr<const FileInfo> info;
+                if (previous != nullptr)
+                {
+                    auto old = previous->files.find(relativePath);
+                    if (old != previous->files.end() && old->second->size == size && old->second->lastWriteTime == lastWriteTime &&
+                        IsHeldOpen(*old->second) == holdOpen)
+                        info = old->second;
+                }
+                if (info == nullptr)
+                {
+                    info = MakeFileInfo(docRoot + relativePath, size, lastWriteTime, holdOpen);
+                    changed = true;
+                }
+
+                if (relativePath.ends_with(".html"))
+                {
+                    snapshot->pages.insert_or_assign(relativePath, info);
+                    snapshot->pages.insert_or_assign(relativePath.substr(0, relativePath.size() - 5), info);
+                }
+
+                snapshot->files.insert_or_assign(std::move(relativePath), std::move(info));
+            }
+
+            if (ec)
+                LOG_ERROR("[CORE] DocumentIndex: Error while walking document root '{0}': '{1}'", docRoot, ec.message());
+
+            // Link each file to its precompressed siblings ("app.js" -> "app.js.br" / "app.js.gz"). A sibling
+            // that is older than the file it was generated from is stale and is not used.
+            for (const auto& [relativePath, info] : snapshot->files)
+            {
+                std::string_view original = relativePath;
+                std::shared_ptr<const FileInfo> PrecompressedVariants::* variant = nullptr;
+
+                if (original.ends_with(".br"))
+                    variant = &PrecompressedVariants::brotli;
+                else if (original.ends_with(".gz"))
+                    variant = &PrecompressedVariants::gzip;
+                else
+                    continue;
+
+                original.remove_suffix(3);
+                auto source = snapshot->files.find(original);
+                if (source == snapshot->files.end())
+                    continue;
+
+                if (info->lastWriteTime < source->second->lastWriteTime)
+                {
+                    LOG_WARN("[CORE] DocumentIndex: Ignoring '{0}' because it is older than '{1}'", relativePath, original);
+                    continue;
+                }
+
+                snapshot->precompressed[std::string(original)].*variant = info;
+            }
+
+            if (previous == nullptr)
+                LOG_INFO("[CORE] DocumentIndex: Indexed {0} files in document root '{1}'", snapshot->files.size(), docRoot);
+
+            // Every file was carried over, so unless one was removed, this is the same index
+            if (!changed && snapshot->files.size() == previous->files.size())
+                return;
+
+            m_snapshot.store(std::move(snapshot));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] DocumentIndex::Build failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] DocumentIndex::Build failure. Caught unknown exception.");
+        }
+    }
+
+    void DocumentIndex::StartRefreshing(std::chrono::milliseconds interval) noexcept
+    {
+        if (interval.count() <= 0 || m_refreshThread.joinable())
+            return;
+
+        try
+        {
+            m_refreshThread = std::jthread([this, interval](std::stop_token stop) { RefreshLoop(stop, interval); });
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] DocumentIndex::StartRefreshing failure. Caught std::exception: \n'{0}'", e.what());
+        }
+    }
+    void DocumentIndex::StopRefreshing() noexcept
+    {
+        if (!m_refreshThread.joinable())
+            return;
+
+        m_refreshThread.request_stop();
+        m_refreshThread.join();
+    }
+
+    void DocumentIndex::RefreshLoop(std::stop_token stop, std::chrono::milliseconds interval) noexcept
+    {
+        // Walking the document root stats every file, which is far too slow to do on an io thread
+        while (!stop.stop_requested())
+        {
+            {
+                // Nothing ever notifies, the wait only ends early when a stop is requested
+                std::unique_lock lock(m_refreshMutex);
+                if (m_refreshWake.wait_for(lock, stop, interval, [&stop]() { return stop.stop_requested(); }))
+                    return;
+            }
+
+            std::shared_ptr<const Snapshot> snapshot = m_snapshot.load();
+            if (snapshot != nullptr)
+                Build(snapshot->docRoot);
+        }
+    }
+
+    std::shared_ptr<const FileInfo> DocumentIndex::Find(std::string_view relativePath) const noexcept
+    {
+        std::shared_ptr<const Snapshot> snapshot = m_snapshot.load();
+        if (snapshot == nullptr)
+            return nullptr;
+
+        auto itr = snapshot->files.find(relativePath);
+        return itr == snapshot->files.end() ? nullptr : itr->second;
+    }
+    std::shared_ptr<const FileInfo> DocumentIndex::FindPage(std::string_view relativePath) const noexcept
+    {
+        std::shared_ptr<const Snapshot> snapshot = m_snapshot.load();
+        if (snapshot == nullptr)
+            return nullptr;
+
+        auto itr = snapshot->pages.find(relativePath);
+        return itr == snapshot->pages.end() ? nullptr : itr->second;
+    }
+
+    PrecompressedVariants DocumentIndex::FindPrecompressed(std::string_view relativePath) const noexcept
+    {
+        std::shared_ptr<const Snapshot> snapshot = m_snapshot.load();
+        if (snapshot == nullptr)
+            return {};
+
+        auto itr = snapshot->precompressed.find(relativePath);
+        return itr == snapshot->precompressed.end() ? PrecompressedVariants{} : itr->second;
+    }
+
+    std::shared_ptr<FileInfo> DocumentIndex::MakeFileInfo(std::string path, std::uint64_t size, std::filesystem::file_time_type lastWriteTime, bool holdOpen) const
+    {
+        auto info = std::make_shared<FileInfo>();
+        info->mimeType = MimeType(path);
+        info->size = size;
+        info->lastWriteTime = lastWriteTime;
+        info->etag = std::format("\"{0:x}-{1:x}\"", size, static_cast<std::uint64_t>(lastWriteTime.time_since_epoch().count()));
+        info->lastModified = ToHTTPTime(lastWriteTime);
+        info->lastModifiedDate = FormatHTTPDate(info->lastModified);
+
+#ifdef PLATFORM_LINUX
+        if (holdOpen)
+        {
+            info->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (info->fd < 0)
+                LOG_WARN("[CORE] DocumentIndex: Failed to hold open file '{0}': '{1}'", path, std::strerror(errno));
+        }
+#endif
+
+        info->path = std::move(path);
+        return info;
+    }
+}
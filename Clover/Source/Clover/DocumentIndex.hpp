@@ -0,0 +1,127 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Return a reasonable mime type based on the extension of a file.
+    ND constexpr std::string_view MimeType(std::string_view path) noexcept
+    {
+        if (path.ends_with(".htm"))  return "text/html";
+        if (path.ends_with(".html")) return "text/html";
+        if (path.ends_with(".php"))  return "text/html";
+        if (path.ends_with(".css"))  return "text/css";
+        if (path.ends_with(".txt"))  return "text/plain";
+        if (path.ends_with(".js"))   return "application/javascript";
+        if (path.ends_with(".json")) return "application/json";
+        if (path.ends_with(".xml"))  return "application/xml";
+        if (path.ends_with(".swf"))  return "application/x-shockwave-flash";
+        if (path.ends_with(".flv"))  return "video/x-flv";
+        if (path.ends_with(".png"))  return "image/png";
+        if (path.ends_with(".jpe"))  return "image/jpeg";
+        if (path.ends_with(".jpeg")) return "image/jpeg";
+        if (path.ends_with(".jpg"))  return "image/jpeg";
+        if (path.ends_with(".gif"))  return "image/gif";
+        if (path.ends_with(".bmp"))  return "image/bmp";
+        if (path.ends_with(".ico"))  return "image/vnd.microsoft.icon";
+        if (path.ends_with(".tiff")) return "image/tiff";
+        if (path.ends_with(".tif"))  return "image/tiff";
+        if (path.ends_with(".svg"))  return "image/svg+xml";
+        if (path.ends_with(".svgz")) return "image/svg+xml";
+        if (path.ends_with(".gz"))   return "application/gzip";
+        if (path.ends_with(".br"))   return "application/x-brotli";
+        return "application/text";
+    }
+
+    // Everything we need to know about a file in the document root in order to serve it
+    struct FileInfo
+    {
+        FileInfo() noexcept = default;
+        FileInfo(const FileInfo&) = delete;
+        FileInfo& operator=(const FileInfo&) = delete;
+        ~FileInfo() noexcept;
+
+        std::string path;               // Filesystem path of the file (document root included)
+        std::uint64_t size = 0;
+        std::filesystem::file_time_type lastWriteTime;
+        std::string_view mimeType;
+        std::string etag;               // Strong ETag derived from the size and last write time
+        std::chrono::sys_seconds lastModified;
+        std::string lastModifiedDate;   // lastModified formatted for the Last-Modified header
+
+#ifdef PLATFORM_LINUX
+        // Only valid when the index was told to hold files open (see DocumentIndex::SetHoldFilesOpen)
+        int fd = -1;
+#endif
+    };
+
+    // Precompressed copies of a file that were found next to it in the document root
+    struct PrecompressedVariants
+    {
+        std::shared_ptr<const FileInfo> brotli;     // "<file>.br"
+        std::shared_ptr<const FileInfo> gzip;       // "<file>.gz"
+    };
+
+    // An in-memory index of every file in the document root. It is built once at startup and then
+    // periodically rebuilt on a background thread so that changes to the document root are picked up
+    // without walking the filesystem on an io thread. Resolving a request is a single hash lookup and
+    // does not touch the filesystem at all.
+    //
+    // Files are indexed by their path relative to the document root ("home/home.js"). In addition,
+    // html files are indexed as pages by both their full name and their name without the extension
+    // so that a request for "/home" and "/home.html" both resolve to "home.html". Precompressed
+    // siblings ("home.js.br", "home.js.gz") are linked to the file they were generated from.
+    //
+    // Find/FindPage/FindPrecompressed are safe to call concurrently from any of the io threads.
+    class DocumentIndex
+    {
+    public:
+        DocumentIndex() noexcept = default;
+        DocumentIndex(const DocumentIndex&) = delete;
+        DocumentIndex& operator=(const DocumentIndex&) = delete;
+        ~DocumentIndex() noexcept { StopRefreshing(); }
+
+        // Walk the document root and atomically replace the current index. Entries for files that
+        // have not changed are carried over from the previous index, and if nothing changed at all,
+        // the current index is kept.
+        void Build(const std::string& docRoot) noexcept;
+
+        // Rebuild the index every 'interval' on a thread of its own. An interval of 0 disables refreshing.
+        void StartRefreshing(std::chrono::milliseconds interval) noexcept;
+        void StopRefreshing() noexcept;
+
+        // 'relativePath' must not start with '/'
+        ND std::shared_ptr<const FileInfo> Find(std::string_view relativePath) const noexcept;
+        ND std::shared_ptr<const FileInfo> FindPage(std::string_view relativePath) const noexcept;
+        ND PrecompressedVariants FindPrecompressed(std::string_view relativePath) const noexcept;
+
+        ND inline bool IsBuilt() const noexcept { return m_snapshot.load() != nullptr; }
+
+        // On Linux, keep a read-only file descriptor open for every indexed file so that serving the file
+        // does not require an open() call (StaticFileBody sends from it and StaticAssetCache loads from it).
+        // Files already in the index are opened or closed on the next Build.
+        inline void SetHoldFilesOpen(bool hold) noexcept { m_holdFilesOpen.store(hold, std::memory_order_relaxed); }
+
+    private:
+        using FileMap = std::unordered_map<std::string, std::shared_ptr<const FileInfo>, string_hash, std::equal_to<>>;
+
+        struct Snapshot
+        {
+            std::string docRoot;
+            FileMap files;
+            FileMap pages;
+            std::unordered_map<std::string, PrecompressedVariants, string_hash, std::equal_to<>> precompressed;
+        };
+
+        ND std::shared_ptr<FileInfo> MakeFileInfo(std::string path, std::uint64_t size, std::filesystem::file_time_type lastWriteTime, bool holdOpen) const;
+        void RefreshLoop(std::stop_token stop, std::chrono::milliseconds interval) noexcept;
+
+        std::atomic<std::shared_ptr<const Snapshot>> m_snapshot;
+        std::mutex m_buildMutex;
+
+        std::atomic<bool> m_holdFilesOpen = false;
+
+        std::mutex m_refreshMutex;
+        std::condition_variable_any m_refreshWake;
+        std::jthread m_refreshThread;
+    };
+}
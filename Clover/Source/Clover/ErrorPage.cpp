@@ -0,0 +1,165 @@
+#include "pch.hpp"
+#include "ErrorPage.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    // Stands in for the reason while the template is rendered. It just needs to be something that will
+    // never show up in a real template.
+    static constexpr std::string_view s_reasonMarker = "\x1f__CLOVER_ERROR_REASON__\x1f";
+
+    // A second marker, to tell whether a page without the first one ignores the reason or transforms it
+    static constexpr std::string_view s_probeMarker = "\x1f__CLOVER_ERROR_PROBE__\x1f";
+
+    ErrorPage::ErrorPage(http::status status) noexcept :
+        m_status(status)
+    {}
+
+    void ErrorPage::Prepare(const DocumentIndex& index, TemplateCache& templates, std::string_view serverVersion) noexcept
+    {
+        m_rendered.store(Render(index, templates, serverVersion));
+    }
+
+    http::response<http::string_body> ErrorPage::Response(std::string_view reason, unsigned version, bool keepAlive,
+                                                          const DocumentIndex& index, TemplateCache& templates, std::string_view serverVersion)
+    {
+        PROFILE_SCOPE("ErrorPage::Response");
+
+        std::shared_ptr<const Rendered> rendered = m_rendered.load();
+
+        // Re-render if Prepare() was never called or the template has been modified since it was rendered
+        bool stale = rendered == nullptr;
+        if (!stale && !m_target.empty())
+        {
+            std::shared_ptr<const FileInfo> fileInfo = index.Find(m_target);
+            stale = fileInfo != nullptr && fileInfo->lastWriteTime != rendered->lastWriteTime;
+        }
+        if (stale)
+        {
+            rendered = Render(index, templates, serverVersion);
+            m_rendered.store(rendered);
+        }
+
+        http::response<http::string_body> res{ rendered->header };
+        res.version(version);
+        res.keep_alive(keepAlive);
+
+        std::string& body = res.body();
+        if (rendered->perRequest)
+        {
+            try
+            {
+                std::shared_ptr<const FileInfo> fileInfo = index.Find(m_target);
+                if (fileInfo != nullptr)
+                {
+                    json data = { { "reason", reason } };
+                    body = templates.Render(fileInfo->path, fileInfo->lastWriteTime, data);
+                    return res;
+                }
+            }
+            catch (const inja::RenderError& err)
+            {
+                LOG_ERROR("[CORE] ErrorPage: Caught inja::RenderError: Type = '{0}' | Message = '{1}'", err.type, err.message);
+                LOG_ERROR("[CORE]     The failure came while rendering error page '{0}'. Sending the page without the reason", rendered->path);
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] ErrorPage::Response failure. Caught std::exception: \n'{0}'", e.what());
+            }
+        }
+
+        if (rendered->segments.empty())
+        {
+            body = reason;
+            return res;
+        }
+
+        body.reserve(rendered->size + reason.size() * (rendered->segments.size() - 1));
+        body.append(rendered->segments[0]);
+        for (std::size_t iii = 1; iii < rendered->segments.size(); ++iii)
+        {
+            body += reason;
+            body += rendered->segments[iii];
+        }
+        return res;
+    }
+
+    std::shared_ptr<const ErrorPage::Rendered> ErrorPage::Render(const DocumentIndex& index, TemplateCache& templates, std::string_view serverVersion) const noexcept
+    {
+        PROFILE_SCOPE("ErrorPage::Render");
+
+        auto rendered = std::make_shared<Rendered>();
+        rendered->header.result(m_status);
+        rendered->header.set(http::field::server, serverVersion);
+        rendered->header.set(http::field::content_type, "text/html");
+
+        if (m_target.empty())
+            return rendered;
+
+        std::shared_ptr<const FileInfo> fileInfo = index.Find(m_target);
+        if (fileInfo == nullptr)
+        {
+            LOG_ERROR("[CORE] ErrorPage: File not found: '{0}'", m_target);
+            return rendered;
+        }
+        rendered->lastWriteTime = fileInfo->lastWriteTime;
+        rendered->path = fileInfo->path;
+
+        std::string html;
+        try
+        {
+            json data = { { "reason", std::string(s_reasonMarker) } };
+            html = templates.Render(fileInfo->path, fileInfo->lastWriteTime, data);
+
+            // No marker either means the page has no reason in it, or that the reason was changed on the way
+            // in. Only the second renders differently for a different reason.
+            if (html.find(s_reasonMarker) == std::string::npos)
+            {
+                data["reason"] = std::string(s_probeMarker);
+                std::string probe = templates.Render(fileInfo->path, fileInfo->lastWriteTime, data);
+                if (probe != html)
+                {
+                    LOG_WARN("[CORE] ErrorPage: '{0}' does not print 'reason' as is, so it will be rendered for every error instead of once", m_target);
+                    rendered->perRequest = true;
+                }
+            }
+        }
+        catch (const inja::RenderError& err)
+        {
+            LOG_ERROR("[CORE] ErrorPage: Caught inja::RenderError: Type = '{0}' | Message = '{1}'", err.type, err.message);
+            LOG_ERROR("[CORE]     The failure came while rendering error page '{0}'", fileInfo->path);
+            return rendered;
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] ErrorPage::Render failure. Caught std::exception: \n'{0}'", e.what());
+            return rendered;
+        }
+
+        // Split the page around each occurrence of the marker
+        try
+        {
+            std::string_view remaining = html;
+            std::size_t pos;
+            while ((pos = remaining.find(s_reasonMarker)) != std::string_view::npos)
+            {
+                rendered->segments.emplace_back(remaining.substr(0, pos));
+                remaining.remove_prefix(pos + s_reasonMarker.size());
+            }
+            rendered->segments.emplace_back(remaining);
+
+            for (const std::string& segment : rendered->segments)
+                rendered->size += segment.size();
+
+            LOG_TRACE("[CORE] ErrorPage: Rendered '{0}' ({1} places for the reason)", m_target, rendered->segments.size() - 1);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] ErrorPage::Render failure. Caught std::exception: \n'{0}'", e.what());
+            rendered->segments.clear();
+        }
+
+        return rendered;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "pch.hpp"
+#include "DocumentIndex.hpp"
+#include "TemplateCache.hpp"
+
+namespace Clover
+{
+    // An error page (400, 404, 500, ...) that is rendered once up front instead of once per error.
+    //
+    // The template is rendered with a marker in place of the 'reason' variable and the output is split
+    // around the marker, so producing the page for a given reason is just concatenating the pieces with
+    // the reason in between. The response header is built at the same time so that it only has to be
+    // copied. This keeps the error paths, which are exactly the ones that spike when a scanner floods
+    // us with bad requests, from paying for a template render each time.
+    //
+    // A template that does something with the reason other than print it (e.g. '{{ upper(reason) }}')
+    // never shows the marker, so those are detected when they are prepared and rendered per request instead.
+    //
+    // The page is re-rendered if the document index reports a new last write time for the template.
+    // Response is safe to call concurrently from any of the io threads.
+    class ErrorPage
+    {
+    public:
+        explicit ErrorPage(http::status status) noexcept;
+        ErrorPage(const ErrorPage&) = delete;
+        ErrorPage& operator=(const ErrorPage&) = delete;
+
+        // Path of the template relative to the document root. An empty target means the body is just the
+        // reason. Should only be called during setup, before Run().
+        inline void SetTarget(std::string_view target) noexcept { m_target = target; }
+
+        // Render the template and build the header. Should be called once the document index is built.
+        void Prepare(const DocumentIndex& index, TemplateCache& templates, std::string_view serverVersion) noexcept;
+
+        // Build the response for 'reason' from the prebuilt header and the pre-rendered pieces of the page.
+        // Re-renders the page first if the template has been modified. The payload is not prepared so
+        // that the caller can still compress the body.
+        ND http::response<http::string_body> Response(std::string_view reason, unsigned version, bool keepAlive,
+                                                      const DocumentIndex& index, TemplateCache& templates, std::string_view serverVersion);
+
+    private:
+        struct Rendered
+        {
+            std::filesystem::file_time_type lastWriteTime;
+
+            // The rendered template split around each occurrence of the reason. A page that does not use
+            // the reason has a single segment. No segments means the body is just the reason.
+            std::vector<std::string> segments;
+            std::size_t size = 0;
+
+            // Set when the template uses the reason but the marker did not survive rendering, in which case
+            // the page is rendered with the real reason for every response
+            bool perRequest = false;
+            std::string path;
+
+            http::response_header<> header;
+        };
+
+        ND std::shared_ptr<const Rendered> Render(const DocumentIndex& index, TemplateCache& templates, std::string_view serverVersion) const noexcept;
+
+        http::status m_status;
+        std::string m_target;
+        std::atomic<std::shared_ptr<const Rendered>> m_rendered;
+    };
+}
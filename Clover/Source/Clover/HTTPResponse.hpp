@@ -0,0 +1,27 @@
+#pragma once
+#include "pch.hpp"
+#include "SharedBody.hpp"
+#include "StaticFileBody.hpp"
+
+namespace Clover
+{
+    using StringResponse = http::response<http::string_body>;
+    using EmptyResponse = http::response<http::empty_body>;
+    using SharedResponse = http::response<SharedBody>;
+
+    // Every response the server sends is one of these. They are not type erased into an
+    // http::message_generator until they are written, so that middleware can still read and change the
+    // header of any response (see MiddlewarePipeline), and so that the session can send the body of a
+    // StaticFileResponse with sendfile(2).
+    using HTTPResponse = std::variant<StringResponse, EmptyResponse, SharedResponse, StaticFileResponse>;
+
+    // The header of a response, whatever its body type
+    ND inline http::response_header<>& ResponseHeader(HTTPResponse& response) noexcept
+    {
+        return std::visit([](auto& res) -> http::response_header<>& { return res; }, response);
+    }
+    ND inline const http::response_header<>& ResponseHeader(const HTTPResponse& response) noexcept
+    {
+        return std::visit([](const auto& res) -> const http::response_header<>& { return res; }, response);
+    }
+}
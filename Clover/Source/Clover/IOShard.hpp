@@ -0,0 +1,36 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // One io_context and the thread that runs it, when the server is sharded (see Application::SetIOSharding).
+    // Each shard has its own SO_REUSEPORT listener, so the kernel spreads new connections across the
+    // shards, and a connection stays on the shard that accepted it for its whole life. Since only one
+    // thread ever runs the io_context, connections don't need strands.
+    struct IOShard
+    {
+        explicit IOShard(unsigned int _index) noexcept :
+            index(_index),
+            ioc(1)
+        {}
+        IOShard(const IOShard&) = delete;
+        IOShard& operator=(const IOShard&) = delete;
+
+        unsigned int index;
+        net::io_context ioc;
+
+        // Only written by the shard's own thread, but may be read from anywhere
+        std::atomic<std::uint64_t> connectionsAccepted = 0;
+        std::atomic<std::uint64_t> acceptErrors = 0;
+        std::atomic<std::uint64_t> requestsHandled = 0;
+    };
+
+    // A snapshot of a shard's counters
+    struct IOShardStats
+    {
+        unsigned int index;
+        std::uint64_t connectionsAccepted;
+        std::uint64_t acceptErrors;
+        std::uint64_t requestsHandled;
+    };
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // What the connections on a listening endpoint are expected to speak
+    enum class ListenerProtocol
+    {
+        // Peek at the start of each connection to tell TLS from plain HTTP (see DetectSession). Lets one
+        // port serve both, at the cost of an extra async read, a timer, and an allocation per connection.
+        Detect,
+
+        // Plain HTTP only. Connections go straight to a PlainHTTPSession
+        Plain,
+
+        // HTTPS only. Connections go straight to an SSLHTTPSession, which starts with the handshake
+        TLS
+    };
+
+    ND constexpr std::string_view ListenerProtocolName(ListenerProtocol protocol) noexcept
+    {
+        switch (protocol)
+        {
+        case ListenerProtocol::Detect: return "detect";
+        case ListenerProtocol::Plain: return "http";
+        case ListenerProtocol::TLS: return "https";
+        }
+        return "unknown";
+    }
+
+    struct ListenerOptions
+    {
+        ListenerProtocol protocol = ListenerProtocol::Detect;
+
+        // Linux only (TCP_DEFER_ACCEPT). The kernel holds on to a new connection until the client has sent
+        // something, or until 'deferAcceptTimeout' has passed, so the first read of a connection finds data
+        // waiting and connections that are opened but never used don't wake the server.
+        bool deferAccept = false;
+        std::chrono::seconds deferAcceptTimeout = std::chrono::seconds(5);
+
+        // Disable Nagle's algorithm (TCP_NODELAY) on accepted connections, so a small response is sent
+        // right away instead of waiting for the previous segment to be acknowledged
+        bool noDelay = false;
+    };
+
+    struct ListenerEndpoint
+    {
+        tcp::endpoint endpoint;
+        ListenerOptions options;
+    };
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include "pch.hpp"
+#include "Log.hpp"
+#include "RequestBody.hpp"
+#include "RequestContext.hpp"
+#include "HTTPResponse.hpp"
+
+namespace Clover
+{
+    // A middleware stage is any type with one or more of:
+    //
+    //   std::optional<HTTPResponse> OnHeader(const HTTPRequest& req, RequestContext& context);
+    //      Called as soon as the header of a request has been read, before any of its body (only the header
+    //      of 'req' is filled in). A stage that can decide from the header alone (401 for a failed auth
+    //      check, 429 for a rate limit) should do it here, so that an upload it turns away is never read.
+    //      Returning a response answers the request, and the remaining stages, the body, and the target
+    //      are skipped. If the request has a body, the connection is closed after the response.
+    //
+    //   std::optional<HTTPResponse> Before(HTTPRequest& req, RequestContext& context);
+    //      Called before the request is dispatched. The stage may modify the request (rewrite the target,
+    //      add a header, set a deadline on the context) or answer it itself by returning a response
+    //      (401 for a failed auth check, 429 for a rate limit), in which case the remaining stages and
+    //      the target are skipped.
+    //
+    //   void After(const RequestContext& context, http::status status, http::fields& header);
+    //      Called once the response is ready, just before it is queued for writing (for metrics, logging,
+    //      or adding a header). Called for every response, including one returned by an earlier stage and
+    //      the ones the server answers with on its own (413, a 503 for a shed request, ...). The header may
+    //      be changed, except for the fields that describe the body (Content-Length, Transfer-Encoding,
+    //      Content-Encoding), which have already been set.
+    //
+    // A stage without a hook costs nothing for that phase. Stages are shared by every io thread, so
+    // they must be safe to call concurrently.
+    template<class T>
+    concept HasHeaderStage = requires(T& stage, const HTTPRequest& req, RequestContext& context)
+    {
+        { stage.OnHeader(req, context) } -> std::convertible_to<std::optional<HTTPResponse>>;
+    };
+
+    template<class T>
+    concept HasBeforeStage = requires(T& stage, HTTPRequest& req, RequestContext& context)
+    {
+        { stage.Before(req, context) } -> std::convertible_to<std::optional<HTTPResponse>>;
+    };
+
+    template<class T>
+    concept HasAfterStage = requires(T& stage, const RequestContext& context, http::status status, http::fields& header)
+    {
+        stage.After(context, status, header);
+    };
+
+    template<class T>
+    concept MiddlewareStage = HasHeaderStage<T> || HasBeforeStage<T> || HasAfterStage<T>;
+
+    // The type erased face of a MiddlewarePipeline, so that Application does not need to know the
+    // stages. This is the only indirect call: one per phase per request, not one per stage.
+    class MiddlewareChain
+    {
+    public:
+        virtual ~MiddlewareChain() noexcept = default;
+
+        ND virtual std::optional<HTTPResponse> OnHeader(const HTTPRequest& req, RequestContext& context) = 0;
+        ND virtual std::optional<HTTPResponse> Before(HTTPRequest& req, RequestContext& context) = 0;
+        virtual void After(const RequestContext& context, http::status status, http::fields& header) noexcept = 0;
+
+        // False if no stage has an OnHeader hook, so the session can skip the call
+        ND virtual bool HasHeaderStages() const noexcept = 0;
+    };
+
+    // A fixed list of stages composed at compile time. OnHeader and Before run the stages in order and After
+    // runs them in reverse, so the first stage wraps all of the others. Each call is resolved statically,
+    // so stages are inlined into the pipeline.
+    template<MiddlewareStage... Stages>
+    class MiddlewarePipeline final : public MiddlewareChain
+    {
+    public:
+        explicit MiddlewarePipeline(Stages... stages) :
+            m_stages(std::move(stages)...)
+        {}
+
+        ND std::optional<HTTPResponse> OnHeader(const HTTPRequest& req, RequestContext& context) override
+        {
+            std::optional<HTTPResponse> response;
+            std::apply([&](auto&... stage) { (RunOnHeader(stage, req, context, response) || ...); }, m_stages);
+            return response;
+        }
+
+        ND std::optional<HTTPResponse> Before(HTTPRequest& req, RequestContext& context) override
+        {
+            std::optional<HTTPResponse> response;
+            std::apply([&](auto&... stage) { (RunBefore(stage, req, context, response) || ...); }, m_stages);
+            return response;
+        }
+
+        void After(const RequestContext& context, http::status status, http::fields& header) noexcept override
+        {
+            RunAfter<sizeof...(Stages)>(context, status, header);
+        }
+
+        ND bool HasHeaderStages() const noexcept override { return (HasHeaderStage<Stages> || ...); }
+
+        // Access to a stage, e.g. to read the counters of a metrics stage
+        template<class Stage>
+        ND Stage& Get() noexcept { return std::get<Stage>(m_stages); }
+
+    private:
+        // Returns true if the stage answered the request
+        template<class Stage>
+        static bool RunOnHeader(Stage& stage, const HTTPRequest& req, RequestContext& context, std::optional<HTTPResponse>& response)
+        {
+            if constexpr (HasHeaderStage<Stage>)
+            {
+                response = stage.OnHeader(req, context);
+                return response.has_value();
+            }
+            else
+                return false;
+        }
+
+        // Returns true if the stage answered the request
+        template<class Stage>
+        static bool RunBefore(Stage& stage, HTTPRequest& req, RequestContext& context, std::optional<HTTPResponse>& response)
+        {
+            if constexpr (HasBeforeStage<Stage>)
+            {
+                response = stage.Before(req, context);
+                return response.has_value();
+            }
+            else
+                return false;
+        }
+
+        template<std::size_t I>
+        void RunAfter(const RequestContext& context, http::status status, http::fields& header) noexcept
+        {
+            if constexpr (I > 0)
+            {
+                using Stage = std::tuple_element_t<I - 1, std::tuple<Stages...>>;
+                if constexpr (HasAfterStage<Stage>)
+                {
+                    try
+                    {
+                        std::get<I - 1>(m_stages).After(context, status, header);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LOG_ERROR("[CORE] Middleware After stage failed. Caught std::exception: \n'{0}'", e.what());
+                    }
+                    catch (...)
+                    {
+                        LOG_ERROR("[CORE] Middleware After stage failed. Caught unknown exception.");
+                    }
+                }
+                RunAfter<I - 1>(context, status, header);
+            }
+        }
+
+        std::tuple<Stages...> m_stages;
+    };
+}
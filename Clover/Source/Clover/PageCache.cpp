@@ -0,0 +1,337 @@
+#include "pch.hpp"
+#include "PageCache.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    PageCache::PageCache(ComputePool& pool) noexcept :
+        m_pool(pool)
+    {}
+
+    std::shared_ptr<const CachedPage> PageCache::Get(const std::string& key, const Options& options, const BuildFn& build)
+    {
+        PROFILE_SCOPE("PageCache::Get");
+
+        std::shared_ptr<const CachedPage> page;
+        std::uint64_t generation = 0;
+        switch (Lookup(key, options, build, page, nullptr, generation))
+        {
+        case LookupResult::Hit:         return page;
+        case LookupResult::MustBuild:   return Build(key, options, build, generation);
+
+        // Somebody else is already building this page, but waiting on them could block an io thread
+        case LookupResult::Building:
+        case LookupResult::Uncacheable: return build();
+        }
+        return build();
+    }
+
+    void PageCache::AsyncGet(const std::string& key, const Options& options, BuildFn build, PageHandler handler, std::optional<ComputePriority> buildPriority)
+    {
+        PROFILE_SCOPE("PageCache::AsyncGet");
+
+        std::shared_ptr<const CachedPage> page;
+        std::uint64_t generation = 0;
+        LookupResult result = Lookup(key, options, build, page, &handler, generation);
+
+        ComputePool::Task task;
+        switch (result)
+        {
+        case LookupResult::Hit:
+            handler(std::move(page), nullptr);
+            return;
+
+        // The handler is parked on the entry and is called once the build in flight completes
+        case LookupResult::Building:
+            return;
+
+        // The handler is parked on the entry as well, so it is called by Build along with everyone else
+        case LookupResult::MustBuild:
+            task = [this, key, options, build = std::move(build), generation]()
+                {
+                    try
+                    {
+                        boost::ignore_unused(Build(key, options, build, generation));
+                    }
+                    catch (...)
+                    {
+                        // Already handed to the waiters
+                    }
+                };
+            break;
+
+        case LookupResult::Uncacheable:
+            task = [build = std::move(build), handler = std::move(handler)]()
+                {
+                    std::shared_ptr<const CachedPage> page;
+                    std::exception_ptr error;
+                    try
+                    {
+                        page = build();
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                    }
+                    handler(std::move(page), error);
+                };
+            break;
+        }
+
+        if (buildPriority.has_value() && m_pool.Submit(task, *buildPriority))
+            return;
+        task();
+    }
+
+    PageCache::LookupResult PageCache::Lookup(const std::string& key, const Options& options, const BuildFn& build,
+                                              std::shared_ptr<const CachedPage>& page, PageHandler* waiter, std::uint64_t& generation)
+    {
+        std::lock_guard lock(m_mutex);
+
+        auto now = Clock::now();
+        auto itr = m_entries.find(key);
+
+        if (itr != m_entries.end())
+        {
+            Entry& entry = itr->second;
+
+            // Fresh hit
+            if (entry.page && now < entry.expires)
+            {
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                page = entry.page;
+                return LookupResult::Hit;
+            }
+
+            // Stale hit - serve the stale page and make sure exactly one refresh is in flight
+            if (entry.page && now < entry.staleUntil)
+            {
+                m_staleHits.fetch_add(1, std::memory_order_relaxed);
+
+                if (!entry.building)
+                {
+                    // Queued as batch work so that refreshes don't get ahead of requests somebody is waiting on
+                    entry.building = m_pool.Submit([this, key, options, build, generation = entry.generation]() { Refresh(key, options, build, generation); },
+                                                   ComputePriority::Batch);
+                }
+                page = entry.page;
+                return LookupResult::Hit;
+            }
+
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            if (entry.building)
+            {
+                if (waiter != nullptr)
+                    entry.waiters.push_back(std::move(*waiter));
+                return LookupResult::Building;
+            }
+        }
+        else
+        {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+
+            if (m_entries.size() >= m_maxEntries)
+            {
+                EvictExpired(now);
+
+                // If the cache is still full, don't cache this page at all
+                if (m_entries.size() >= m_maxEntries)
+                {
+                    LOG_TRACE("[CORE] PageCache: Cache is full ({0} entries). Not caching '{1}'", m_entries.size(), key);
+                    return LookupResult::Uncacheable;
+                }
+            }
+        }
+
+        Entry& entry = m_entries[key];
+        entry.building = true;
+        generation = entry.generation;
+        if (waiter != nullptr)
+            entry.waiters.push_back(std::move(*waiter));
+        return LookupResult::MustBuild;
+    }
+
+    std::shared_ptr<const CachedPage> PageCache::Build(const std::string& key, const Options& options, const BuildFn& build, std::uint64_t generation)
+    {
+        PROFILE_SCOPE("PageCache::Build");
+
+        std::shared_ptr<const CachedPage> page;
+        std::exception_ptr error;
+        try
+        {
+            page = build();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        std::vector<PageHandler> waiters;
+        {
+            std::lock_guard lock(m_mutex);
+            auto itr = m_entries.find(key);
+            if (itr != m_entries.end())
+            {
+                Entry& entry = itr->second;
+                waiters = std::move(entry.waiters);
+                entry.waiters.clear();
+                entry.building = false;
+
+                // An entry that was invalidated while the page was built has no page left (see Invalidate)
+                // and must not get this one, so it is dropped like one whose first build failed
+                if (error == nullptr && entry.generation == generation)
+                {
+                    auto now = Clock::now();
+                    entry.page = page;
+                    entry.stored = now;
+                    entry.expires = now + options.ttl;
+                    entry.staleUntil = entry.expires + options.staleWhileRevalidate;
+                }
+                else if (!entry.page)
+                    m_entries.erase(itr);
+            }
+        }
+
+        // Everyone waiting on this build sees the same page, or the same failure
+        for (PageHandler& waiter : waiters)
+        {
+            try
+            {
+                waiter(page, error);
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] PageCache::Build failure. A waiter for '{0}' threw std::exception: \n'{1}'", key, e.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR("[CORE] PageCache::Build failure. A waiter for '{0}' threw an unknown exception.", key);
+            }
+        }
+
+        if (error != nullptr)
+            std::rethrow_exception(error);
+        return page;
+    }
+
+    void PageCache::Refresh(const std::string& key, const Options& options, const BuildFn& build, std::uint64_t generation) noexcept
+    {
+        try
+        {
+            boost::ignore_unused(Build(key, options, build, generation));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_WARN("[CORE] PageCache: Background refresh of '{0}' failed: '{1}'. Continuing to serve the stale page.", key, e.what());
+        }
+        catch (...)
+        {
+            LOG_WARN("[CORE] PageCache: Background refresh of '{0}' failed with an unknown exception. Continuing to serve the stale page.", key);
+        }
+    }
+
+    std::shared_ptr<const CachedPage> PageCache::Peek(std::string_view key) noexcept
+    {
+        std::lock_guard lock(m_mutex);
+
+        auto itr = m_entries.find(key);
+        return itr != m_entries.end() ? itr->second.page : nullptr;
+    }
+    void PageCache::Remember(const std::string& key, std::chrono::milliseconds maxAge, const BuildFn& make) noexcept
+    {
+        try
+        {
+            // Don't step on a page that Get is managing, and don't replace a copy that is recent enough
+            auto isWanted = [maxAge](const Entry& entry, Clock::time_point now)
+                {
+                    if (entry.building || now < entry.staleUntil)
+                        return false;
+                    return !entry.page || now - entry.stored >= maxAge;
+                };
+
+            {
+                std::lock_guard lock(m_mutex);
+                auto itr = m_entries.find(key);
+                if (itr != m_entries.end() && !isWanted(itr->second, Clock::now()))
+                    return;
+            }
+
+            // Made outside of the lock. If two threads get here at the same time, the second copy wins.
+            std::shared_ptr<const CachedPage> page = make();
+
+            std::lock_guard lock(m_mutex);
+
+            auto now = Clock::now();
+            auto itr = m_entries.find(key);
+            if (itr == m_entries.end())
+            {
+                if (m_entries.size() >= m_maxEntries)
+                {
+                    EvictExpired(now);
+                    if (m_entries.size() >= m_maxEntries)
+                        return;
+                }
+                itr = m_entries.emplace(key, Entry{}).first;
+            }
+            else if (itr->second.building || now < itr->second.staleUntil)
+                return;
+
+            itr->second.page = std::move(page);
+            itr->second.stored = now;
+            itr->second.expires = itr->second.staleUntil = Clock::time_point::min();
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] PageCache::Remember failure. Caught std::exception: \n'{0}'", e.what());
+        }
+    }
+
+    void PageCache::Invalidate(std::string_view key) noexcept
+    {
+        std::lock_guard lock(m_mutex);
+
+        auto itr = m_entries.find(key);
+        if (itr == m_entries.end())
+            return;
+
+        // An in flight build still needs the entry to hand its result to the waiters, so keep it but make
+        // sure that result is not published (see Build)
+        if (itr->second.building)
+            Expire(itr->second);
+        else
+            m_entries.erase(itr);
+    }
+    void PageCache::Clear() noexcept
+    {
+        std::lock_guard lock(m_mutex);
+
+        for (auto itr = m_entries.begin(); itr != m_entries.end();)
+        {
+            // An in flight build still needs the entry to hand its result to the waiters (see Invalidate)
+            if (itr->second.building)
+            {
+                Expire(itr->second);
+                ++itr;
+            }
+            else
+                itr = m_entries.erase(itr);
+        }
+    }
+
+    void PageCache::Expire(Entry& entry) noexcept
+    {
+        ++entry.generation;
+        entry.page.reset();
+        entry.expires = entry.staleUntil = Clock::time_point::min();
+    }
+
+    void PageCache::EvictExpired(Clock::time_point now) noexcept
+    {
+        std::erase_if(m_entries,
+            [now](const auto& item)
+            {
+                return now >= item.second.staleUntil && !item.second.building;
+            });
+    }
+}
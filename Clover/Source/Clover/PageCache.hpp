@@ -0,0 +1,171 @@
+#pragma once
+#include "pch.hpp"
+#include "ComputePool.hpp"
+
+namespace Clover
+{
+    // A fully rendered page that can be sent to any number of clients
+    struct CachedPage
+    {
+        std::shared_ptr<const std::string> body;
+        std::string contentType = "text/html";
+        std::string etag;               // Weak ETag derived from the body
+        std::shared_ptr<const std::string> gzipBody;    // Compressed copy of the body, if it is large enough to be worth it
+    };
+
+    // Output cache for rendered pages. Pages are keyed by the target plus the canonicalized
+    // parameters (see MakeKey) so that a hit skips both data gathering and rendering.
+    //
+    //  - When several requests miss on the same key at the same time, only one of them calls the
+    //    BuildFn. Callers of AsyncGet that arrive while it runs are parked on the entry and called
+    //    back with its result. Nothing ever waits on another build, so an io thread is never blocked.
+    //  - When an entry has expired but is still within its stale-while-revalidate window, the
+    //    stale page is returned immediately and a single refresh is queued on the compute pool
+    //    (as batch work), so a refresh can't be stuck behind the io threads that are serving it.
+    //
+    // All public methods are safe to call concurrently from any thread.
+    class PageCache
+    {
+    public:
+        struct Options
+        {
+            // How long a page is served without being rebuilt
+            std::chrono::milliseconds ttl{ 1000 };
+
+            // How long after expiring a page may still be served while it is rebuilt in the background
+            std::chrono::milliseconds staleWhileRevalidate{ 0 };
+        };
+
+        // IMPORTANT: A BuildFn may be invoked on another thread after the request that created it has
+        //            completed (background refresh), so it must own everything it references.
+        using BuildFn = std::function<std::shared_ptr<const CachedPage>()>;
+
+        // Called with the page, or with the exception thrown by the BuildFn
+        using PageHandler = std::function<void(std::shared_ptr<const CachedPage> page, std::exception_ptr error)>;
+
+        // Stale pages are refreshed on 'pool'. If it is not running, they are served until they run
+        // out of stale time and are then rebuilt by the next request.
+        explicit PageCache(ComputePool& pool) noexcept;
+
+        // Returns the cached page for 'key', building it first if necessary. Any exception thrown by
+        // 'build' is rethrown to the caller. If another build of the same page is already in flight,
+        // this builds its own copy rather than wait for it.
+        ND std::shared_ptr<const CachedPage> Get(const std::string& key, const Options& options, const BuildFn& build);
+
+        // Same as Get, but a caller that arrives while the page is being built is called back with the
+        // result of that build instead of building another copy. 'handler' is called exactly once: before
+        // this returns on a hit, or otherwise from the thread that builds the page. A miss is built on the
+        // calling thread, or on the compute pool if 'buildPriority' is set and the pool is running.
+        void AsyncGet(const std::string& key, const Options& options, BuildFn build, PageHandler handler,
+                      std::optional<ComputePriority> buildPriority = std::nullopt);
+
+        // The most recent page for 'key', no matter how old it is, or nullptr. Never builds anything. Used
+        // as a fallback when building a fresh page is taking too long (see TargetOptions::onDeadline).
+        ND std::shared_ptr<const CachedPage> Peek(std::string_view key) noexcept;
+
+        // Keep a page that was rendered outside of the cache so that Peek can fall back to it. The entry
+        // starts out expired, so Get never serves it as fresh, and it is the first to go when the cache is full.
+        // 'make' is only called (and the page only copied) if there is no copy yet, or the copy that is kept
+        // is older than 'maxAge', so a busy target doesn't pay for a copy on every response.
+        void Remember(const std::string& key, std::chrono::milliseconds maxAge, const BuildFn& make) noexcept;
+
+        // Drop the page for 'key', or every page. A build that is in flight still hands its page to the
+        // callers waiting on it, but the page is not kept, so the next lookup builds it again.
+        void Invalidate(std::string_view key) noexcept;
+        void Clear() noexcept;
+
+        // Upper bound on the number of cached pages. Should only be called during setup, before Run().
+        inline void SetMaxEntries(std::size_t maxEntries) noexcept { m_maxEntries = maxEntries; }
+
+        ND inline std::uint64_t Hits() const noexcept { return m_hits.load(std::memory_order_relaxed); }
+        ND inline std::uint64_t StaleHits() const noexcept { return m_staleHits.load(std::memory_order_relaxed); }
+        ND inline std::uint64_t Misses() const noexcept { return m_misses.load(std::memory_order_relaxed); }
+
+        // Build a cache key from the target and the parameters. The parameters are sorted by key so
+        // that '/a?x=1&y=2' and '/a?y=2&x=1' share the same entry. The parameters have already been
+        // decoded, so '&', '=' and '%' in a name or value are escaped again; otherwise '?a=1%26b%3D2'
+        // would get the same key as '?a=1&b=2'.
+        template<typename ParametersMap>
+        ND static std::string MakeKey(std::string_view target, const ParametersMap& parameters)
+        {
+            std::string key(target);
+            if (parameters.empty())
+                return key;
+
+            std::vector<std::pair<std::string_view, std::string_view>> sorted(parameters.begin(), parameters.end());
+            std::sort(sorted.begin(), sorted.end());
+
+            char separator = '?';
+            for (const auto& [name, value] : sorted)
+            {
+                key += separator;
+                AppendEscaped(key, name);
+                key += '=';
+                AppendEscaped(key, value);
+                separator = '&';
+            }
+            return key;
+        }
+
+    private:
+        static void AppendEscaped(std::string& key, std::string_view text)
+        {
+            for (char c : text)
+            {
+                switch (c)
+                {
+                case '%': key += "%25"; break;
+                case '&': key += "%26"; break;
+                case '=': key += "%3D"; break;
+                default:  key += c;     break;
+                }
+            }
+        }
+
+        using Clock = std::chrono::steady_clock;
+
+        struct Entry
+        {
+            std::shared_ptr<const CachedPage> page;
+            Clock::time_point expires;
+            Clock::time_point staleUntil;
+            Clock::time_point stored;       // When the page was last replaced
+
+            // True from the moment a build (or a background refresh) is started until it has published
+            // its result. The callers of AsyncGet that are waiting on it are kept in 'waiters'.
+            bool building = false;
+            std::vector<PageHandler> waiters;
+
+            // Bumped by Invalidate and Clear. A build remembers the generation it started in and only
+            // publishes its page if it is unchanged, since the page was made from data gathered before
+            std::uint64_t generation = 0;
+        };
+
+        // What a lookup found. On a hit, 'page' is set. When the page is being built, or has to be built by
+        // the caller, 'waiter' (if given) is parked on the entry. An uncacheable page is built but not kept.
+        // On MustBuild, 'generation' is the entry's generation, which has to be passed on to Build.
+        enum class LookupResult { Hit, Building, MustBuild, Uncacheable };
+        ND LookupResult Lookup(const std::string& key, const Options& options, const BuildFn& build,
+                               std::shared_ptr<const CachedPage>& page, PageHandler* waiter, std::uint64_t& generation);
+
+        // Calls 'build', publishes the result, and hands it to everyone waiting on the entry. Rethrows
+        // any exception thrown by 'build' after the waiters have seen it. If the entry was invalidated
+        // since 'generation', the waiters still get the page but it is not kept.
+        ND std::shared_ptr<const CachedPage> Build(const std::string& key, const Options& options, const BuildFn& build, std::uint64_t generation);
+        void Refresh(const std::string& key, const Options& options, const BuildFn& build, std::uint64_t generation) noexcept;
+        void EvictExpired(Clock::time_point now) noexcept;
+
+        // Drop the page of an entry that is being built, so the build in flight can't publish it
+        static void Expire(Entry& entry) noexcept;
+
+        ComputePool& m_pool;
+        std::size_t m_maxEntries = 1024;
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, Entry, string_hash, std::equal_to<>> m_entries;
+
+        std::atomic<std::uint64_t> m_hits = 0;
+        std::atomic<std::uint64_t> m_staleHits = 0;
+        std::atomic<std::uint64_t> m_misses = 0;
+    };
+}
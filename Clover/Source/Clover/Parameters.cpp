@@ -0,0 +1,157 @@
+#include "pch.hpp"
+#include "Parameters.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    // Character classes for the query string scanner. Everything that is not a delimiter or the start
+    // of an escape is 0, so the scanner can skip over ordinary characters with a single table lookup.
+    enum : std::uint8_t
+    {
+        Ordinary = 0,
+        Separator = 1,  // '&' (and ';', which some older clients use)
+        Equals = 2,     // '='
+        Escape = 4      // '%' or '+'
+    };
+
+    static constexpr std::array<std::uint8_t, 256> s_queryClass = []()
+        {
+            std::array<std::uint8_t, 256> table{};
+            table[static_cast<unsigned char>('&')] = Separator;
+            table[static_cast<unsigned char>(';')] = Separator;
+            table[static_cast<unsigned char>('=')] = Equals;
+            table[static_cast<unsigned char>('%')] = Escape;
+            table[static_cast<unsigned char>('+')] = Escape;
+            return table;
+        }();
+
+    // Value of a hex digit, or -1
+    static constexpr std::array<std::int8_t, 256> s_hexValue = []()
+        {
+            std::array<std::int8_t, 256> table{};
+            for (auto& value : table)
+                value = -1;
+            for (int iii = 0; iii < 10; ++iii)
+                table['0' + iii] = static_cast<std::int8_t>(iii);
+            for (int iii = 0; iii < 6; ++iii)
+            {
+                table['a' + iii] = static_cast<std::int8_t>(10 + iii);
+                table['A' + iii] = static_cast<std::int8_t>(10 + iii);
+            }
+            return table;
+        }();
+
+    void Parameters::Parse(std::string_view query)
+    {
+        PROFILE_SCOPE("Parameters::Parse");
+
+        // Only reserve decode storage if there is anything to decode. Reserving the full length of the
+        // query guarantees the storage never reallocates while we hand out views into it.
+        if (query.find_first_of("%+") != std::string_view::npos)
+            m_storage.reserve(m_storage.size() + query.size());
+
+        std::size_t start = 0;
+        while (start < query.size())
+        {
+            // Scan one "key=value" pair, noting where the '=' is and whether anything needs decoding
+            std::size_t equals = std::string_view::npos;
+            std::uint8_t seen = 0;
+            std::size_t end = start;
+            for (; end < query.size(); ++end)
+            {
+                std::uint8_t cls = s_queryClass[static_cast<unsigned char>(query[end])];
+                if (cls == Ordinary)
+                    continue;
+                if (cls == Separator)
+                    break;
+                if (cls == Equals && equals == std::string_view::npos)
+                    equals = end;
+                seen |= cls;
+            }
+
+            std::size_t pairStart = start;
+            std::string_view pair = query.substr(start, end - start);
+            start = end + 1;
+
+            if (pair.empty())
+                continue;
+
+            // A key without an '=' is not an error we can recover a value from, so skip it
+            if (equals == std::string_view::npos)
+            {
+                LOG_WARN("[CORE] Parsing parameters failed because there is no '=' for key '{0}': '{1}'", pair, query);
+                continue;
+            }
+
+            std::string_view key = pair.substr(0, equals - pairStart);
+            std::string_view value = pair.substr(key.size() + 1);
+            if (seen & Escape)
+            {
+                key = Decode(key);
+                value = Decode(value);
+            }
+
+            if (!emplace(key, value))
+                LOG_WARN("[CORE] Parsing parameters failed because this is the second time the key '{0}' was found. Skipping second occurrence. Parameters: {1}", key, query);
+        }
+    }
+
+    Parameters::const_iterator Parameters::find(std::string_view key) const noexcept
+    {
+        return std::find_if(m_params.begin(), m_params.end(),
+            [key](const value_type& param) { return param.first == key; });
+    }
+
+    std::string_view Parameters::at(std::string_view key) const
+    {
+        const_iterator itr = find(key);
+        if (itr == end())
+            throw std::out_of_range(std::format("Parameters::at: No parameter named '{0}'", key));
+        return itr->second;
+    }
+
+    void Parameters::insert_or_assign(std::string_view key, std::string_view value)
+    {
+        auto itr = std::find_if(m_params.begin(), m_params.end(),
+            [key](const value_type& param) { return param.first == key; });
+        if (itr != m_params.end())
+            itr->second = value;
+        else
+            m_params.emplace_back(key, value);
+    }
+
+    bool Parameters::emplace(std::string_view key, std::string_view value)
+    {
+        if (contains(key))
+            return false;
+        m_params.emplace_back(key, value);
+        return true;
+    }
+
+    std::string_view Parameters::Decode(std::string_view encoded) noexcept
+    {
+        if (encoded.find_first_of("%+") == std::string_view::npos)
+            return encoded;
+
+        // Parse() reserved enough space for this, so none of these push_backs reallocate
+        std::size_t offset = m_storage.size();
+        for (std::size_t iii = 0; iii < encoded.size(); ++iii)
+        {
+            char c = encoded[iii];
+            if (c == '+')
+                c = ' ';
+            else if (c == '%' && iii + 2 < encoded.size() &&
+                     s_hexValue[static_cast<unsigned char>(encoded[iii + 1])] >= 0 &&
+                     s_hexValue[static_cast<unsigned char>(encoded[iii + 2])] >= 0)
+            {
+                c = static_cast<char>(s_hexValue[static_cast<unsigned char>(encoded[iii + 1])] * 16 +
+                                      s_hexValue[static_cast<unsigned char>(encoded[iii + 2])]);
+                iii += 2;
+            }
+            // Malformed escapes ("%zz", a trailing '%') are kept as-is
+            m_storage.push_back(c);
+        }
+        return std::string_view(m_storage.data() + offset, m_storage.size() - offset);
+    }
+}
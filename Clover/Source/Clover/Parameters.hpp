@@ -0,0 +1,65 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // The parameters of a request (query string and route captures) as a flat list of key/value views.
+    //
+    // Parsing a query string does not allocate for typical requests: the pairs are kept in a small
+    // inline buffer, and keys/values are views into the request target. Only a key or value that
+    // actually contains an escape ('%XX' or '+') is decoded, into storage owned by this object, so the
+    // object must outlive any views taken from it and can't be copied or moved.
+    //
+    // Lookups are a linear scan, which beats hashing for the handful of parameters a request carries.
+    // The interface mirrors the parts of std::unordered_map that handlers use (find, contains, at,
+    // iteration over pairs) so that handlers written against the old map keep compiling.
+    class Parameters
+    {
+    public:
+        using value_type = std::pair<std::string_view, std::string_view>;
+        using Container = boost::container::small_vector<value_type, 8>;
+        using const_iterator = Container::const_iterator;
+        using iterator = const_iterator;
+
+        Parameters() noexcept = default;
+        Parameters(const Parameters&) = delete;
+        Parameters& operator=(const Parameters&) = delete;
+
+        // Parse a query string (everything after the '?'). If a key appears more than once, the first
+        // occurrence wins. Should be called at most once, before any other parameters are added.
+        void Parse(std::string_view query);
+
+        ND inline const_iterator begin() const noexcept { return m_params.begin(); }
+        ND inline const_iterator end() const noexcept { return m_params.end(); }
+        ND inline std::size_t size() const noexcept { return m_params.size(); }
+        ND inline bool empty() const noexcept { return m_params.empty(); }
+
+        ND const_iterator find(std::string_view key) const noexcept;
+        ND inline bool contains(std::string_view key) const noexcept { return find(key) != end(); }
+        ND inline std::size_t count(std::string_view key) const noexcept { return contains(key) ? 1 : 0; }
+
+        // Throws std::out_of_range if the key is not present
+        ND std::string_view at(std::string_view key) const;
+
+        // Returns 'fallback' if the key is not present
+        ND inline std::string_view Get(std::string_view key, std::string_view fallback = {}) const noexcept
+        {
+            const_iterator itr = find(key);
+            return itr == end() ? fallback : itr->second;
+        }
+
+        // The views must outlive this object
+        void insert_or_assign(std::string_view key, std::string_view value);
+        bool emplace(std::string_view key, std::string_view value);
+
+    private:
+        // Returns 'encoded' itself if it contains no escapes, otherwise a view of the decoded copy in m_storage
+        ND std::string_view Decode(std::string_view encoded) noexcept;
+
+        Container m_params;
+
+        // Decoded keys/values. Reserved up front in Parse() so that it never reallocates (which would
+        // invalidate the views into it). A decoded string is never longer than its encoded form.
+        boost::container::small_vector<char, 128> m_storage;
+    };
+}
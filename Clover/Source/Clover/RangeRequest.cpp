@@ -0,0 +1,149 @@
+#include "pch.hpp"
+#include "RangeRequest.hpp"
+#include "ConditionalRequest.hpp"
+
+namespace Clover
+{
+    static std::string_view TrimOWS(std::string_view str) noexcept
+    {
+        while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+            str.remove_prefix(1);
+        while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+            str.remove_suffix(1);
+        return str;
+    }
+
+    // Parse a non-empty string of digits. Fails on anything else, including overflow
+    static std::optional<std::uint64_t> ParseDigits(std::string_view str) noexcept
+    {
+        if (str.empty())
+            return std::nullopt;
+
+        std::uint64_t value = 0;
+        for (char c : str)
+        {
+            if (c < '0' || c > '9')
+                return std::nullopt;
+
+            std::uint64_t digit = static_cast<std::uint64_t>(c - '0');
+            if (value > (std::numeric_limits<std::uint64_t>::max() - digit) / 10)
+                return std::nullopt;
+            value = value * 10 + digit;
+        }
+        return value;
+    }
+
+    RangeRequest ParseRange(std::string_view value, std::uint64_t size, std::size_t maxRanges)
+    {
+        RangeRequest request;
+
+        // The range unit is case-insensitive
+        value = TrimOWS(value);
+        if (value.size() < 6 || !beast::iequals(value.substr(0, 6), "bytes="))
+            return request;
+        value.remove_prefix(6);
+
+        std::size_t count = 0;
+        while (true)
+        {
+            std::size_t comma = value.find(',');
+            std::string_view spec = TrimOWS(value.substr(0, comma));
+
+            // Empty list elements are allowed (e.g. "bytes=0-1,,5-6")
+            if (!spec.empty())
+            {
+                if (++count > maxRanges)
+                    return {};
+
+                std::size_t dash = spec.find('-');
+                if (dash == std::string_view::npos)
+                    return {};
+
+                std::string_view firstStr = spec.substr(0, dash);
+                std::string_view lastStr = spec.substr(dash + 1);
+
+                if (firstStr.empty())
+                {
+                    // Suffix range: "-500" is the last 500 bytes
+                    std::optional<std::uint64_t> suffix = ParseDigits(lastStr);
+                    if (!suffix.has_value())
+                        return {};
+
+                    if (*suffix > 0 && size > 0)
+                    {
+                        std::uint64_t length = std::min(*suffix, size);
+                        request.ranges.push_back({ size - length, length });
+                    }
+                }
+                else
+                {
+                    std::optional<std::uint64_t> first = ParseDigits(firstStr);
+                    std::optional<std::uint64_t> last = lastStr.empty() ? std::optional<std::uint64_t>(size > 0 ? size - 1 : 0) : ParseDigits(lastStr);
+                    if (!first.has_value() || !last.has_value() || (!lastStr.empty() && *last < *first))
+                        return {};
+
+                    // A range that starts beyond the end of the representation can't be satisfied,
+                    // but the others in the list may still be
+                    if (*first < size)
+                    {
+                        std::uint64_t end = std::min(*last, size - 1);
+                        request.ranges.push_back({ *first, end - *first + 1 });
+                    }
+                }
+            }
+
+            if (comma == std::string_view::npos)
+                break;
+            value.remove_prefix(comma + 1);
+        }
+
+        if (count == 0)
+            return {};
+
+        if (request.ranges.empty())
+        {
+            request.result = RangeRequest::Result::Unsatisfiable;
+            return request;
+        }
+
+        // Overlapping ranges are merged so that a client can't make us send the same bytes over and over
+        if (request.ranges.size() > 1)
+        {
+            std::sort(request.ranges.begin(), request.ranges.end(),
+                [](const ByteRange& lhs, const ByteRange& rhs) { return lhs.offset < rhs.offset; });
+
+            std::vector<ByteRange> merged;
+            merged.reserve(request.ranges.size());
+            for (const ByteRange& range : request.ranges)
+            {
+                if (!merged.empty() && range.offset <= merged.back().offset + merged.back().length)
+                {
+                    ByteRange& back = merged.back();
+                    back.length = std::max(back.offset + back.length, range.offset + range.length) - back.offset;
+                }
+                else
+                    merged.push_back(range);
+            }
+            request.ranges = std::move(merged);
+        }
+
+        request.result = RangeRequest::Result::Satisfiable;
+        return request;
+    }
+
+    bool IfRangeMatches(const http::fields& request, std::string_view etag, std::chrono::sys_seconds lastModified) noexcept
+    {
+        auto ifRange = request.find(http::field::if_range);
+        if (ifRange == request.end())
+            return true;
+
+        std::string_view value = TrimOWS(ifRange->value());
+
+        // Entity tag. Weak tags can never be used with If-Range
+        if (value.starts_with('"') || value.starts_with("W/"))
+            return !value.starts_with("W/") && !etag.starts_with("W/") && value == etag;
+
+        std::optional<std::chrono::sys_seconds> date = ParseHTTPDate(value);
+        return date.has_value() && *date == lastModified;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Helpers for byte range requests (RFC 9110, section 14)
+
+    struct ByteRange
+    {
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+
+        // Value of the Content-Range header for this range of a representation of 'size' bytes
+        ND inline std::string ContentRange(std::uint64_t size) const { return std::format("bytes {0}-{1}/{2}", offset, offset + length - 1, size); }
+    };
+
+    struct RangeRequest
+    {
+        enum class Result
+        {
+            Ignore,         // No usable Range header. Send the full representation with a 200
+            Satisfiable,    // Send the ranges with a 206
+            Unsatisfiable   // None of the ranges overlap the representation. Send a 416
+        };
+
+        Result result = Result::Ignore;
+
+        // Sorted by offset, with overlapping and adjacent ranges merged
+        std::vector<ByteRange> ranges;
+    };
+
+    // Parse the value of a Range header for a representation of 'size' bytes. A header with invalid
+    // syntax, an unknown unit, or more than 'maxRanges' ranges is ignored, as the RFC allows.
+    ND RangeRequest ParseRange(std::string_view value, std::uint64_t size, std::size_t maxRanges = 16);
+
+    // Returns true if the Range header should be honored. That is the case when there is no If-Range
+    // header, or when it names the current representation. An entity tag uses the strong comparison
+    // (so a weak ETag never matches) and a date must match Last-Modified exactly.
+    ND bool IfRangeMatches(const http::fields& request, std::string_view etag, std::chrono::sys_seconds lastModified) noexcept;
+
+    // Build a multipart/byteranges body. 'append' is called as append(const ByteRange&, std::string&)
+    // and must append exactly range.length bytes of the representation to the string. It returns false
+    // on failure, in which case std::nullopt is returned.
+    template<typename AppendFn>
+    ND std::optional<std::string> MakeMultipartByteranges(std::string_view boundary, std::string_view contentType, std::uint64_t size,
+                                                          const std::vector<ByteRange>& ranges, AppendFn&& append)
+    {
+        std::string body;
+
+        std::uint64_t total = 0;
+        for (const ByteRange& range : ranges)
+            total += range.length + boundary.size() + contentType.size() + 96;
+        body.reserve(static_cast<std::size_t>(total));
+
+        for (const ByteRange& range : ranges)
+        {
+            std::format_to(std::back_inserter(body), "\r\n--{0}\r\nContent-Type: {1}\r\nContent-Range: {2}\r\n\r\n", boundary, contentType, range.ContentRange(size));
+            if (!append(range, body))
+                return std::nullopt;
+        }
+        std::format_to(std::back_inserter(body), "\r\n--{0}--\r\n", boundary);
+
+        return body;
+    }
+}
@@ -0,0 +1,192 @@
+#include "pch.hpp"
+#include "RequestBody.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    const std::filesystem::path RequestBody::s_noPath;
+
+    RequestBody::SpooledFile::~SpooledFile() noexcept
+    {
+        beast::error_code closeError;
+        if (file.is_open())
+            file.close(closeError);
+
+        if (keep || path.empty())
+            return;
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        if (ec)
+            LOG_WARN("[CORE] Failed to remove request body file '{0}': {1}", path.string(), ec.message());
+    }
+
+    void RequestBody::SpooledFile::Create(const std::filesystem::path& directory, beast::error_code& ec)
+    {
+        PROFILE_SCOPE("RequestBody::SpooledFile::Create");
+
+        // Nothing else should be writing files with this prefix, but if something is, try another name
+        static std::atomic<std::uint64_t> s_counter = std::random_device{}();
+        std::filesystem::path candidate;
+        for (int attempt = 0; attempt < 8; ++attempt)
+        {
+            candidate = directory / std::format("clover-upload-{0:016x}", s_counter.fetch_add(1, std::memory_order_relaxed));
+            file.open(candidate.string().c_str(), beast::file_mode::write_new, ec);
+            if (ec != beast::errc::file_exists)
+                break;
+        }
+        if (ec)
+        {
+            LOG_ERROR("[CORE] Failed to create request body file '{0}': {1}", candidate.string(), ec.message());
+            return;
+        }
+
+        path = std::move(candidate);
+    }
+
+    void RequestBody::FlushSpool(bool close, beast::error_code& ec)
+    {
+        PROFILE_SCOPE("RequestBody::FlushSpool");
+
+        ec = {};
+        if (m_file == nullptr)
+            return;
+
+        if (m_file->path.empty())
+        {
+            m_file->Create(m_spoolDirectory, ec);
+            if (ec)
+                return;
+        }
+
+        const char* data = m_pending.data();
+        std::size_t size = m_pending.size();
+        while (size > 0)
+        {
+            std::size_t written = m_file->file.write(data, size, ec);
+            if (ec)
+            {
+                LOG_ERROR("[CORE] Failed to write request body file '{0}': {1}", m_file->path.string(), ec.message());
+                return;
+            }
+            data += written;
+            size -= written;
+        }
+
+        // Keep the capacity, the next flush will need about as much
+        m_pending.clear();
+
+        if (close && m_file->file.is_open())
+            m_file->file.close(ec);
+    }
+
+    std::string RequestBody::ReadAll() const
+    {
+        PROFILE_SCOPE("RequestBody::ReadAll");
+
+        if (m_file == nullptr)
+            return m_memory;
+
+        std::ifstream file(m_file->path, std::ios::binary);
+        if (!file)
+            throw std::runtime_error(std::format("RequestBody::ReadAll: Failed to open '{0}'", m_file->path.string()));
+
+        std::string contents;
+        contents.resize(static_cast<std::size_t>(m_size));
+        file.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+        contents.resize(static_cast<std::size_t>(file.gcount()));
+        return contents;
+    }
+
+    bool RequestBody::SaveAs(const std::filesystem::path& destination, std::error_code& ec) const
+    {
+        PROFILE_SCOPE("RequestBody::SaveAs");
+
+        ec.clear();
+        if (m_file == nullptr)
+        {
+            std::ofstream file(destination, std::ios::binary | std::ios::trunc);
+            if (!file.write(m_memory.data(), static_cast<std::streamsize>(m_memory.size())))
+            {
+                ec = std::make_error_code(std::errc::io_error);
+                return false;
+            }
+            return true;
+        }
+
+        // Renaming fails if the destination is on another file system, in which case fall back to a copy
+        std::filesystem::rename(m_file->path, destination, ec);
+        if (ec)
+        {
+            ec.clear();
+            if (!std::filesystem::copy_file(m_file->path, destination, std::filesystem::copy_options::overwrite_existing, ec))
+                return false;
+            std::filesystem::remove(m_file->path, ec);
+            ec.clear();
+        }
+
+        m_file->path = destination;
+        m_file->keep = true;
+        return true;
+    }
+
+    void UploadBody::reader::init(const boost::optional<std::uint64_t>& contentLength, beast::error_code& ec)
+    {
+        ec = {};
+        m_body.m_memory.clear();
+        m_body.m_pending.clear();
+        m_body.m_file.reset();
+        m_body.m_size = 0;
+
+        if (!contentLength)
+            return;
+
+        // When the size is known up front, there is no reason to buffer anything before spooling
+        if (*contentLength > m_body.m_memoryLimit)
+            Spool(ec);
+        else
+            m_body.m_memory.reserve(static_cast<std::size_t>(*contentLength));
+    }
+
+    void UploadBody::reader::finish(beast::error_code& ec)
+    {
+        ec = {};
+        if (!m_deferWrites)
+            m_body.FlushSpool(true, ec);
+    }
+
+    void UploadBody::reader::Spool(beast::error_code& ec)
+    {
+        // The file itself is only created by the first flush, so that this never touches the disk
+        ec = {};
+        m_body.m_file = std::make_shared<RequestBody::SpooledFile>();
+        m_body.m_pending = std::move(m_body.m_memory);
+        m_body.m_memory = std::string();
+
+        if (!m_deferWrites)
+            m_body.FlushSpool(false, ec);
+    }
+
+    void UploadBody::reader::Write(const char* data, std::size_t size, beast::error_code& ec)
+    {
+        ec = {};
+        if (m_body.m_file == nullptr && m_body.m_memory.size() + size > m_body.m_memoryLimit)
+        {
+            Spool(ec);
+            if (ec)
+                return;
+        }
+
+        m_body.m_size += size;
+        if (m_body.m_file == nullptr)
+        {
+            m_body.m_memory.append(data, size);
+            return;
+        }
+
+        m_body.m_pending.append(data, size);
+        if (!m_deferWrites)
+            m_body.FlushSpool(false, ec);
+    }
+}
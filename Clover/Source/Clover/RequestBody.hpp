@@ -0,0 +1,145 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // The body of a request (in practice, a PUT or POST). Small bodies are held in memory. Once a body
+    // grows past the memory limit (see SpoolTo), it is written to a temporary file as it arrives so
+    // that a large upload never has to fit in memory.
+    //
+    // A body read off a socket is not written to the file by the read itself, which would block the io
+    // thread on the disk. What has arrived is kept as pending until the session has FlushSpool called
+    // for it on another thread (see Application::FlushRequestBody).
+    //
+    // Copies share the temporary file, which is deleted when the last copy is destroyed, unless it was
+    // moved somewhere permanent with SaveAs.
+    class RequestBody
+    {
+    public:
+        RequestBody() noexcept = default;
+
+        // Should only be called before the body is read. Bodies larger than 'memoryLimit' bytes are
+        // written to a new file in 'directory'. By default, bodies are always held in memory.
+        inline void SpoolTo(const std::filesystem::path& directory, std::uint64_t memoryLimit)
+        {
+            m_spoolDirectory = directory;
+            m_memoryLimit = memoryLimit;
+        }
+
+        ND inline std::uint64_t Size() const noexcept { return m_size; }
+        ND inline std::string_view ContentType() const noexcept { return m_contentType; }
+        ND inline bool Empty() const noexcept { return m_size == 0; }
+
+        // True if the body was written to a file instead of being held in memory
+        ND inline bool IsSpooled() const noexcept { return m_file != nullptr; }
+
+        // Bytes of a spooled body that have been read but not written to the file yet
+        ND inline std::size_t PendingSpool() const noexcept { return m_pending.size(); }
+
+        // Write the pending bytes to the file (creating it first if need be), and close it if 'close' is
+        // set. Blocks on the disk.
+        void FlushSpool(bool close, beast::error_code& ec);
+
+        // The body, if it is held in memory. Empty if the body was spooled
+        ND inline std::string_view Data() const noexcept { return m_memory; }
+
+        // The file holding the body, if it was spooled. Empty otherwise
+        ND inline const std::filesystem::path& Path() const noexcept { return m_file != nullptr ? m_file->path : s_noPath; }
+
+        // The whole body, wherever it is. For a spooled body, this reads the file back into memory
+        ND std::string ReadAll() const;
+
+        // Store the body at 'destination'. A spooled body is moved there (rather than copied) when
+        // possible, and is then no longer deleted automatically. Path() refers to the new location afterwards.
+        bool SaveAs(const std::filesystem::path& destination, std::error_code& ec) const;
+
+    private:
+        friend struct UploadBody;
+        friend class MultipartForm;
+
+        struct SpooledFile
+        {
+            SpooledFile() noexcept = default;
+            SpooledFile(const SpooledFile&) = delete;
+            SpooledFile& operator=(const SpooledFile&) = delete;
+            ~SpooledFile() noexcept;
+
+            // Pick an unused name in 'directory' and open it for writing
+            void Create(const std::filesystem::path& directory, beast::error_code& ec);
+
+            std::filesystem::path path;     // Empty until the file is created
+            beast::file file;               // Open while the body is being written
+            bool keep = false;
+        };
+
+        static const std::filesystem::path s_noPath;
+
+        std::string m_memory;
+        std::string m_pending;
+        std::shared_ptr<SpooledFile> m_file;
+        std::uint64_t m_size = 0;
+        std::string m_contentType;
+
+        std::filesystem::path m_spoolDirectory;
+        std::uint64_t m_memoryLimit = std::numeric_limits<std::uint64_t>::max();
+    };
+
+    // A Beast Body type for reading requests into a RequestBody. Each buffer is either appended in memory
+    // or, once the body is spooled, queued for the spool file, so the body is never held in memory in full
+    // just to be written out afterwards. When reading a request, the queued bytes are left for the session
+    // to flush (see RequestBody::FlushSpool). A reader constructed from just a body (see MultipartForm)
+    // writes them out itself.
+    struct UploadBody
+    {
+        using value_type = RequestBody;
+
+        class reader
+        {
+        public:
+            template<bool isRequest, class Fields>
+            reader(http::header<isRequest, Fields>& header, value_type& body) :
+                m_body(body),
+                m_deferWrites(true)
+            {
+                // Kept so that the body can be decoded without access to the request (see MultipartForm)
+                m_body.m_contentType = header[http::field::content_type];
+            }
+
+            // For filling a RequestBody that is not part of a message (see MultipartForm)
+            explicit reader(value_type& body) noexcept :
+                m_body(body),
+                m_deferWrites(false)
+            {}
+
+            void init(const boost::optional<std::uint64_t>& contentLength, beast::error_code& ec);
+
+            template<class ConstBufferSequence>
+            ND std::size_t put(const ConstBufferSequence& buffers, beast::error_code& ec)
+            {
+                std::size_t bytes = 0;
+                for (auto itr = net::buffer_sequence_begin(buffers); itr != net::buffer_sequence_end(buffers); ++itr)
+                {
+                    net::const_buffer buffer = *itr;
+                    Write(static_cast<const char*>(buffer.data()), buffer.size(), ec);
+                    if (ec)
+                        return bytes;
+                    bytes += buffer.size();
+                }
+                return bytes;
+            }
+
+            void finish(beast::error_code& ec);
+
+        private:
+            // Move whatever is in memory so far to the spool file and queue everything after it for there too
+            void Spool(beast::error_code& ec);
+            void Write(const char* data, std::size_t size, beast::error_code& ec);
+
+            value_type& m_body;
+            bool m_deferWrites;
+        };
+    };
+
+    // Every request is read with an UploadBody
+    using HTTPRequest = http::request<UploadBody, http::basic_fields<std::allocator<char>>>;
+}
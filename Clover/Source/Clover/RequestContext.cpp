@@ -0,0 +1,90 @@
+#include "pch.hpp"
+#include "RequestContext.hpp"
+#include "Log.hpp"
+
+namespace Clover
+{
+    RequestContext::RequestContext() :
+        m_state(std::make_shared<State>())
+    {}
+
+    std::optional<RequestContext::Clock::time_point> RequestContext::Deadline() const noexcept
+    {
+        Clock::time_point deadline = m_state->deadline.load(std::memory_order_acquire);
+        if (deadline == Clock::time_point::max())
+            return std::nullopt;
+        return deadline;
+    }
+
+    RequestContext::Clock::duration RequestContext::Remaining() const noexcept
+    {
+        Clock::time_point deadline = m_state->deadline.load(std::memory_order_acquire);
+        if (deadline == Clock::time_point::max())
+            return Clock::duration::max();
+
+        Clock::time_point now = Clock::now();
+        return now < deadline ? deadline - now : Clock::duration::zero();
+    }
+
+    bool RequestContext::IsCancelled() const noexcept
+    {
+        return Reason() != CancelReason::None;
+    }
+
+    RequestContext::CancelReason RequestContext::Reason() const noexcept
+    {
+        CancelReason reason = m_state->reason.load(std::memory_order_acquire);
+        if (reason != CancelReason::None)
+            return reason;
+
+        // The deadline is checked lazily rather than with a timer per request
+        return Clock::now() >= m_state->deadline.load(std::memory_order_acquire) ? CancelReason::DeadlineExceeded : CancelReason::None;
+    }
+
+    void RequestContext::Cancel(CancelReason reason) noexcept
+    {
+        if (reason == CancelReason::None)
+            return;
+
+        CancelReason expected = CancelReason::None;
+        if (!m_state->reason.compare_exchange_strong(expected, reason, std::memory_order_acq_rel))
+            return;
+
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            callbacks.swap(m_state->callbacks);
+        }
+
+        for (auto& callback : callbacks)
+        {
+            try
+            {
+                callback();
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("[CORE] RequestContext::Cancel callback failure. Caught std::exception: \n'{0}'", e.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR("[CORE] RequestContext::Cancel callback failure. Caught unknown exception.");
+            }
+        }
+    }
+
+    void RequestContext::OnCancel(std::function<void()> callback) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            if (m_state->reason.load(std::memory_order_acquire) == CancelReason::None)
+            {
+                m_state->callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+
+        // Already cancelled
+        callback();
+    }
+}
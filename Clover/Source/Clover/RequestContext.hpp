@@ -0,0 +1,83 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Per-request state that is shared between the session, the application, and the data gathering
+    // functions. It carries the request's deadline and a cancellation signal, so that work for a client
+    // that has gone away (or that we have given up on) can be abandoned instead of burning CPU.
+    //
+    // Copies refer to the same request, so the session can keep one to signal a disconnect while a
+    // handler on another thread checks IsCancelled(). For synchronous handlers, cancellation is
+    // cooperative: nothing is interrupted, long running handlers are expected to check IsCancelled()
+    // between steps. Asynchronous handlers are also run with an Asio cancellation slot that is signalled
+    // on Cancel() or at the deadline, so whatever they are waiting on completes with operation_aborted.
+    class RequestContext
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        enum class CancelReason
+        {
+            None,
+            DeadlineExceeded,
+            ClientDisconnected
+        };
+
+        RequestContext();
+
+        // When the request was received. The deadline is measured from here, so time spent queued counts
+        ND inline Clock::time_point Received() const noexcept { return m_state->received; }
+
+        // Called by the session once the body of the request has been read as well, so that the time the
+        // client took to send it doesn't count against the deadline. Should only be called before the
+        // context is handed on.
+        inline void MarkReceived() noexcept { m_state->received = Clock::now(); }
+
+        // Should only be called before the context is handed to a data gathering function
+        inline void SetTimeout(Clock::duration timeout) noexcept { m_state->deadline.store(m_state->received + timeout, std::memory_order_release); }
+
+        ND std::optional<Clock::time_point> Deadline() const noexcept;
+
+        // Time left until the deadline. Clock::duration::max() if there is no deadline
+        ND Clock::duration Remaining() const noexcept;
+
+        // True once Cancel() has been called or the deadline has passed
+        ND bool IsCancelled() const noexcept;
+        ND CancelReason Reason() const noexcept;
+
+        // The first reason wins. Runs the OnCancel callbacks on the calling thread.
+        void Cancel(CancelReason reason) noexcept;
+
+        // Called once when Cancel() is called, or right away if it already has been. This is for waking up
+        // something that is waiting (e.g. cancelling a timer). Passing the deadline does not call these,
+        // whoever is waiting should be waiting on the deadline as well.
+        void OnCancel(std::function<void()> callback) const;
+
+        ND inline bool operator==(const RequestContext& other) const noexcept { return m_state == other.m_state; }
+
+    private:
+        struct State
+        {
+            Clock::time_point received = Clock::now();
+            std::atomic<Clock::time_point> deadline = Clock::time_point::max();
+            std::atomic<CancelReason> reason = CancelReason::None;
+
+            std::mutex mutex;
+            std::vector<std::function<void()>> callbacks;
+        };
+
+        std::shared_ptr<State> m_state;
+    };
+
+    ND constexpr std::string_view CancelReasonName(RequestContext::CancelReason reason) noexcept
+    {
+        switch (reason)
+        {
+        case RequestContext::CancelReason::None:               return "none";
+        case RequestContext::CancelReason::DeadlineExceeded:   return "deadline exceeded";
+        case RequestContext::CancelReason::ClientDisconnected: return "client disconnected";
+        }
+        return "unknown";
+    }
+}
@@ -0,0 +1,281 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Values captured from the path while matching a route, in the order they appear in the pattern.
+    // Both the names (owned by the router) and the values (pointing into the matched path) are views,
+    // so matching a route never allocates.
+    class RouteParameters
+    {
+    public:
+        static constexpr std::size_t Capacity = 8;
+
+        ND inline std::size_t size() const noexcept { return m_count; }
+        ND inline bool empty() const noexcept { return m_count == 0; }
+        ND inline auto begin() const noexcept { return m_params.begin(); }
+        ND inline auto end() const noexcept { return m_params.begin() + m_count; }
+
+        // Returns an empty string_view if there is no parameter with that name
+        ND std::string_view Get(std::string_view name) const noexcept
+        {
+            for (std::size_t iii = 0; iii < m_count; ++iii)
+            {
+                if (m_params[iii].first == name)
+                    return m_params[iii].second;
+            }
+            return {};
+        }
+
+        inline void Push(std::string_view name, std::string_view value) noexcept { m_params[m_count++] = { name, value }; }
+        inline void Pop() noexcept { --m_count; }
+
+    private:
+        std::array<std::pair<std::string_view, std::string_view>, Capacity> m_params;
+        std::size_t m_count = 0;
+    };
+
+    // A compressed radix tree (prefix tree) that maps path patterns to values, with one value per
+    // HTTP method. Patterns are made of:
+    //
+    //      static text     "/user/settings"    must match exactly
+    //      {name}          "/user/{id}"        matches one non-empty path segment (up to the next '/')
+    //      *name           "/static/*path"     matches the rest of the path (may be empty). Must be last
+    //
+    // When more than one route could match, static text wins over a parameter, which wins over a
+    // wildcard ("/user/settings" beats "/user/{id}" beats "/user/*rest"). Lookup cost depends on the
+    // length of the path and not on the number of routes.
+    //
+    // Routes should only be inserted during setup. Find is safe to call concurrently once setup is done.
+    template<typename T>
+    class Router
+    {
+    public:
+        struct Match
+        {
+            const T* value = nullptr;       // nullptr if nothing matched (or the method is not allowed)
+            bool pathMatched = false;       // True if the path matched a route, even if the method did not
+            RouteParameters parameters;
+        };
+
+        Router() noexcept : m_root(std::make_unique<Node>()) {}
+        Router(const Router&) = delete;
+        Router& operator=(const Router&) = delete;
+
+        // Returns false if the pattern is invalid or a value is already registered for that method and
+        // pattern, in which case 'error' describes why. A failed insert never changes which routes match.
+        bool Insert(http::verb method, std::string_view pattern, T value, std::string& error)
+        {
+            std::size_t parameterCount = 0;
+            Node* node = m_root.get();
+
+            while (!pattern.empty())
+            {
+                if (pattern.front() == '{')
+                {
+                    std::size_t close = pattern.find('}');
+                    if (close == std::string_view::npos || close == 1)
+                    {
+                        error = "parameter is missing a name or closing '}'";
+                        return false;
+                    }
+                    if (close + 1 < pattern.size() && pattern[close + 1] != '/')
+                    {
+                        error = "a parameter must be followed by '/' or the end of the pattern";
+                        return false;
+                    }
+
+                    std::string_view name = pattern.substr(1, close - 1);
+                    if (node->paramChild == nullptr)
+                    {
+                        node->paramChild = std::make_unique<Node>();
+                        node->paramChild->name = name;
+                    }
+                    else if (node->paramChild->name != name)
+                    {
+                        error = std::format("parameter '{0}' conflicts with parameter '{1}' of an existing route", name, node->paramChild->name);
+                        return false;
+                    }
+
+                    node = node->paramChild.get();
+                    pattern.remove_prefix(close + 1);
+                    ++parameterCount;
+                }
+                else if (pattern.front() == '*')
+                {
+                    std::string_view name = pattern.substr(1);
+                    if (name.find_first_of("/{*") != std::string_view::npos)
+                    {
+                        error = "a wildcard must be the last part of the pattern";
+                        return false;
+                    }
+                    if (name.empty())
+                        name = "*";
+
+                    if (node->wildcardChild == nullptr)
+                    {
+                        node->wildcardChild = std::make_unique<Node>();
+                        node->wildcardChild->name = name;
+                    }
+                    else if (node->wildcardChild->name != name)
+                    {
+                        error = std::format("wildcard '{0}' conflicts with wildcard '{1}' of an existing route", name, node->wildcardChild->name);
+                        return false;
+                    }
+
+                    node = node->wildcardChild.get();
+                    pattern = {};
+                    ++parameterCount;
+                }
+                else
+                {
+                    std::size_t special = pattern.find_first_of("{*");
+                    node = InsertStatic(node, pattern.substr(0, special));
+                    pattern.remove_prefix(special == std::string_view::npos ? pattern.size() : special);
+                }
+            }
+
+            if (parameterCount > RouteParameters::Capacity)
+            {
+                error = std::format("a route can have at most {0} parameters", RouteParameters::Capacity);
+                return false;
+            }
+
+            for (const auto& [existingMethod, existingValue] : node->values)
+            {
+                if (existingMethod == method)
+                {
+                    error = "a route with the same method and pattern already exists";
+                    return false;
+                }
+            }
+
+            node->values.emplace_back(method, std::move(value));
+            return true;
+        }
+
+        ND Match Find(http::verb method, std::string_view path) const noexcept
+        {
+            Match match;
+            match.value = Find(*m_root, path, method, match.parameters, match.pathMatched);
+            if (match.value != nullptr)
+                match.pathMatched = true;
+            return match;
+        }
+
+    private:
+        struct Node
+        {
+            std::string prefix;                                 // Static nodes: the text on the edge into this node
+            std::string name;                                   // Parameter/wildcard nodes: the name of the capture
+
+            std::string indices;                                // First character of each static child's prefix
+            std::vector<std::unique_ptr<Node>> children;        // Static children, in the same order as 'indices'
+            std::unique_ptr<Node> paramChild;
+            std::unique_ptr<Node> wildcardChild;
+
+            std::vector<std::pair<http::verb, T>> values;
+        };
+
+        // Insert 'text' below 'node', splitting existing edges where they only partially match
+        static Node* InsertStatic(Node* node, std::string_view text)
+        {
+            while (!text.empty())
+            {
+                std::size_t index = node->indices.find(text.front());
+                if (index == std::string::npos)
+                {
+                    auto child = std::make_unique<Node>();
+                    child->prefix = text;
+                    node->indices.push_back(text.front());
+                    node->children.push_back(std::move(child));
+                    return node->children.back().get();
+                }
+
+                Node* child = node->children[index].get();
+                std::size_t common = 0;
+                while (common < text.size() && common < child->prefix.size() && text[common] == child->prefix[common])
+                    ++common;
+
+                // Split the edge: 'middle' takes over the common part and 'child' keeps the rest
+                if (common < child->prefix.size())
+                {
+                    auto middle = std::make_unique<Node>();
+                    middle->prefix = child->prefix.substr(0, common);
+                    child->prefix.erase(0, common);
+                    middle->indices.push_back(child->prefix.front());
+                    middle->children.push_back(std::move(node->children[index]));
+                    node->children[index] = std::move(middle);
+                    child = node->children[index].get();
+                }
+
+                node = child;
+                text.remove_prefix(common);
+            }
+            return node;
+        }
+
+        // The value registered on 'node' for 'method', if any. Records that the path matched a route
+        // even when the method does not, so the caller can tell a 405 from a 404
+        static const T* ValueFor(const Node& node, http::verb method, bool& pathMatched) noexcept
+        {
+            for (const auto& [nodeMethod, value] : node.values)
+            {
+                if (nodeMethod == method)
+                    return &value;
+            }
+            pathMatched = pathMatched || !node.values.empty();
+            return nullptr;
+        }
+
+        // Depth first search that prefers static children, then the parameter child, then the wildcard
+        // child, backtracking when a more specific branch turns out to be a dead end
+        static const T* Find(const Node& node, std::string_view path, http::verb method, RouteParameters& parameters, bool& pathMatched) noexcept
+        {
+            if (path.empty())
+            {
+                if (const T* value = ValueFor(node, method, pathMatched))
+                    return value;
+            }
+            else
+            {
+                std::size_t index = node.indices.find(path.front());
+                if (index != std::string::npos)
+                {
+                    const Node& child = *node.children[index];
+                    if (path.starts_with(child.prefix))
+                    {
+                        if (const T* value = Find(child, path.substr(child.prefix.size()), method, parameters, pathMatched))
+                            return value;
+                    }
+                }
+
+                if (node.paramChild != nullptr)
+                {
+                    std::size_t end = std::min(path.find('/'), path.size());
+                    if (end > 0)
+                    {
+                        parameters.Push(node.paramChild->name, path.substr(0, end));
+                        if (const T* value = Find(*node.paramChild, path.substr(end), method, parameters, pathMatched))
+                            return value;
+                        parameters.Pop();
+                    }
+                }
+            }
+
+            // The wildcard also matches an empty remainder
+            if (node.wildcardChild != nullptr)
+            {
+                if (const T* value = ValueFor(*node.wildcardChild, method, pathMatched))
+                {
+                    parameters.Push(node.wildcardChild->name, path);
+                    return value;
+                }
+            }
+
+            return nullptr;
+        }
+
+        std::unique_ptr<Node> m_root;
+    };
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // A Beast Body type for responses whose payload lives in an immutable, reference counted buffer.
+    // This allows a buffer that was generated once (a cached page, a cached static file, etc) to be
+    // sent to any number of clients at the same time without copying it into each response.
+    //
+    // The 'view' member is the portion of the buffer that will actually be sent. By default it
+    // covers the whole buffer.
+    struct SharedBody
+    {
+        struct value_type
+        {
+            value_type() noexcept = default;
+            value_type(std::shared_ptr<const std::string> _buffer) noexcept :
+                buffer(std::move(_buffer)),
+                view(buffer ? std::string_view(*buffer) : std::string_view())
+            {}
+            value_type(std::shared_ptr<const std::string> _buffer, std::string_view _view) noexcept :
+                buffer(std::move(_buffer)),
+                view(_view)
+            {}
+
+            std::shared_ptr<const std::string> buffer;
+            std::string_view view;
+        };
+
+        ND static std::uint64_t size(const value_type& body) noexcept { return body.view.size(); }
+
+        class writer
+        {
+        public:
+            using const_buffers_type = net::const_buffer;
+
+            template<bool isRequest, class Fields>
+            writer(const http::header<isRequest, Fields>&, const value_type& body) noexcept :
+                m_body(body)
+            {}
+
+            void init(beast::error_code& ec) noexcept { ec = {}; }
+
+            ND boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) noexcept
+            {
+                ec = {};
+                return { { const_buffers_type(m_body.view.data(), m_body.view.size()), false } };
+            }
+
+        private:
+            const value_type& m_body;
+        };
+    };
+}
@@ -0,0 +1,187 @@
+#include "pch.hpp"
+#include "StaticAssetCache.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+#ifdef PLATFORM_LINUX
+#include <unistd.h>
+#endif
+
+namespace Clover
+{
+    std::shared_ptr<const std::string> StaticAssetCache::Get(const FileInfo& info)
+    {
+        PROFILE_SCOPE("StaticAssetCache::Get");
+
+        if (info.size > m_maxFileSize || info.size > m_capacity)
+            return nullptr;
+
+        {
+            std::shared_lock lock(m_mutex);
+
+            auto itr = m_entries.find(info.path);
+            if (itr != m_entries.end())
+            {
+                Entry& entry = itr->second;
+                if (entry.size == info.size && entry.lastWriteTime == info.lastWriteTime)
+                {
+                    m_hits.fetch_add(1, std::memory_order_relaxed);
+
+                    const Clock::rep now = Clock::now().time_since_epoch().count();
+                    if (now - entry.lastUsed.load(std::memory_order_relaxed) > TouchGranularity.count())
+                        entry.lastUsed.store(now, std::memory_order_relaxed);
+                    return entry.buffer;
+                }
+
+                // The file has changed since it was cached. The stale entry is replaced below.
+            }
+        }
+
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+
+        // Read the file without holding the lock. If two threads miss on the same file at the same time,
+        // they will both read it, but only one copy will end up in the cache.
+        std::shared_ptr<const std::string> buffer = Load(info);
+        if (buffer == nullptr || buffer->size() != info.size)
+            return nullptr;
+
+        std::unique_lock lock(m_mutex);
+
+        auto itr = m_entries.find(info.path);
+        if (itr != m_entries.end())
+        {
+            if (itr->second.size == info.size && itr->second.lastWriteTime == info.lastWriteTime)
+                return itr->second.buffer;
+
+            m_bytes -= itr->second.size;
+            m_entries.erase(itr);
+        }
+
+        EvictUntilFits(info.size);
+
+        Entry& entry = m_entries.try_emplace(info.path).first->second;
+        entry.size = info.size;
+        entry.lastWriteTime = info.lastWriteTime;
+        entry.buffer = buffer;
+        entry.lastUsed.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        m_bytes += info.size;
+
+        LOG_TRACE("[CORE] StaticAssetCache: Cached '{0}' ({1} bytes). Cache now holds {2} files / {3} bytes", info.path, info.size, m_entries.size(), m_bytes);
+        return buffer;
+    }
+
+    void StaticAssetCache::Clear() noexcept
+    {
+        std::unique_lock lock(m_mutex);
+        m_entries.clear();
+        m_bytes = 0;
+    }
+
+    std::uint64_t StaticAssetCache::SizeInBytes() const noexcept
+    {
+        std::shared_lock lock(m_mutex);
+        return m_bytes;
+    }
+    std::size_t StaticAssetCache::Count() const noexcept
+    {
+        std::shared_lock lock(m_mutex);
+        return m_entries.size();
+    }
+
+    void StaticAssetCache::EvictUntilFits(std::uint64_t bytes) noexcept
+    {
+        if (m_bytes + bytes <= m_capacity)
+            return;
+
+        try
+        {
+            // Sorting is the expensive part, so make room for more than just this file while at it
+            const std::uint64_t target = m_capacity - std::min(m_capacity / 8 + bytes, m_capacity);
+
+            using Candidate = std::pair<Clock::rep, decltype(m_entries)::iterator>;
+            std::vector<Candidate> candidates;
+            candidates.reserve(m_entries.size());
+            for (auto itr = m_entries.begin(); itr != m_entries.end(); ++itr)
+                candidates.emplace_back(itr->second.lastUsed.load(std::memory_order_relaxed), itr);
+            std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.first < b.first; });
+
+            for (const auto& [lastUsed, itr] : candidates)
+            {
+                if (m_bytes <= target)
+                    break;
+                m_bytes -= itr->second.size;
+                m_entries.erase(itr);
+            }
+        }
+        catch (...)
+        {
+            // Out of memory for the candidates. Dropping everything still keeps the cache within its capacity
+            m_entries.clear();
+            m_bytes = 0;
+        }
+    }
+
+    std::shared_ptr<const std::string> StaticAssetCache::Load(const FileInfo& info) noexcept
+    {
+        PROFILE_SCOPE("StaticAssetCache::Load");
+
+        try
+        {
+            auto buffer = std::make_shared<std::string>();
+            buffer->resize(info.size);
+
+#ifdef PLATFORM_LINUX
+            // If the document index is holding the file open, read through that descriptor. pread() does not
+            // touch the file offset, so it is fine for other threads to be using the same descriptor.
+            if (info.fd >= 0)
+            {
+                std::size_t total = 0;
+                while (total < info.size)
+                {
+                    ssize_t bytes = ::pread(info.fd, buffer->data() + total, info.size - total, static_cast<off_t>(total));
+                    if (bytes < 0 && errno == EINTR)
+                        continue;
+                    if (bytes <= 0)
+                    {
+                        LOG_WARN("[CORE] StaticAssetCache: Failed to read file '{0}'", info.path);
+                        return nullptr;
+                    }
+                    total += static_cast<std::size_t>(bytes);
+                }
+                return buffer;
+            }
+#endif
+
+            beast::error_code ec;
+            beast::file file;
+            file.open(info.path.c_str(), beast::file_mode::scan, ec);
+            if (ec)
+            {
+                LOG_WARN("[CORE] StaticAssetCache: Failed to open file '{0}': '{1}'", info.path, ec.message());
+                return nullptr;
+            }
+
+            std::size_t total = 0;
+            while (total < info.size)
+            {
+                std::size_t bytes = file.read(buffer->data() + total, info.size - total, ec);
+                if (ec || bytes == 0)
+                {
+                    LOG_WARN("[CORE] StaticAssetCache: Failed to read file '{0}': '{1}'", info.path, ec.message());
+                    return nullptr;
+                }
+                total += bytes;
+            }
+            return buffer;
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("[CORE] StaticAssetCache::Load failure. Caught std::exception: \n'{0}'", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("[CORE] StaticAssetCache::Load failure. Caught unknown exception.");
+        }
+        return nullptr;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "pch.hpp"
+#include "DocumentIndex.hpp"
+
+namespace Clover
+{
+    // Keeps the contents of small, frequently requested files (css, js, icons, small images) in
+    // memory so that serving them does not require an open/read/close for every request. Each file is
+    // loaded once into an immutable buffer that is shared by every response that sends it (see
+    // SharedBody), so there is no per-request copy either.
+    //
+    // The cache is bounded by the total number of bytes it holds and evicts the least recently used
+    // files first. Files larger than the max file size are never cached. An entry is reloaded when the
+    // size or last write time reported by the DocumentIndex no longer matches the cached copy.
+    //
+    // A hit only takes the lock shared, so hits on different io threads don't serialize. Recency is an
+    // atomic timestamp on each entry instead of a position in a list, and it is only written when it is
+    // noticeably out of date so that a popular file's entry isn't bounced between cores on every hit.
+    // Eviction sorts the entries by that timestamp, which is only done when a new file doesn't fit.
+    //
+    // All public methods are safe to call concurrently from any of the io threads.
+    class StaticAssetCache
+    {
+    public:
+        // Returns the contents of the file, loading it if necessary. Returns nullptr if the file is
+        // too large to be cached or could not be read, in which case it should be served from disk.
+        ND std::shared_ptr<const std::string> Get(const FileInfo& info);
+
+        void Clear() noexcept;
+
+        // Should only be called during setup, before Run()
+        inline void SetCapacity(std::uint64_t bytes) noexcept { m_capacity = bytes; }
+        inline void SetMaxFileSize(std::uint64_t bytes) noexcept { m_maxFileSize = bytes; }
+
+        ND inline std::uint64_t MaxFileSize() const noexcept { return m_maxFileSize; }
+        ND inline std::uint64_t Hits() const noexcept { return m_hits.load(std::memory_order_relaxed); }
+        ND inline std::uint64_t Misses() const noexcept { return m_misses.load(std::memory_order_relaxed); }
+        ND std::uint64_t SizeInBytes() const noexcept;
+        ND std::size_t Count() const noexcept;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // How stale an entry's last use may get before a hit updates it
+        static constexpr Clock::duration TouchGranularity = std::chrono::milliseconds(100);
+
+        struct Entry
+        {
+            std::uint64_t size = 0;
+            std::filesystem::file_time_type lastWriteTime;
+            std::shared_ptr<const std::string> buffer;
+            std::atomic<Clock::rep> lastUsed = 0;
+        };
+
+        ND static std::shared_ptr<const std::string> Load(const FileInfo& info) noexcept;
+        void EvictUntilFits(std::uint64_t bytes) noexcept;
+
+        std::uint64_t m_capacity = 64 * 1024 * 1024;
+        std::uint64_t m_maxFileSize = 256 * 1024;
+
+        // Entries are constructed in place and never move (std::unordered_map nodes are stable), which
+        // is what lets them hold an atomic
+        mutable std::shared_mutex m_mutex;
+        std::unordered_map<std::string, Entry, string_hash, std::equal_to<>> m_entries;
+        std::uint64_t m_bytes = 0;
+
+        std::atomic<std::uint64_t> m_hits = 0;
+        std::atomic<std::uint64_t> m_misses = 0;
+    };
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include "pch.hpp"
+#include "DocumentIndex.hpp"
+
+namespace Clover
+{
+    // A Beast Body type for static files that are too large to be held in the StaticAssetCache.
+    //
+    // The body describes a byte range of a file. When it is serialized by Beast (SSL sessions and
+    // non-Linux platforms), the range is read into a small buffer one chunk at a time, just like
+    // http::file_body. On Linux, a plain TCP session does not serialize the body at all. Instead, it
+    // writes the header and then hands the file descriptor to sendfile(2) so the file contents go
+    // from the page cache to the socket without ever being copied into userspace (see HTTPSession).
+    struct StaticFileBody
+    {
+        class value_type
+        {
+        public:
+            value_type() noexcept = default;
+            value_type(value_type&&) noexcept = default;
+            value_type& operator=(value_type&&) noexcept = default;
+
+            // Prepare to send the whole file. If the document index is holding the file open, that
+            // descriptor is used (all reads are positional, so it can be shared). Otherwise, the file is opened.
+            void Open(std::shared_ptr<const FileInfo> info, beast::error_code& ec) noexcept
+            {
+                m_info = std::move(info);
+                offset = 0;
+
+#ifdef PLATFORM_LINUX
+                if (m_info->fd >= 0)
+                {
+                    ec = {};
+                    length = m_info->size;
+                    return;
+                }
+#endif
+
+                m_file.open(m_info->path.c_str(), beast::file_mode::scan, ec);
+                if (ec)
+                    return;
+
+                length = m_file.size(ec);
+            }
+
+            ND inline const FileInfo& Info() const noexcept { return *m_info; }
+            ND inline beast::file& File() noexcept { return m_file; }
+
+#ifdef PLATFORM_LINUX
+            ND inline int NativeHandle() const noexcept { return m_info != nullptr && m_info->fd >= 0 ? m_info->fd : m_file.native_handle(); }
+#endif
+
+            // Read up to 'size' bytes starting at 'position' in the file. Returns the number of bytes read,
+            // which is only 0 at the end of the file or on error.
+            ND std::size_t ReadSome(std::uint64_t position, char* buffer, std::size_t size, beast::error_code& ec) noexcept
+            {
+#ifdef PLATFORM_LINUX
+                ssize_t bytes;
+                do
+                {
+                    bytes = ::pread(NativeHandle(), buffer, size, static_cast<off_t>(position));
+                } while (bytes < 0 && errno == EINTR);
+
+                if (bytes < 0)
+                {
+                    ec = beast::error_code(errno, beast::system_category());
+                    return 0;
+                }
+                ec = {};
+                return static_cast<std::size_t>(bytes);
+#else
+                m_file.seek(position, ec);
+                if (ec)
+                    return 0;
+                return m_file.read(buffer, size, ec);
+#endif
+            }
+
+            // The range of the file that will be sent
+            std::uint64_t offset = 0;
+            std::uint64_t length = 0;
+
+        private:
+            std::shared_ptr<const FileInfo> m_info;
+            beast::file m_file;
+        };
+
+        ND static std::uint64_t size(const value_type& body) noexcept { return body.length; }
+
+        class writer
+        {
+        public:
+            using const_buffers_type = net::const_buffer;
+
+            template<bool isRequest, class Fields>
+            writer(const http::header<isRequest, Fields>&, value_type& body) noexcept :
+                m_body(body)
+            {}
+
+            void init(beast::error_code& ec) noexcept
+            {
+                m_position = m_body.offset;
+                m_remain = m_body.length;
+                ec = {};
+            }
+
+            ND boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) noexcept
+            {
+                std::size_t amount = static_cast<std::size_t>(std::min<std::uint64_t>(m_remain, sizeof(m_buffer)));
+                if (amount == 0)
+                {
+                    ec = {};
+                    return boost::none;
+                }
+
+                std::size_t nread = m_body.ReadSome(m_position, m_buffer, amount, ec);
+                if (ec)
+                    return boost::none;
+
+                // The file got shorter after the Content-Length was sent
+                if (nread == 0)
+                {
+                    ec = http::error::short_read;
+                    return boost::none;
+                }
+
+                m_position += nread;
+                m_remain -= nread;
+                return { { const_buffers_type(m_buffer, nread), m_remain > 0 } };
+            }
+
+        private:
+            value_type& m_body;
+            std::uint64_t m_position = 0;
+            std::uint64_t m_remain = 0;
+            char m_buffer[16384];
+        };
+    };
+
+    // Kept as its own type in HTTPResponse so that the session can choose how to send the body
+    using StaticFileResponse = http::response<StaticFileBody>;
+}
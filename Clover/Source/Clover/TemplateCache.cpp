@@ -0,0 +1,116 @@
+#include "pch.hpp"
+#include "TemplateCache.hpp"
+#include "Log.hpp"
+#include "Profiling.hpp"
+
+namespace Clover
+{
+    TemplateCache::TemplateCache(inja::Environment& env) noexcept :
+        m_env(env)
+    {}
+
+    std::string TemplateCache::Render(const std::string& file, const json& data)
+    {
+        PROFILE_SCOPE("TemplateCache::Render");
+
+        {
+            std::shared_lock lock(m_mutex);
+
+            auto itr = m_templates.find(file);
+            if (itr != m_templates.end() && IsFresh(file, *itr->second))
+                return m_env.render(itr->second->tmpl, data);
+        }
+
+        // Cache miss (or the file has been modified), so the template needs to be parsed
+        std::shared_ptr<Entry> entry = Parse(file);
+
+        std::shared_lock lock(m_mutex);
+        return m_env.render(entry->tmpl, data);
+    }
+
+    std::string TemplateCache::Render(const std::string& file, std::filesystem::file_time_type lastWriteTime, const json& data)
+    {
+        PROFILE_SCOPE("TemplateCache::Render");
+
+        {
+            std::shared_lock lock(m_mutex);
+
+            auto itr = m_templates.find(file);
+            if (itr != m_templates.end() && itr->second->lastWriteTime == lastWriteTime)
+                return m_env.render(itr->second->tmpl, data);
+        }
+
+        std::shared_ptr<Entry> entry = Parse(file, lastWriteTime);
+
+        std::shared_lock lock(m_mutex);
+        return m_env.render(entry->tmpl, data);
+    }
+
+    void TemplateCache::Load(const std::string& file)
+    {
+        {
+            std::shared_lock lock(m_mutex);
+
+            auto itr = m_templates.find(file);
+            if (itr != m_templates.end() && IsFresh(file, *itr->second))
+                return;
+        }
+
+        boost::ignore_unused(Parse(file));
+    }
+
+    void TemplateCache::Reload() noexcept
+    {
+        std::unique_lock lock(m_mutex);
+        m_templates.clear();
+    }
+    void TemplateCache::Reload(std::string_view file) noexcept
+    {
+        std::unique_lock lock(m_mutex);
+
+        auto itr = m_templates.find(file);
+        if (itr != m_templates.end())
+            m_templates.erase(itr);
+    }
+
+    bool TemplateCache::IsFresh(const std::string& file, Entry& entry) const noexcept
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto lastChecked = entry.lastChecked.load(std::memory_order_relaxed);
+
+        if (std::chrono::steady_clock::duration(now - lastChecked) < m_checkInterval)
+            return true;
+
+        entry.lastChecked.store(now, std::memory_order_relaxed);
+
+        std::error_code ec;
+        auto lastWriteTime = std::filesystem::last_write_time(file, ec);
+        return !ec && lastWriteTime == entry.lastWriteTime;
+    }
+
+    std::shared_ptr<TemplateCache::Entry> TemplateCache::Parse(const std::string& file, std::optional<std::filesystem::file_time_type> knownLastWriteTime)
+    {
+        PROFILE_SCOPE("TemplateCache::Parse");
+
+        std::unique_lock lock(m_mutex);
+
+        // If the file can't be stat'd, don't fail here. Instead, let inja report the failure when it tries to load it
+        std::error_code ec;
+        auto lastWriteTime = knownLastWriteTime.has_value() ? *knownLastWriteTime : std::filesystem::last_write_time(file, ec);
+
+        // Another thread may have already re-parsed the template while we were waiting on the lock
+        auto itr = m_templates.find(file);
+        if (!ec && itr != m_templates.end() && itr->second->lastWriteTime == lastWriteTime)
+            return itr->second;
+
+        LOG_TRACE("[CORE] TemplateCache: Parsing template '{0}'", file);
+
+        auto entry = std::make_shared<Entry>();
+        entry->tmpl = m_env.parse_template(file);
+        entry->lastWriteTime = lastWriteTime;
+        entry->lastChecked.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+
+        m_templates.insert_or_assign(file, entry);
+        return entry;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // Holds the parsed inja::Template for each html file that has been rendered so that a request
+    // only has to pay for rendering the template and not for reading, tokenizing, and parsing the
+    // file all over again. Entries are keyed by the resolved file path (document root included).
+    //
+    // A cached template is considered stale once the last write time of its file changes. To keep
+    // the hot path free of a stat() per request, the last write time is only re-checked once per
+    // check interval. Reload() can be used to force all (or one) of the templates to be re-parsed.
+    //
+    // All public methods are safe to call concurrently from any of the io threads.
+    class TemplateCache
+    {
+    public:
+        explicit TemplateCache(inja::Environment& env) noexcept;
+
+        // Render the template for 'file' with 'data', parsing it first if it is not cached or is stale.
+        // Throws the same inja exceptions that inja::Environment::render_file would throw.
+        ND std::string Render(const std::string& file, const json& data);
+
+        // Same as above, but the caller already knows the last write time of the file (for example, from
+        // the DocumentIndex) so the cache does not need to stat() the file to determine if it is stale
+        ND std::string Render(const std::string& file, std::filesystem::file_time_type lastWriteTime, const json& data);
+
+        // Parse the template for 'file' now (if necessary) so that the first request does not pay for it
+        void Load(const std::string& file);
+
+        // Drop all cached templates / a single cached template. They will be re-parsed on next use.
+        void Reload() noexcept;
+        void Reload(std::string_view file) noexcept;
+
+        // How often the last write time of a cached file is checked. A value of 0 means the file is
+        // checked on every render. Should only be called during setup, before Run().
+        inline void SetCheckInterval(std::chrono::milliseconds interval) noexcept { m_checkInterval = interval; }
+
+    private:
+        struct Entry
+        {
+            inja::Template tmpl;
+            std::filesystem::file_time_type lastWriteTime;
+            std::atomic<std::chrono::steady_clock::rep> lastChecked;
+        };
+
+        ND bool IsFresh(const std::string& file, Entry& entry) const noexcept;
+        ND std::shared_ptr<Entry> Parse(const std::string& file, std::optional<std::filesystem::file_time_type> knownLastWriteTime = std::nullopt);
+
+        inja::Environment& m_env;
+        std::chrono::milliseconds m_checkInterval{ 1000 };
+
+        // NOTE: The mutex does not only protect the map. inja::Environment::parse_template() will
+        //       write to the environment's template storage when it comes across an include, so
+        //       rendering (which reads that storage) must be done while holding a shared lock.
+        mutable std::shared_mutex m_mutex;
+        std::unordered_map<std::string, std::shared_ptr<Entry>, string_hash, std::equal_to<>> m_templates;
+    };
+}
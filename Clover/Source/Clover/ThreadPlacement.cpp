@@ -0,0 +1,218 @@
+#include "pch.hpp"
+#include "ThreadPlacement.hpp"
+#include "Log.hpp"
+
+#ifdef PLATFORM_LINUX
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+namespace Clover
+{
+#ifdef PLATFORM_LINUX
+    // "0-3,8,10-11" -> { 0, 1, 2, 3, 8, 10, 11 }
+    static std::vector<unsigned int> ParseCpuList(std::string_view list)
+    {
+        std::vector<unsigned int> cpus;
+        while (!list.empty())
+        {
+            std::size_t comma = list.find(',');
+            std::string_view range = list.substr(0, comma);
+            list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+
+            while (!range.empty() && std::isspace(static_cast<unsigned char>(range.back())))
+                range.remove_suffix(1);
+
+            unsigned int first = 0;
+            unsigned int last = 0;
+            std::size_t dash = range.find('-');
+            if (std::from_chars(range.data(), range.data() + range.size(), first).ec != std::errc())
+                continue;
+            last = first;
+            if (dash != std::string_view::npos && std::from_chars(range.data() + dash + 1, range.data() + range.size(), last).ec != std::errc())
+                continue;
+
+            for (unsigned int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+#endif
+
+    const CpuTopology& CpuTopology::Get()
+    {
+        static const CpuTopology s_topology;
+        return s_topology;
+    }
+
+    CpuTopology::CpuTopology()
+    {
+#ifdef PLATFORM_LINUX
+        // Only the CPUs we are allowed to run on (taskset, cgroups) are of any use
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        {
+            for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &allowed))
+                    m_cpus.push_back(cpu);
+            }
+        }
+
+        std::error_code ec;
+        for (unsigned int node = 0; ; ++node)
+        {
+            std::filesystem::path cpulist = std::format("/sys/devices/system/node/node{0}/cpulist", node);
+            if (!std::filesystem::exists(cpulist, ec))
+                break;
+
+            std::ifstream file(cpulist);
+            std::string line;
+            std::getline(file, line);
+
+            std::vector<unsigned int> cpus;
+            for (unsigned int cpu : ParseCpuList(line))
+            {
+                if (std::ranges::find(m_cpus, cpu) != m_cpus.end())
+                {
+                    cpus.push_back(cpu);
+                    m_nodeOf[cpu] = node;
+                }
+            }
+            m_nodes.push_back(std::move(cpus));
+        }
+#endif
+
+        if (m_cpus.empty())
+        {
+            for (unsigned int cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu)
+                m_cpus.push_back(cpu);
+        }
+
+        // Without NUMA information, everything is on one node
+        if (m_nodes.empty())
+            m_nodes.push_back(m_cpus);
+    }
+
+    unsigned int CpuTopology::NodeOf(unsigned int cpu) const noexcept
+    {
+        auto itr = m_nodeOf.find(cpu);
+        return itr == m_nodeOf.end() ? 0 : itr->second;
+    }
+
+    std::vector<unsigned int> CpuTopology::CpusByNode() const
+    {
+        std::vector<unsigned int> cpus;
+        cpus.reserve(m_cpus.size());
+        for (const auto& node : m_nodes)
+            cpus.insert(cpus.end(), node.begin(), node.end());
+
+        // A CPU that sysfs did not list under any node still counts
+        for (unsigned int cpu : m_cpus)
+        {
+            if (std::ranges::find(cpus, cpu) == cpus.end())
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    ThreadPlan::ThreadPlan(const ThreadPlacement& placement, unsigned int ioThreads) :
+        m_acceptCpus(placement.acceptCpus),
+        m_numaAware(placement.numaAware),
+        m_isolateAccept(placement.isolateAccept)
+    {
+#ifndef PLATFORM_LINUX
+        if (placement.pinIOThreads || placement.numaAware || !placement.computeCpus.empty() || placement.isolateCompute || !placement.acceptCpus.empty())
+            LOG_WARN("[CORE] ThreadPlacement: Pinning threads is only supported on Linux. Threads will not be pinned");
+#endif
+
+        const CpuTopology& topology = CpuTopology::Get();
+
+        // One CPU per io thread
+        if (placement.pinIOThreads)
+        {
+            std::vector<unsigned int> cpus = !placement.ioCpus.empty() ? placement.ioCpus :
+                placement.numaAware ? topology.CpusByNode() : topology.Cpus();
+
+            m_ioCpus.reserve(ioThreads);
+            for (unsigned int iii = 0; iii < ioThreads; ++iii)
+                m_ioCpus.push_back(cpus[iii % cpus.size()]);
+
+            if (ioThreads > cpus.size())
+                LOG_WARN("[CORE] ThreadPlacement: {0} io threads are sharing {1} CPUs", ioThreads, cpus.size());
+        }
+
+        if (!placement.computeCpus.empty())
+        {
+            m_computeCpus = placement.computeCpus;
+        }
+        else if (placement.isolateCompute)
+        {
+            for (unsigned int cpu : topology.Cpus())
+            {
+                if (std::ranges::find(m_ioCpus, cpu) == m_ioCpus.end() && std::ranges::find(m_acceptCpus, cpu) == m_acceptCpus.end())
+                    m_computeCpus.push_back(cpu);
+            }
+
+            if (m_computeCpus.empty())
+                LOG_WARN("[CORE] ThreadPlacement: No CPUs are left over for the compute pool, so it will not be isolated");
+        }
+    }
+
+    void ThreadPlan::ApplyToIOThread(unsigned int index) const noexcept
+    {
+        if (!m_ioCpus.empty())
+            PinCurrentThread(std::span<const unsigned int>(&m_ioCpus[index % m_ioCpus.size()], 1));
+
+        // Only after pinning, so that "local" means the node the thread is going to stay on
+        if (m_numaAware)
+            PreferLocalMemory();
+    }
+    void ThreadPlan::ApplyToComputeThread() const noexcept
+    {
+        if (!m_computeCpus.empty())
+            PinCurrentThread(m_computeCpus);
+    }
+    void ThreadPlan::ApplyToAcceptThread() const noexcept
+    {
+        if (!m_acceptCpus.empty())
+            PinCurrentThread(m_acceptCpus);
+    }
+
+    bool PinCurrentThread(std::span<const unsigned int> cpus) noexcept
+    {
+#ifdef PLATFORM_LINUX
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned int cpu : cpus)
+        {
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (result != 0)
+        {
+            LOG_WARN("[CORE] Failed to pin thread to {0} CPU(s) starting at {1}: {2}", cpus.size(), cpus.empty() ? 0u : cpus.front(), std::strerror(result));
+            return false;
+        }
+        return true;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+
+    void PreferLocalMemory() noexcept
+    {
+#ifdef PLATFORM_LINUX
+        // glibc has no wrapper for set_mempolicy, and libnuma isn't worth a dependency for one call
+        if (syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) != 0)
+            LOG_WARN("[CORE] Failed to set the thread's memory policy to MPOL_LOCAL: {0}", std::strerror(errno));
+#endif
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "pch.hpp"
+
+namespace Clover
+{
+    // The CPUs this process may run on and the NUMA node each of them belongs to. Read once, from
+    // sched_getaffinity and /sys/devices/system/node on Linux. Elsewhere, and on machines without NUMA,
+    // every CPU is reported as being on node 0.
+    class CpuTopology
+    {
+    public:
+        ND static const CpuTopology& Get();
+
+        ND inline const std::vector<unsigned int>& Cpus() const noexcept { return m_cpus; }
+        ND inline std::size_t NodeCount() const noexcept { return m_nodes.size(); }
+        ND inline const std::vector<unsigned int>& NodeCpus(std::size_t node) const noexcept { return m_nodes[node]; }
+        ND unsigned int NodeOf(unsigned int cpu) const noexcept;
+
+        // Cpus(), but grouped node by node
+        ND std::vector<unsigned int> CpusByNode() const;
+
+    private:
+        CpuTopology();
+
+        std::vector<unsigned int> m_cpus;
+        std::vector<std::vector<unsigned int>> m_nodes;
+        std::unordered_map<unsigned int, unsigned int> m_nodeOf;
+    };
+
+    // Where the server's threads are allowed to run (see Application::SetThreadPlacement). By default
+    // nothing is pinned and the scheduler is free to move threads around. Pinning is only supported on
+    // Linux; elsewhere a placement is ignored with a warning.
+    struct ThreadPlacement
+    {
+        // Pin each io thread to a single CPU, taken from 'ioCpus' in order (wrapping around if there are
+        // more threads than CPUs). If 'ioCpus' is empty, every CPU the process may run on is used.
+        bool pinIOThreads = false;
+        std::vector<unsigned int> ioCpus;
+
+        // When picking the io CPUs automatically, fill one NUMA node before moving to the next, and have
+        // each io thread ask for its memory to come from its own node. Together with SetIOSharding, where
+        // a connection never leaves the thread that accepted it and each shard is created on its own
+        // thread, a connection's buffers and session objects stay on the node that serves it.
+        bool numaAware = false;
+
+        // Restrict the compute pool to 'computeCpus'. If that is empty and 'isolateCompute' is set, the
+        // compute pool gets every CPU that no io thread is pinned to.
+        std::vector<unsigned int> computeCpus;
+        bool isolateCompute = false;
+
+        // Accept connections on a dedicated thread (restricted to 'acceptCpus' if it is not empty) instead
+        // of on the io threads. Only applies to the shared io_context; a sharded server accepts on every shard.
+        bool isolateAccept = false;
+        std::vector<unsigned int> acceptCpus;
+    };
+
+    // A ThreadPlacement resolved against the CpuTopology. Safe to use from any thread once constructed.
+    class ThreadPlan
+    {
+    public:
+        ThreadPlan() noexcept = default;
+        ThreadPlan(const ThreadPlacement& placement, unsigned int ioThreads);
+
+        // Each should be called first thing on the thread it is for
+        void ApplyToIOThread(unsigned int index) const noexcept;
+        void ApplyToComputeThread() const noexcept;
+        void ApplyToAcceptThread() const noexcept;
+
+        ND inline bool IsolateAccept() const noexcept { return m_isolateAccept; }
+
+    private:
+        std::vector<unsigned int> m_ioCpus;
+        std::vector<unsigned int> m_computeCpus;
+        std::vector<unsigned int> m_acceptCpus;
+        bool m_numaAware = false;
+        bool m_isolateAccept = false;
+    };
+
+    // Restrict the calling thread to 'cpus'. Logs and returns false if that is not possible.
+    bool PinCurrentThread(std::span<const unsigned int> cpus) noexcept;
+
+    // Have memory allocated by the calling thread come from the NUMA node it is running on (MPOL_LOCAL),
+    // regardless of the policy the process was started with
+    void PreferLocalMemory() noexcept;
+}
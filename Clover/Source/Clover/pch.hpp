@@ -14,20 +14,38 @@
 #include <SDKDDKVer.h>
 #endif
 
+#ifdef PLATFORM_LINUX
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+
 #include "Core.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <latch>
+#include <limits>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
+#include <random>
+#include <shared_mutex>
 #include <source_location>
+#include <span>
 #include <string>
 #include <string.h>
 #include <string_view>
@@ -35,6 +53,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include <boost/beast/core.hpp>
@@ -42,11 +61,24 @@
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/websocket/ssl.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/beast/zlib.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/bind_cancellation_slot.hpp>
 #include <boost/asio/bind_executor.hpp>
+#include <boost/asio/cancellation_signal.hpp>
+#include <boost/asio/co_spawn.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#include <boost/asio/redirect_error.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/crc.hpp>
 #include <boost/make_unique.hpp>
 #include <boost/optional.hpp>
 
@@ -9,11 +9,36 @@ using Clover::SSLWebsocketSession;
 
 using Clover::Application;
 
+// A middleware stage (see Clover::MiddlewarePipeline) that logs requests that took too long
+struct SlowRequestLog
+{
+    std::chrono::milliseconds threshold;
+
+    void After(const Clover::RequestContext& context, http::status status, http::fields& /* header */) const
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clover::RequestContext::Clock::now() - context.Received());
+        if (elapsed > threshold)
+            LOG_WARN("Sandbox: A request took {0}ms (status {1})", elapsed.count(), static_cast<unsigned>(status));
+    }
+};
+
+// The number of io threads. One, unless SANDBOX_THREADS says otherwise (see Scripts/Benchmark-IOBackend.sh)
+static unsigned int SandboxThreads()
+{
+    const char* threads = std::getenv("SANDBOX_THREADS");
+    unsigned long count = threads != nullptr ? std::strtoul(threads, nullptr, 10) : 0;
+    return count > 0 ? static_cast<unsigned int>(count) : 1;
+}
+
 class Sandbox : public Clover::Application
 {
 public:
-	Sandbox() : Clover::Application("0.0.0.0", 8080, 1, "/dev/ssl/cert.pem", "/dev/ssl/key.pem", "/dev/ssl/dh.pem")
+	Sandbox() : Clover::Application("0.0.0.0", 8080, SandboxThreads(), "/dev/ssl/cert.pem", "/dev/ssl/key.pem", "/dev/ssl/dh.pem")
 	{
+        // Give each io thread its own io_context (and, with io_uring, its own ring) when asked to
+        const char* sharding = std::getenv("SANDBOX_IO_SHARDING");
+        SetIOSharding(sharding != nullptr && std::string_view(sharding) == "1");
+
         // Set the server version string (will be used as the "Server" response header field)
         SetServerVersion("Clover");
         
@@ -25,6 +50,9 @@ public:
         SetNotFoundTarget("error-handling/not_found.html");
         SetInternalServerErrorTarget("error-handling/internal_server_error.html");
 
+        // Stages are composed at compile time, so adding more of them does not add any per-request indirection
+        UseMiddleware(SlowRequestLog{ std::chrono::milliseconds(250) });
+
         
         // Register Targets
         // Registering a target is entirely optional. The idea here is that when a request comes
@@ -32,9 +60,27 @@ public:
         // if no data needs to be looked up, then there is no need to register the target. In short,
         // registering a target simply adds the data gathering step between receiving a request, and
         // generating the html response.
-        RegisterGETTarget("/home", [this](const Application::ParametersMap& parameters) -> json { return this->GetHomeData(parameters); });
+        //
+        // Rendered pages can optionally be cached. Here, the rendered '/home' page is reused for 5 seconds, after
+        // which it may be served stale for up to another 30 seconds while it is rebuilt in the background.
+        RegisterGETTarget("/home", [this](const Application::ParametersMap& parameters) -> json { return this->GetHomeData(parameters); },
+            { .cache = Clover::PageCache::Options{ .ttl = std::chrono::seconds(5), .staleWhileRevalidate = std::chrono::seconds(30) } });
+
+        // The front end's fetch calls want the data itself rather than a page, so the result is sent as JSON
+        RegisterGETTarget("/api/home", [this](const Application::ParametersMap& parameters) -> json { return this->GetHomeData(parameters); },
+            { .format = Clover::ResponseFormat::JSON });
 
-        RegisterPUTTarget("/preferences/update-user-image", [this](const Application::ParametersMap& parameters) -> json { return this->UpdateUserImage(parameters); });
+        // Uploads can be much larger than the default request body limit. Anything over the in-memory limit
+        // (see SetRequestBodySpooling) is written to a temporary file as it arrives.
+        RegisterPUTTarget("/preferences/update-user-image",
+            [this](const Application::ParametersMap& parameters, const Clover::RequestBody& body, const Clover::RequestContext&) -> json { return this->UpdateUserImage(parameters, body); },
+            { .maxBodySize = 8 * 1024 * 1024 });
+
+        // multipart/form-data posts are split into their fields and files (see Clover::MultipartForm). The parts
+        // are views into a body held in memory, but a spooled body's parts are copied out into files of their own
+        RegisterPOSTTarget("/preferences/update-profile",
+            [this](const Application::ParametersMap& parameters, const Clover::RequestBody& body, const Clover::RequestContext&) -> json { return this->UpdateProfile(parameters, body); },
+            { .maxBodySize = 8 * 1024 * 1024 });
     }
     virtual ~Sandbox() override {}
 
@@ -48,12 +94,35 @@ public:
         d["home"] = "some data";
         return d;
     }
-    json UpdateUserImage(const Application::ParametersMap& /* parameters */)
+    json UpdateUserImage(const Application::ParametersMap& /* parameters */, const Clover::RequestBody& body)
     {
         PROFILE_SCOPE("Sandbox::UpdateUserImage");
 
+        std::error_code ec;
+        json d;
+        d["update-user-image"] = body.SaveAs("front-end/images/user-image", ec);
+        d["bytes"] = body.Size();
+        if (ec)
+            LOG_WARN("Sandbox: Failed to save user image: {0}", ec.message());
+        return d;
+    }
+
+    json UpdateProfile(const Application::ParametersMap& /* parameters */, const Clover::RequestBody& body)
+    {
+        PROFILE_SCOPE("Sandbox::UpdateProfile");
+
+        Clover::MultipartForm form;
+        form.Parse(body);
+
         json d;
-        d["update-user-image"] = "some data";
+        d["display-name"] = form.Get("display-name");
+        if (const Clover::FormPart* image = form.Find("image"); image != nullptr && image->isFile && image->Size() > 0)
+        {
+            std::error_code ec;
+            d["update-user-image"] = image->SaveAs("front-end/images/user-image", ec);
+            if (ec)
+                LOG_WARN("Sandbox: Failed to save user image: {0}", ec.message());
+        }
         return d;
     }
 
@@ -0,0 +1,59 @@
+#!/bin/bash
+#
+# Compare the epoll and io_uring builds of the Sandbox under the same load. Each build is run in turn
+# and driven with wrk; the requests/sec and the CPU time (user + system) the server used are printed
+# for each, so the cost per request can be compared.
+#
+# Usage: ./Benchmark-IOBackend.sh [target] [connections] [duration] [server threads]
+#   e.g. ./Benchmark-IOBackend.sh /home 512 30s 8
+#
+# The server threads are the Sandbox's io threads (SANDBOX_THREADS), by default one per core. With more
+# than one, set SANDBOX_IO_SHARDING=1 as well to give each thread its own ring (see SetIOSharding).
+#
+# Requires wrk, liburing, and a Sandbox that listens on plain http (the default build detects TLS,
+# so plain requests are fine).
+
+TARGET=${1:-/home}
+CONNECTIONS=${2:-256}
+DURATION=${3:-30s}
+SERVER_THREADS=${4:-$(nproc)}
+THREADS=$(nproc)
+URL="http://127.0.0.1:8080${TARGET}"
+BINARY=Binaries/linux-x86_64/Release/Sandbox/Sandbox
+
+pushd .. > /dev/null
+
+for BACKEND in epoll io_uring; do
+   if [ "$BACKEND" = "io_uring" ]; then
+      Vendor/bin/Premake/Linux/premake5 --cc=gcc --file=Build.lua --io-uring gmake2 > /dev/null
+   else
+      Vendor/bin/Premake/Linux/premake5 --cc=gcc --file=Build.lua gmake2 > /dev/null
+   fi
+
+   # The defines change every translation unit, so always rebuild from scratch
+   make clean config=release > /dev/null
+   make -j"$THREADS" config=release > /dev/null || { echo "Build failed for $BACKEND"; exit 1; }
+
+   pushd Sandbox > /dev/null
+   SANDBOX_THREADS=$SERVER_THREADS ../$BINARY > /dev/null 2>&1 &
+   SERVER=$!
+   popd > /dev/null
+   sleep 2
+
+   # Warm the caches so both runs measure the steady state
+   wrk -t2 -c16 -d5s "$URL" > /dev/null
+
+   BEFORE=$(awk '{ print $14 + $15 }' /proc/$SERVER/stat)
+   RESULT=$(wrk -t"$THREADS" -c"$CONNECTIONS" -d"$DURATION" "$URL")
+   AFTER=$(awk '{ print $14 + $15 }' /proc/$SERVER/stat)
+
+   kill -INT $SERVER
+   wait $SERVER
+
+   REQUESTS=$(echo "$RESULT" | awk '/Requests\/sec/ { print $2 }')
+   TOTAL=$(echo "$RESULT" | awk '/requests in/ { print $1 }')
+   TICKS=$(( AFTER - BEFORE ))
+   echo "$BACKEND ($SERVER_THREADS server threads): $REQUESTS requests/sec, $TICKS CPU ticks ($(getconf CLK_TCK)/s) for $TOTAL requests"
+done
+
+popd > /dev/null
@@ -1,5 +1,6 @@
 #!/bin/bash
 
+# Extra options are passed through to premake, e.g. ./Setup-Linux.sh --io-uring
 pushd ..
-Vendor/bin/Premake/Linux/premake5 --cc=gcc --file=Build.lua gmake2
-popd
\ No newline at end of file
+Vendor/bin/Premake/Linux/premake5 --cc=gcc --file=Build.lua "$@" gmake2
+popd
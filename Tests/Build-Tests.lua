@@ -0,0 +1,24 @@
+project "Tests"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++latest"
+   targetdir "Binaries/%{cfg.buildcfg}"
+   staticruntime "off"
+
+   files { "Source/**.hpp", "Source/**.cpp" }
+
+   includedirs
+   {
+      "Source",
+
+	  -- Include Clover
+	  "../Clover/Source"
+   }
+
+   links
+   {
+      "Clover"
+   }
+
+   targetdir ("../Binaries/" .. OutputDir .. "/%{prj.name}")
+   objdir ("../Binaries/Intermediates/" .. OutputDir .. "/%{prj.name}")
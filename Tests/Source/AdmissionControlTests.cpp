@@ -0,0 +1,118 @@
+#include "Test.hpp"
+#include <Clover/AdmissionControl.hpp>
+
+using Clover::AdmissionControl;
+using Clover::AdmissionLimits;
+
+TEST_CASE(Admission_UnlimitedByDefault)
+{
+    AdmissionControl admission;
+    std::vector<AdmissionControl::RequestSlot> requests;
+    for (int iii = 0; iii < 100; ++iii)
+    {
+        requests.push_back(admission.TryBeginRequest());
+        CHECK(requests.back());
+    }
+
+    CHECK_EQ(admission.GetStats().inFlightRequests, 100u);
+    CHECK_EQ(admission.GetStats().shedRequests, 0u);
+    CHECK(!admission.AtConnectionLimit());
+
+    requests.clear();
+    CHECK_EQ(admission.GetStats().inFlightRequests, 0u);
+}
+
+TEST_CASE(Admission_ShedsRequestsOverTheLimit)
+{
+    AdmissionControl admission;
+    admission.SetLimits({ .maxInFlightRequests = 2 });
+
+    AdmissionControl::RequestSlot first = admission.TryBeginRequest();
+    AdmissionControl::RequestSlot second = admission.TryBeginRequest();
+    AdmissionControl::RequestSlot third = admission.TryBeginRequest();
+    CHECK(first);
+    CHECK(second);
+    CHECK(!third);
+    CHECK_EQ(admission.GetStats().inFlightRequests, 2u);
+    CHECK_EQ(admission.GetStats().shedRequests, 1u);
+
+    // Releasing twice (or releasing an empty slot) must not give back more than was taken
+    first.Release();
+    first.Release();
+    third.Release();
+    CHECK_EQ(admission.GetStats().inFlightRequests, 1u);
+
+    third = admission.TryBeginRequest();
+    CHECK(third);
+    CHECK(!admission.TryBeginRequest());
+    CHECK_EQ(admission.GetStats().shedRequests, 2u);
+}
+
+TEST_CASE(Admission_RequestSlotsMove)
+{
+    AdmissionControl admission;
+    admission.SetLimits({ .maxInFlightRequests = 2 });
+
+    AdmissionControl::RequestSlot slot = admission.TryBeginRequest();
+    {
+        // The moved-from slot no longer owns the place, so destroying it gives nothing back
+        AdmissionControl::RequestSlot moved(std::move(slot));
+        CHECK(moved);
+        CHECK(!slot);
+        CHECK_EQ(admission.GetStats().inFlightRequests, 1u);
+        slot = std::move(moved);
+    }
+    CHECK(slot);
+    CHECK_EQ(admission.GetStats().inFlightRequests, 1u);
+
+    // Assigning over a held slot gives its place back
+    slot = admission.TryBeginRequest();
+    CHECK(slot);
+    CHECK_EQ(admission.GetStats().inFlightRequests, 1u);
+
+    slot = {};
+    CHECK_EQ(admission.GetStats().inFlightRequests, 0u);
+}
+
+TEST_CASE(Admission_ConnectionLimit)
+{
+    AdmissionControl admission;
+    admission.SetLimits({ .maxConnections = 2 });
+    net::ip::address address = net::ip::make_address("10.0.0.1");
+
+    AdmissionControl::ConnectionSlot first = admission.TryAdmitConnection(address);
+    CHECK(!admission.AtConnectionLimit());
+    AdmissionControl::ConnectionSlot second = admission.TryAdmitConnection(address);
+    CHECK(first);
+    CHECK(second);
+    CHECK(admission.AtConnectionLimit());
+
+    CHECK(!admission.TryAdmitConnection(address));
+    CHECK_EQ(admission.GetStats().connections, 2u);
+    CHECK_EQ(admission.GetStats().rejectedConnections, 1u);
+
+    second.Release();
+    CHECK(!admission.AtConnectionLimit());
+    CHECK_EQ(admission.GetStats().connections, 1u);
+}
+
+TEST_CASE(Admission_PerAddressLimit)
+{
+    AdmissionControl admission;
+    admission.SetLimits({ .maxConnectionsPerIP = 1 });
+    net::ip::address first = net::ip::make_address("10.0.0.1");
+    net::ip::address second = net::ip::make_address("::1");
+
+    AdmissionControl::ConnectionSlot slot = admission.TryAdmitConnection(first);
+    CHECK(slot);
+    CHECK(!admission.TryAdmitConnection(first));
+    CHECK(admission.TryAdmitConnection(second));
+    CHECK_EQ(admission.GetStats().rejectedConnections, 1u);
+
+    // Once the address's only connection closes, it can connect again
+    AdmissionControl::ConnectionSlot moved(std::move(slot));
+    CHECK(!admission.TryAdmitConnection(first));
+    moved.Release();
+    CHECK(admission.TryAdmitConnection(first));
+    CHECK_EQ(admission.GetStats().connections, 0u);
+}
@@ -0,0 +1,30 @@
+#include "Test.hpp"
+#include <exception>
+#include <iostream>
+
+// Runs every registered test and returns the number of failures, so a script can check the exit code
+int main(int , char** )
+{
+    int failures = 0;
+    for (const Tests::TestCase& test : Tests::Registry())
+    {
+        try
+        {
+            test.fn();
+            std::cout << "[PASS] " << test.name << '\n';
+        }
+        catch (const Tests::Failure& failure)
+        {
+            std::cout << "[FAIL] " << test.name << "\n       " << failure.message << '\n';
+            ++failures;
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << "[FAIL] " << test.name << "\n       Caught std::exception: " << e.what() << '\n';
+            ++failures;
+        }
+    }
+
+    std::cout << Tests::Registry().size() - failures << " passed, " << failures << " failed\n";
+    return failures;
+}
@@ -0,0 +1,122 @@
+#include "Test.hpp"
+#include <Clover/PageCache.hpp>
+#include <Clover/Parameters.hpp>
+
+using Clover::CachedPage;
+using Clover::ComputePool;
+using Clover::PageCache;
+using Clover::Parameters;
+
+namespace
+{
+    std::shared_ptr<const CachedPage> MakePage(std::string body)
+    {
+        auto page = std::make_shared<CachedPage>();
+        page->body = std::make_shared<const std::string>(std::move(body));
+        return page;
+    }
+}
+
+TEST_CASE(MakeKey_NoParameters)
+{
+    Parameters parameters;
+    CHECK_EQ(PageCache::MakeKey("/index", parameters), "/index");
+}
+
+TEST_CASE(MakeKey_SortsParameters)
+{
+    Parameters first;
+    first.Parse("y=2&x=1");
+    Parameters second;
+    second.Parse("x=1&y=2");
+
+    CHECK_EQ(PageCache::MakeKey("/a", first), "/a?x=1&y=2");
+    CHECK_EQ(PageCache::MakeKey("/a", first), PageCache::MakeKey("/a", second));
+}
+
+TEST_CASE(MakeKey_EscapesDecodedDelimiters)
+{
+    Parameters encoded;
+    encoded.Parse("a=1%26b%3D2");
+    Parameters split;
+    split.Parse("a=1&b=2");
+
+    CHECK_EQ(PageCache::MakeKey("/t", encoded), "/t?a=1%26b%3D2");
+    CHECK_EQ(PageCache::MakeKey("/t", split), "/t?a=1&b=2");
+}
+
+TEST_CASE(MakeKey_EscapesPercent)
+{
+    Parameters parameters;
+    parameters.Parse("p=100%25&k%3D=v");
+
+    CHECK_EQ(PageCache::MakeKey("/t", parameters), "/t?k%3D=v&p=100%25");
+}
+
+TEST_CASE(PageCache_HitsWithinTTL)
+{
+    ComputePool pool;
+    PageCache cache(pool);
+    PageCache::Options options{ .ttl = std::chrono::hours(1) };
+
+    int builds = 0;
+    auto build = [&builds]() { return MakePage(std::format("build {0}", ++builds)); };
+
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 1");
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 1");
+    CHECK_EQ(builds, 1);
+    CHECK_EQ(cache.Hits(), 1u);
+}
+
+TEST_CASE(PageCache_InvalidateDuringBuildIsNotLost)
+{
+    ComputePool pool;
+    PageCache cache(pool);
+    PageCache::Options options{ .ttl = std::chrono::hours(1), .staleWhileRevalidate = std::chrono::hours(1) };
+
+    // While the first build runs, a second caller parks on it and then the page is invalidated
+    int builds = 0;
+    std::shared_ptr<const CachedPage> parked;
+    PageCache::BuildFn build = [&]()
+        {
+            if (++builds == 1)
+            {
+                cache.AsyncGet("/a", options, build,
+                    [&parked](std::shared_ptr<const CachedPage> page, std::exception_ptr) { parked = std::move(page); });
+                cache.Invalidate("/a");
+            }
+            return MakePage(std::format("build {0}", builds));
+        };
+
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 1");
+
+    // The parked caller still gets the page of the build it waited on...
+    CHECK(parked != nullptr);
+    CHECK_EQ(*parked->body, "build 1");
+
+    // ...but it was not kept, so the next lookup builds again, and that page is kept
+    CHECK(cache.Peek("/a") == nullptr);
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 2");
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 2");
+    CHECK_EQ(builds, 2);
+}
+
+TEST_CASE(PageCache_ClearDuringBuildIsNotLost)
+{
+    ComputePool pool;
+    PageCache cache(pool);
+    PageCache::Options options{ .ttl = std::chrono::hours(1) };
+
+    int builds = 0;
+    PageCache::BuildFn build = [&]()
+        {
+            if (++builds == 1)
+                cache.Clear();
+            return MakePage(std::format("build {0}", builds));
+        };
+
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 1");
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 2");
+    CHECK_EQ(*cache.Get("/a", options, build)->body, "build 2");
+    CHECK_EQ(builds, 2);
+}
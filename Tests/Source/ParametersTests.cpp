@@ -0,0 +1,106 @@
+#include "Test.hpp"
+#include <Clover/Parameters.hpp>
+
+using Clover::Parameters;
+
+TEST_CASE(Parameters_PlainPairs)
+{
+    Parameters parameters;
+    parameters.Parse("a=1&b=two&empty=");
+
+    CHECK_EQ(parameters.size(), 3u);
+    CHECK_EQ(parameters.at("a"), "1");
+    CHECK_EQ(parameters.at("b"), "two");
+    CHECK(parameters.contains("empty"));
+    CHECK_EQ(parameters.at("empty"), "");
+    CHECK(!parameters.contains("c"));
+    CHECK_EQ(parameters.Get("c", "fallback"), "fallback");
+}
+
+TEST_CASE(Parameters_PercentAndPlusDecoding)
+{
+    Parameters parameters;
+    parameters.Parse("q=hello+world&x=%41%62c&%6Bey=v");
+
+    CHECK_EQ(parameters.at("q"), "hello world");
+    CHECK_EQ(parameters.at("x"), "Abc");
+    CHECK_EQ(parameters.at("key"), "v");
+}
+
+TEST_CASE(Parameters_DecodedDelimitersStayInTheValue)
+{
+    Parameters parameters;
+    parameters.Parse("a=1%26b%3D2");
+
+    CHECK_EQ(parameters.size(), 1u);
+    CHECK_EQ(parameters.at("a"), "1&b=2");
+}
+
+TEST_CASE(Parameters_MalformedEscapesAreKept)
+{
+    Parameters parameters;
+    parameters.Parse("a=%zz&b=%4&c=50%");
+
+    CHECK_EQ(parameters.at("a"), "%zz");
+    CHECK_EQ(parameters.at("b"), "%4");
+    CHECK_EQ(parameters.at("c"), "50%");
+}
+
+TEST_CASE(Parameters_FirstDuplicateWins)
+{
+    Parameters parameters;
+    parameters.Parse("a=1&b=2&a=3");
+
+    CHECK_EQ(parameters.size(), 2u);
+    CHECK_EQ(parameters.at("a"), "1");
+}
+
+TEST_CASE(Parameters_DuplicatesAreComparedAfterDecoding)
+{
+    Parameters parameters;
+    parameters.Parse("a=1&%61=2");
+
+    CHECK_EQ(parameters.size(), 1u);
+    CHECK_EQ(parameters.at("a"), "1");
+}
+
+TEST_CASE(Parameters_SkipsEmptyPairsAndKeysWithoutValues)
+{
+    Parameters parameters;
+    parameters.Parse("&&flag&a=1;b=2&");
+
+    CHECK_EQ(parameters.size(), 2u);
+    CHECK(!parameters.contains("flag"));
+    CHECK_EQ(parameters.at("a"), "1");
+    CHECK_EQ(parameters.at("b"), "2");
+}
+
+TEST_CASE(Parameters_AtThrowsForMissingKey)
+{
+    Parameters parameters;
+    parameters.Parse("a=1");
+
+    bool threw = false;
+    try
+    {
+        (void)parameters.at("b");
+    }
+    catch (const std::out_of_range&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+TEST_CASE(Parameters_RouteValuesOverrideQuery)
+{
+    Parameters parameters;
+    parameters.Parse("id=query");
+    parameters.insert_or_assign("id", "route");
+    parameters.insert_or_assign("other", "value");
+
+    CHECK_EQ(parameters.size(), 2u);
+    CHECK_EQ(parameters.at("id"), "route");
+    CHECK(!parameters.emplace("other", "again"));
+    CHECK_EQ(parameters.at("other"), "value");
+}
@@ -0,0 +1,145 @@
+#include "Test.hpp"
+#include <Clover/Router.hpp>
+
+using Clover::Router;
+
+namespace
+{
+    // Insert a route that is expected to be valid, failing the test if it isn't
+    void Insert(Router<int>& router, http::verb method, std::string_view pattern, int value)
+    {
+        std::string error;
+        if (!router.Insert(method, pattern, value, error))
+            throw Tests::Failure{ std::format("Insert('{0}') failed: {1}", pattern, error) };
+    }
+
+    // The value matched for 'path', or -1 if nothing matched
+    int Find(const Router<int>& router, std::string_view path, http::verb method = http::verb::get)
+    {
+        Router<int>::Match match = router.Find(method, path);
+        return match.value != nullptr ? *match.value : -1;
+    }
+}
+
+TEST_CASE(Router_StaticRoutes)
+{
+    Router<int> router;
+    Insert(router, http::verb::get, "/users", 1);
+    Insert(router, http::verb::get, "/user", 2);
+    Insert(router, http::verb::get, "/u", 3);
+    Insert(router, http::verb::get, "/", 4);
+
+    // Each insert splits the edges of the ones before it
+    CHECK_EQ(Find(router, "/users"), 1);
+    CHECK_EQ(Find(router, "/user"), 2);
+    CHECK_EQ(Find(router, "/u"), 3);
+    CHECK_EQ(Find(router, "/"), 4);
+    CHECK_EQ(Find(router, "/use"), -1);
+    CHECK_EQ(Find(router, "/users/"), -1);
+    CHECK(!router.Find(http::verb::get, "/use").pathMatched);
+}
+
+TEST_CASE(Router_ParameterCapture)
+{
+    Router<int> router;
+    Insert(router, http::verb::get, "/user/{id}/posts/{post}", 1);
+
+    Router<int>::Match match = router.Find(http::verb::get, "/user/42/posts/7");
+    CHECK(match.value != nullptr);
+    CHECK_EQ(match.parameters.size(), 2u);
+    CHECK_EQ(match.parameters.Get("id"), "42");
+    CHECK_EQ(match.parameters.Get("post"), "7");
+    CHECK_EQ(match.parameters.Get("missing"), "");
+
+    // A parameter matches one non-empty segment
+    CHECK_EQ(Find(router, "/user//posts/7"), -1);
+    CHECK_EQ(Find(router, "/user/42/43/posts/7"), -1);
+}
+
+TEST_CASE(Router_StaticBeatsParameterBeatsWildcard)
+{
+    Router<int> router;
+    Insert(router, http::verb::get, "/user/*rest", 3);
+    Insert(router, http::verb::get, "/user/{id}", 2);
+    Insert(router, http::verb::get, "/user/settings", 1);
+
+    CHECK_EQ(Find(router, "/user/settings"), 1);
+    CHECK_EQ(Find(router, "/user/42"), 2);
+    CHECK_EQ(Find(router, "/user/42/avatar"), 3);
+
+    Router<int>::Match match = router.Find(http::verb::get, "/user/42/avatar");
+    CHECK_EQ(match.parameters.size(), 1u);
+    CHECK_EQ(match.parameters.Get("rest"), "42/avatar");
+}
+
+TEST_CASE(Router_BacktracksFromDeadEnds)
+{
+    Router<int> router;
+    Insert(router, http::verb::get, "/user/settings", 1);
+    Insert(router, http::verb::get, "/user/{id}/posts", 2);
+
+    // "settings" matches the static branch first, which has nothing for "/posts"
+    Router<int>::Match match = router.Find(http::verb::get, "/user/settings/posts");
+    CHECK(match.value != nullptr);
+    CHECK_EQ(*match.value, 2);
+    CHECK_EQ(match.parameters.size(), 1u);
+    CHECK_EQ(match.parameters.Get("id"), "settings");
+}
+
+TEST_CASE(Router_WildcardMatchesEmptyRemainder)
+{
+    Router<int> router;
+    Insert(router, http::verb::get, "/static/*path", 1);
+    Insert(router, http::verb::get, "/files/*", 2);
+
+    Router<int>::Match match = router.Find(http::verb::get, "/static/");
+    CHECK(match.value != nullptr);
+    CHECK_EQ(match.parameters.Get("path"), "");
+
+    match = router.Find(http::verb::get, "/files/a/b.txt");
+    CHECK(match.value != nullptr);
+    CHECK_EQ(match.parameters.Get("*"), "a/b.txt");
+
+    CHECK_EQ(Find(router, "/static"), -1);
+}
+
+TEST_CASE(Router_MethodMismatchStillMatchesPath)
+{
+    Router<int> router;
+    Insert(router, http::verb::get, "/item/{id}", 1);
+    Insert(router, http::verb::put, "/item/{id}", 2);
+
+    CHECK_EQ(Find(router, "/item/9", http::verb::get), 1);
+    CHECK_EQ(Find(router, "/item/9", http::verb::put), 2);
+
+    Router<int>::Match match = router.Find(http::verb::delete_, "/item/9");
+    CHECK(match.value == nullptr);
+    CHECK(match.pathMatched);
+
+    match = router.Find(http::verb::delete_, "/other");
+    CHECK(match.value == nullptr);
+    CHECK(!match.pathMatched);
+}
+
+TEST_CASE(Router_RejectsInvalidPatterns)
+{
+    Router<int> router;
+    Insert(router, http::verb::get, "/user/{id}", 1);
+    Insert(router, http::verb::get, "/files/*path", 2);
+
+    std::string error;
+    CHECK(!router.Insert(http::verb::get, "/user/{id}", 3, error));
+    CHECK(!error.empty());
+    CHECK(!router.Insert(http::verb::get, "/user/{name}", 3, error));
+    CHECK(!router.Insert(http::verb::get, "/files/*rest", 3, error));
+    CHECK(!router.Insert(http::verb::get, "/a/{", 3, error));
+    CHECK(!router.Insert(http::verb::get, "/a/{}", 3, error));
+    CHECK(!router.Insert(http::verb::get, "/a/{id}x", 3, error));
+    CHECK(!router.Insert(http::verb::get, "/a/*rest/more", 3, error));
+    CHECK(!router.Insert(http::verb::get, "/{a}/{b}/{c}/{d}/{e}/{f}/{g}/{h}/{i}", 3, error));
+
+    // A failed insert never changes which routes match
+    CHECK_EQ(Find(router, "/user/5"), 1);
+    CHECK_EQ(router.Find(http::verb::get, "/user/5").parameters.Get("id"), "5");
+    CHECK_EQ(Find(router, "/files/x"), 2);
+}
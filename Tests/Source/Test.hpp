@@ -0,0 +1,54 @@
+#pragma once
+#include <format>
+#include <string>
+#include <vector>
+
+// A minimal test harness, so the tests don't pull in a framework. A test is a function declared with
+// TEST_CASE, which registers itself before main() runs. CHECK and CHECK_EQ throw on failure, which ends
+// the test; main() reports it and carries on with the next one.
+namespace Tests
+{
+    using TestFn = void(*)();
+
+    struct TestCase
+    {
+        const char* name;
+        TestFn fn;
+    };
+
+    struct Failure
+    {
+        std::string message;
+    };
+
+    inline std::vector<TestCase>& Registry()
+    {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    struct Registrar
+    {
+        Registrar(const char* name, TestFn fn) { Registry().push_back({ name, fn }); }
+    };
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static ::Tests::Registrar s_##name##Registrar(#name, &name); \
+    static void name()
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) \
+            throw ::Tests::Failure{ std::format("{0}:{1}: CHECK({2}) failed", __FILE__, __LINE__, #expr) }; \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        const auto& _actual = (actual); \
+        const auto& _expected = (expected); \
+        if (!(_actual == _expected)) \
+            throw ::Tests::Failure{ std::format("{0}:{1}: CHECK_EQ({2}, {3}) failed: '{4}' != '{5}'", \
+                __FILE__, __LINE__, #actual, #expected, _actual, _expected) }; \
+    } while (0)